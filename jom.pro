@@ -4,7 +4,10 @@ sub_app.subdir = src/app
 sub_app.depends = sub_jomlib
 sub_tests.subdir = tests
 sub_tests.depends = sub_jomlib sub_app
-SUBDIRS = sub_app sub_jomlib sub_tests
+sub_benchmarks.subdir = tests/benchmarks
+sub_benchmarks.depends = sub_jomlib
+sub_scaling.subdir = tests/scaling
+SUBDIRS = sub_app sub_jomlib sub_tests sub_benchmarks sub_scaling
 
 OTHER_FILES = \
     changelog.txt \
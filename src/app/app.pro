@@ -1,6 +1,6 @@
 TEMPLATE = app
 DESTDIR = ../../bin
-QT = core
+QT = core network
 CONFIG += console
 DEFINES += QT_NO_CAST_FROM_ASCII QT_NO_CAST_TO_ASCII
 TARGET = jom
@@ -16,8 +16,9 @@ contains(QMAKE_CXXFLAGS_RELEASE, -MT) {
 }
 
 INCLUDEPATH += ../jomlib
-HEADERS = application.h
-SOURCES = main.cpp application.cpp
+LIBS += -lpsapi
+HEADERS = application.h buildserver.h buildwatcher.h statusserver.h workerdaemon.h
+SOURCES = main.cpp application.cpp buildserver.cpp buildwatcher.cpp statusserver.cpp workerdaemon.cpp
 RESOURCES = app.qrc
 
 JOM_VERSION = $$cat(version.txt, lines)
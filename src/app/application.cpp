@@ -35,7 +35,7 @@ namespace NMakeFile {
 
 static bool isSubJOM()
 {
-    return GetEnvironmentVariableA("_JOMSRVKEY_", NULL, 0) > 0;
+    return GetEnvironmentVariableA("_JOMSEMAPHORE_", NULL, 0) > 0;
 }
 
 Application::Application(int &argc, char **argv)
@@ -49,6 +49,13 @@ Application::~Application()
     IoCompletionPort::destroyInstance();
 }
 
+void Application::showLogo()
+{
+    fprintf(stderr, "\njom %d.%d.%d - empower your cores\n\n",
+        JOM_VERSION_MAJOR, JOM_VERSION_MINOR, JOM_VERSION_PATCH);
+    fflush(stderr);
+}
+
 void Application::exit(int exitCode)
 {
     QCoreApplication::exit(exitCode);
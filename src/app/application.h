@@ -40,6 +40,7 @@ public:
     ~Application();
 
     bool isSubJOM() const { return m_bIsSubJOM; }
+    static void showLogo();
 
 public slots:
     void exit(int exitCode);
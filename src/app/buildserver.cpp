@@ -0,0 +1,737 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "buildserver.h"
+#include "application.h"
+#include <exception.h>
+#include <fastfileinfo.h>
+#include <jobserver.h>
+#include <macrotable.h>
+#include <makefile.h>
+#include <makefilefactory.h>
+#include <options.h>
+#include <sharedstatcache.h>
+#include <targetexecutor.h>
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QProcess>
+#include <QtCore/QSet>
+#include <QtCore/QtEndian>
+#include <QtCore/QVector>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
+#include <cstdio>
+#include <fcntl.h>
+#include <io.h>
+
+namespace NMakeFile {
+
+enum MessageType
+{
+    BuildRequest = 1,
+    StandardOutput,
+    StandardError,
+    BuildFinished,
+    RequestDeclined
+};
+
+static const int maxCachedMakefiles = 16;
+static const char markerFileName[] = ".jomserver";
+
+/**
+ * A message is its size as big endian quint32, the message type and the payload.
+ */
+static void writeMessage(QLocalSocket *socket, MessageType type, const QByteArray &payload)
+{
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream << quint32(payload.size() + 1) << quint8(type);
+    message.append(payload);
+    socket->write(message);
+}
+
+static bool readMessage(QLocalSocket *socket, quint8 *type, QByteArray *payload)
+{
+    quint32 size;
+    if (socket->peek(reinterpret_cast<char *>(&size), sizeof(size)) < qint64(sizeof(size)))
+        return false;
+    size = qFromBigEndian(size);
+    if (socket->bytesAvailable() < qint64(sizeof(size) + size))
+        return false;
+    socket->read(sizeof(size));
+    const QByteArray message = socket->read(size);
+    *type = quint8(message.at(0));
+    *payload = message.mid(1);
+    return true;
+}
+
+static void writeBinary(FILE *stream, const QByteArray &data)
+{
+    const int fd = _fileno(stream);
+    const int origMode = _setmode(fd, _O_BINARY);
+    fwrite(data.constData(), sizeof(char), data.size(), stream);
+    fflush(stream);
+    if (origMode != -1)
+        _setmode(fd, origMode);
+}
+
+static QString normalizedFilePath(const QString &filePath)
+{
+    return QDir::toNativeSeparators(QDir::cleanPath(filePath)).toLower();
+}
+
+static void collectSourceFiles(const Makefile *makefile, QStringList *filePaths)
+{
+    foreach (const QString &fileName, makefile->sourceFiles())
+        filePaths->append(normalizedFilePath(fileName));
+    foreach (const Makefile *subMakefile, makefile->subMakefiles())
+        collectSourceFiles(subMakefile, filePaths);
+}
+
+PipeReader::PipeReader(int fd, int channel, QObject *parent)
+    : QThread(parent)
+    , m_fd(fd)
+    , m_channel(channel)
+{
+}
+
+void PipeReader::run()
+{
+    char buffer[4096];
+    for (;;) {
+        const int count = _read(m_fd, buffer, sizeof(buffer));
+        if (count <= 0)
+            break;
+        emit dataRead(m_channel, QByteArray(buffer, count));
+    }
+    _close(m_fd);
+}
+
+OutputCapture::OutputCapture(QObject *parent)
+    : QObject(parent)
+{
+}
+
+OutputCapture::~OutputCapture()
+{
+    stop();
+}
+
+bool OutputCapture::start()
+{
+    fflush(stdout);
+    fflush(stderr);
+    FILE *streams[] = { stdout, stderr };
+    for (int i = 0; i < 2; ++i) {
+        const int fd = _fileno(streams[i]);
+        int fds[2];
+        if (_pipe(fds, 65536, _O_BINARY | _O_NOINHERIT) != 0) {
+            stop();
+            return false;
+        }
+
+        Channel &channel = m_channels[i];
+        channel.savedFd = _dup(fd);
+        _dup2(fds[1], fd);
+        _close(fds[1]);
+        _setmode(fd, _O_TEXT);
+
+        // Processes that outlive the build must not keep the pipe open.
+        SetHandleInformation(reinterpret_cast<HANDLE>(_get_osfhandle(fd)), HANDLE_FLAG_INHERIT, 0);
+
+        channel.reader = new PipeReader(fds[0], i, this);
+        connect(channel.reader, &PipeReader::dataRead,
+                this, &OutputCapture::outputAvailable, Qt::QueuedConnection);
+        channel.reader->start();
+    }
+    return true;
+}
+
+/**
+ * Restores stdout and stderr and emits the output that is still in the pipes.
+ */
+void OutputCapture::stop()
+{
+    fflush(stdout);
+    fflush(stderr);
+    FILE *streams[] = { stdout, stderr };
+    for (int i = 0; i < 2; ++i) {
+        Channel &channel = m_channels[i];
+        if (channel.savedFd == -1)
+            continue;
+        _dup2(channel.savedFd, _fileno(streams[i]));
+        _close(channel.savedFd);
+        channel.savedFd = -1;
+        channel.reader->wait();
+        delete channel.reader;
+        channel.reader = 0;
+    }
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+}
+
+DirectoryWatcher::DirectoryWatcher(const QString &directory, QObject *parent)
+    : QThread(parent)
+    , m_directory(QDir::toNativeSeparators(directory))
+    , m_markerFilePath(m_directory + QLatin1Char('\\') + QLatin1String(markerFileName))
+    , m_hStopEvent(CreateEvent(NULL, TRUE, FALSE, NULL))
+    , m_hWatchingEvent(CreateEvent(NULL, TRUE, FALSE, NULL))
+    , m_markerCount(0)
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    stop();
+    CloseHandle(m_hStopEvent);
+    CloseHandle(m_hWatchingEvent);
+    QFile::remove(m_markerFilePath);
+}
+
+/**
+ * Starts the thread and returns when changes are recorded.
+ */
+void DirectoryWatcher::startWatching()
+{
+    start();
+    WaitForSingleObject(m_hWatchingEvent, INFINITE);
+}
+
+void DirectoryWatcher::stop()
+{
+    SetEvent(m_hStopEvent);
+    wait();
+}
+
+/**
+ * Changes the marker file. Returns false, if the watcher won't report that.
+ */
+bool DirectoryWatcher::writeMarkerFile()
+{
+    if (!isRunning())
+        return false;
+    QFile file(m_markerFilePath);
+    if (!file.open(QFile::WriteOnly))
+        return false;
+    return file.write(QByteArray::number(++m_markerCount)) > 0;
+}
+
+void DirectoryWatcher::run()
+{
+    HANDLE hDirectory = CreateFileW(reinterpret_cast<const wchar_t *>(m_directory.utf16()),
+                                    FILE_LIST_DIRECTORY,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    NULL, OPEN_EXISTING,
+                                    FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (hDirectory == INVALID_HANDLE_VALUE) {
+        qWarning("Cannot watch %s for changes.", qPrintable(m_directory));
+        SetEvent(m_hWatchingEvent);
+        return;
+    }
+
+    const QString directoryPrefix = m_directory + QLatin1Char('\\');
+    const QString markerFileNameString = QLatin1String(markerFileName);
+    const DWORD notifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME
+            | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+    QVector<DWORD> buffer(16384);
+    OVERLAPPED overlapped = {0};
+    overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    HANDLE handles[] = { m_hStopEvent, overlapped.hEvent };
+    for (;;) {
+        ResetEvent(overlapped.hEvent);
+        const BOOL watching = ReadDirectoryChangesW(hDirectory, buffer.data(),
+                                                    DWORD(buffer.size() * sizeof(DWORD)), TRUE,
+                                                    notifyFilter, NULL, &overlapped, NULL);
+        SetEvent(m_hWatchingEvent);
+        if (!watching) {
+            qWarning("Cannot watch %s for changes.", qPrintable(m_directory));
+            break;
+        }
+
+        DWORD bytesReturned = 0;
+        if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+            CancelIo(hDirectory);
+            GetOverlappedResult(hDirectory, &overlapped, &bytesReturned, TRUE);
+            break;
+        }
+        if (!GetOverlappedResult(hDirectory, &overlapped, &bytesReturned, FALSE))
+            break;
+
+        if (bytesReturned == 0) {
+            // More changes happened than fit into the buffer.
+            emit overflow();
+            continue;
+        }
+
+        QStringList filePaths;
+        bool filesAddedOrRemoved = false;
+        bool markerFileSeen = false;
+        const char *p = reinterpret_cast<const char *>(buffer.constData());
+        for (;;) {
+            const FILE_NOTIFY_INFORMATION *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(p);
+            const QString fileName = QString::fromWCharArray(info->FileName,
+                                                             info->FileNameLength / sizeof(WCHAR));
+            if (fileName.compare(markerFileNameString, Qt::CaseInsensitive) == 0) {
+                markerFileSeen = true;
+            } else {
+                filePaths.append(directoryPrefix + fileName);
+                if (info->Action != FILE_ACTION_MODIFIED)
+                    filesAddedOrRemoved = true;
+            }
+            if (!info->NextEntryOffset)
+                break;
+            p += info->NextEntryOffset;
+        }
+        if (!filePaths.isEmpty())
+            emit filesChanged(filePaths, filesAddedOrRemoved);
+        if (markerFileSeen)
+            emit markerFileChanged();
+    }
+
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(hDirectory);
+}
+
+BuildServer::BuildServer(QObject *parent)
+    : QObject(parent)
+    , m_directory(QDir::currentPath())
+    , m_server(new QLocalServer(this))
+    , m_outputCapture(new OutputCapture(this))
+    , m_watcher(new DirectoryWatcher(m_directory, this))
+    , m_currentSocket(0)
+    , m_building(false)
+    , m_waitingForWatcher(false)
+    , m_printWorkingDir(false)
+    , m_jobServer(0)
+    , m_makefile(0)
+    , m_executor(0)
+{
+    connect(m_server, &QLocalServer::newConnection, this, &BuildServer::onNewConnection);
+    connect(m_outputCapture, &OutputCapture::outputAvailable,
+            this, &BuildServer::onOutputAvailable);
+    connect(m_watcher, &DirectoryWatcher::filesChanged, this, &BuildServer::onFilesChanged);
+    connect(m_watcher, &DirectoryWatcher::markerFileChanged,
+            this, &BuildServer::onMarkerFileChanged);
+    connect(m_watcher, &DirectoryWatcher::overflow, this, &BuildServer::onOverflow);
+    SharedStatCache::create();
+}
+
+BuildServer::~BuildServer()
+{
+    m_watcher->stop();
+    clearParseCache();
+}
+
+QString BuildServer::serverName(const QString &directory)
+{
+    const QByteArray key = normalizedFilePath(directory).toUtf8();
+    return QLatin1String("jom-")
+            + QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex().left(16));
+}
+
+bool BuildServer::listen()
+{
+    const QString name = serverName(m_directory);
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(1000)) {
+        m_errorString = QLatin1String("A build server is already running for this directory.");
+        return false;
+    }
+
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(name)) {
+        m_errorString = m_server->errorString();
+        return false;
+    }
+
+    m_watcher->startWatching();
+    fprintf(stderr, "jom: build server running for %s\n",
+            qPrintable(QDir::toNativeSeparators(m_directory)));
+    fflush(stderr);
+    return true;
+}
+
+/**
+ * Runs the event loop until the application quits.
+ * An exception that is thrown during a build fails only this build.
+ */
+int BuildServer::exec()
+{
+    for (;;) {
+        try {
+            return QCoreApplication::exec();
+        } catch (const Exception &e) {
+            fprintf(stderr, "jom: %s\n", qPrintable(e.message()));
+            finishBuild(2);
+        }
+    }
+}
+
+/**
+ * Sends the build to the server of the current directory and prints its output.
+ * Returns false if there is no server or if the server declined the build.
+ */
+bool BuildServer::forwardBuild(const QStringList &arguments, int *exitCode)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName(QDir::currentPath()));
+    if (!socket.waitForConnected(1000))
+        return false;
+
+    QByteArray request;
+    QDataStream stream(&request, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << QDir::currentPath() << arguments << QProcess::systemEnvironment();
+    writeMessage(&socket, BuildRequest, request);
+    socket.waitForBytesWritten();
+
+    for (;;) {
+        quint8 type;
+        QByteArray payload;
+        while (readMessage(&socket, &type, &payload)) {
+            switch (type) {
+            case StandardOutput:
+                writeBinary(stdout, payload);
+                break;
+            case StandardError:
+                writeBinary(stderr, payload);
+                break;
+            case BuildFinished:
+                *exitCode = payload.toInt();
+                return true;
+            case RequestDeclined:
+                return false;
+            }
+        }
+        if (!socket.waitForReadyRead(-1)) {
+            fputs("jom: lost the connection to the build server\n", stderr);
+            *exitCode = 2;
+            return true;
+        }
+    }
+}
+
+void BuildServer::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, &BuildServer::onReadyRead);
+        connect(socket, &QLocalSocket::disconnected, this, &BuildServer::onClientDisconnected);
+    }
+}
+
+void BuildServer::onReadyRead()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    quint8 type;
+    QByteArray payload;
+    while (readMessage(socket, &type, &payload)) {
+        if (type != BuildRequest)
+            continue;
+        Request request;
+        request.socket = socket;
+        QDataStream stream(payload);
+        stream.setVersion(QDataStream::Qt_5_2);
+        stream >> request.directory >> request.arguments >> request.environment;
+        if (stream.status() == QDataStream::Ok)
+            m_pendingRequests.append(request);
+    }
+    startNextBuild();
+}
+
+void BuildServer::onClientDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    QList<Request>::iterator it = m_pendingRequests.begin();
+    while (it != m_pendingRequests.end()) {
+        if (it->socket == socket)
+            it = m_pendingRequests.erase(it);
+        else
+            ++it;
+    }
+
+    if (socket == m_currentSocket) {
+        m_currentSocket = 0;
+        if (m_executor)
+            m_executor->abort();
+        finishBuild(2);
+    }
+    socket->deleteLater();
+}
+
+void BuildServer::onOutputAvailable(int channel, const QByteArray &data)
+{
+    if (m_currentSocket)
+        writeMessage(m_currentSocket, channel == 0 ? StandardOutput : StandardError, data);
+}
+
+/**
+ * Files may have been changed right before the request was sent. Their notifications
+ * are handled before the one of the marker file. Then the pending builds are started.
+ */
+void BuildServer::startNextBuild()
+{
+    if (m_building || m_waitingForWatcher || m_pendingRequests.isEmpty())
+        return;
+
+    if (m_watcher->writeMarkerFile()) {
+        m_waitingForWatcher = true;
+        return;
+    }
+
+    // We don't know what has changed.
+    FastFileInfo::clearCache();
+    reportOutdatedMakefiles(m_parseCache.count());
+    clearParseCache();
+    startPendingBuilds();
+}
+
+void BuildServer::onMarkerFileChanged()
+{
+    if (!m_waitingForWatcher)
+        return;
+    m_waitingForWatcher = false;
+    startPendingBuilds();
+}
+
+/**
+ * Files outside of the watched directory, like headers of other projects or libraries,
+ * may have changed since the last build. Their time stamps are read again.
+ */
+void BuildServer::startPendingBuilds()
+{
+    FastFileInfo::clearCacheOutside(m_directory);
+    while (!m_building && !m_pendingRequests.isEmpty())
+        startBuild(m_pendingRequests.takeFirst());
+}
+
+/**
+ * Builds like a jom process that was started with the request's command line.
+ * Requests for other directories and for options that only print information
+ * are declined. The front end handles them itself.
+ */
+void BuildServer::startBuild(const Request &request)
+{
+    bool accepted = QDir::cleanPath(request.directory).compare(m_directory, Qt::CaseInsensitive) == 0;
+    g_options = GlobalOptions();
+    if (accepted) {
+        MacroTable macroTable;
+        foreach (const QString &argument, request.arguments) {
+            if (argument.startsWith(QLatin1Char('@'))) {
+                accepted = false;
+            } else if (!argument.startsWith(QLatin1Char('/')) && !argument.startsWith(QLatin1Char('-'))
+                       && argument.contains(QLatin1Char('=')))
+            {
+                const QString name = argument.left(argument.indexOf(QLatin1Char('='))).trimmed();
+                if (!macroTable.isMacroNameValid(name))
+                    accepted = false;
+            }
+        }
+    }
+    if (accepted) {
+        Options options;
+        MacroTable macroTable;
+        QString fileName;
+        QStringList targets;
+        accepted = options.readCommandLineArguments(request.arguments, fileName, targets, macroTable)
+                && !options.showUsageAndExit && !options.showVersionAndExit
+                && !options.displayMakeInformation && !options.watchMode
+                && options.stderrFile.isEmpty();
+    }
+    if (!accepted || !m_outputCapture->start()) {
+        writeMessage(request.socket, RequestDeclined, QByteArray());
+        return;
+    }
+
+    m_building = true;
+    m_currentSocket = request.socket;
+
+    QStringList environment = request.environment;
+    environment.sort();
+    const QString key = request.arguments.join(QLatin1String("\n")) + QLatin1Char('\0')
+            + environment.join(QLatin1String("\n"));
+    CachedMakefile cached = m_parseCache.value(key);
+    if (!cached.makefile) {
+        MakefileFactory factory;
+        factory.setEnvironment(request.environment);
+        if (!factory.apply(request.arguments)) {
+            delete factory.makefile();
+            fprintf(stderr, "Error: %s\n", qPrintable(factory.errorString()));
+            finishBuild(2);
+            return;
+        }
+        cached.makefile = factory.makefile();
+        cached.activeTargets = factory.activeTargets();
+        collectSourceFiles(cached.makefile, &cached.sourceFiles);
+        if (m_parseCache.count() >= maxCachedMakefiles)
+            clearParseCache();
+        m_parseCache.insert(key, cached);
+    }
+
+    m_makefile = cached.makefile->clone();
+    const Options *options = m_makefile->options();
+    if (options->showLogo)
+        Application::showLogo();
+
+    m_printWorkingDir = options->printWorkingDir;
+    if (m_printWorkingDir) {
+        printf("jom: Entering directory '%s\n", qPrintable(QDir::toNativeSeparators(m_directory)));
+        fflush(stdout);
+    }
+
+    m_environment = m_makefile->macroTable()->environment();
+    SharedStatCache *sharedCache = SharedStatCache::instance();
+    if (sharedCache && options->shareStatCache)
+        sharedCache->advertise(&m_environment);
+    m_jobServer = new JobServer(&m_environment);
+    if (!m_jobServer->start(g_options.maxNumberOfJobs)) {
+        fprintf(stderr, "Cannot start job server: %s.\n", qPrintable(m_jobServer->errorString()));
+        finishBuild(3);
+        return;
+    }
+
+    if (m_makefile->isParallelExecutionDisabled()) {
+        printf("jom: parallel job execution disabled for %s\n", qPrintable(m_makefile->fileName()));
+        g_options.maxNumberOfJobs = 1;
+    }
+
+    m_executor = new TargetExecutor(m_environment);
+    connect(m_executor, &TargetExecutor::finished, this, &BuildServer::onBuildFinished,
+            Qt::QueuedConnection);
+    m_executor->apply(m_makefile, cached.activeTargets);
+    QMetaObject::invokeMethod(m_executor, "startProcesses", Qt::QueuedConnection);
+}
+
+void BuildServer::onBuildFinished(int exitCode)
+{
+    finishBuild(exitCode);
+}
+
+void BuildServer::finishBuild(int exitCode)
+{
+    if (!m_building)
+        return;
+    m_building = false;
+
+    // The executor may still be on the stack. It uses the makefile and the job server.
+    Makefile *makefile = m_makefile;
+    JobServer *jobServer = m_jobServer;
+    if (m_executor) {
+        disconnect(m_executor, 0, this, 0);
+        connect(m_executor, &QObject::destroyed, [makefile, jobServer]() {
+            delete makefile;
+            delete jobServer;
+        });
+        m_executor->deleteLater();
+    } else {
+        delete makefile;
+        delete jobServer;
+    }
+    m_executor = 0;
+    m_makefile = 0;
+    m_jobServer = 0;
+
+    if (m_printWorkingDir) {
+        printf("jom: Leaving directory '%s'\n", qPrintable(QDir::toNativeSeparators(m_directory)));
+        fflush(stdout);
+    }
+    m_outputCapture->stop();
+    if (m_currentSocket) {
+        writeMessage(m_currentSocket, BuildFinished, QByteArray::number(exitCode));
+        m_currentSocket->flush();
+        m_currentSocket = 0;
+    }
+    QMetaObject::invokeMethod(this, "startNextBuild", Qt::QueuedConnection);
+}
+
+void BuildServer::onFilesChanged(const QStringList &filePaths, bool filesAddedOrRemoved)
+{
+    FastFileInfo::clearCacheForFiles(filePaths);
+
+    // New and removed files can change the outcome of !IF EXIST and of include file lookups.
+    if (filesAddedOrRemoved) {
+        reportOutdatedMakefiles(m_parseCache.count());
+        clearParseCache();
+        return;
+    }
+
+    QSet<QString> changedFiles;
+    foreach (const QString &filePath, filePaths)
+        changedFiles.insert(normalizedFilePath(filePath));
+
+    int outdatedCount = 0;
+    QHash<QString, CachedMakefile>::iterator it = m_parseCache.begin();
+    while (it != m_parseCache.end()) {
+        bool outdated = false;
+        foreach (const QString &sourceFile, it->sourceFiles) {
+            if (changedFiles.contains(sourceFile)) {
+                outdated = true;
+                break;
+            }
+        }
+        if (outdated) {
+            delete it->makefile;
+            it = m_parseCache.erase(it);
+            outdatedCount++;
+        } else {
+            ++it;
+        }
+    }
+    reportOutdatedMakefiles(outdatedCount);
+}
+
+/**
+ * Tells the user of the server console that makefiles will be read again.
+ */
+void BuildServer::reportOutdatedMakefiles(int count)
+{
+    if (count <= 0)
+        return;
+    fprintf(stderr, "jom: %d parsed makefiles outdated\n", count);
+    fflush(stderr);
+}
+
+void BuildServer::onOverflow()
+{
+    FastFileInfo::clearCache();
+    reportOutdatedMakefiles(m_parseCache.count());
+    clearParseCache();
+
+    // The notification about the marker file might have been lost.
+    if (m_waitingForWatcher && !m_watcher->writeMarkerFile())
+        onMarkerFileChanged();
+}
+
+void BuildServer::clearParseCache()
+{
+    foreach (const CachedMakefile &cached, m_parseCache)
+        delete cached.makefile;
+    m_parseCache.clear();
+}
+
+} // namespace NMakeFile
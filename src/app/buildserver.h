@@ -0,0 +1,203 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef BUILDSERVER_H
+#define BUILDSERVER_H
+
+#include <processenvironment.h>
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+
+#include <qt_windows.h>
+
+QT_BEGIN_NAMESPACE
+class QLocalServer;
+class QLocalSocket;
+QT_END_NAMESPACE
+
+namespace NMakeFile {
+
+class JobServer;
+class Makefile;
+class TargetExecutor;
+
+/**
+ * Reads everything that is written to one end of a pipe and emits it in chunks.
+ */
+class PipeReader : public QThread
+{
+    Q_OBJECT
+public:
+    PipeReader(int fd, int channel, QObject *parent);
+
+signals:
+    void dataRead(int channel, const QByteArray &data);
+
+protected:
+    void run();
+
+private:
+    int m_fd;
+    int m_channel;
+};
+
+/**
+ * Redirects the stdout and stderr file descriptors of this process into pipes
+ * while a build is running.
+ */
+class OutputCapture : public QObject
+{
+    Q_OBJECT
+public:
+    OutputCapture(QObject *parent = 0);
+    ~OutputCapture();
+
+    bool start();
+    void stop();
+
+signals:
+    void outputAvailable(int channel, const QByteArray &data);
+
+private:
+    struct Channel
+    {
+        Channel() : savedFd(-1), reader(0) {}
+        int savedFd;
+        PipeReader *reader;
+    };
+    Channel m_channels[2];
+};
+
+/**
+ * Reports the files that change below a directory.
+ * Writing the marker file tells when the notifications have caught up:
+ * markerFileChanged() is emitted after the changes that happened before.
+ */
+class DirectoryWatcher : public QThread
+{
+    Q_OBJECT
+public:
+    DirectoryWatcher(const QString &directory, QObject *parent = 0);
+    ~DirectoryWatcher();
+
+    void startWatching();
+    void stop();
+    bool writeMarkerFile();
+
+signals:
+    void filesChanged(const QStringList &filePaths, bool filesAddedOrRemoved);
+    void markerFileChanged();
+    void overflow();
+
+protected:
+    void run();
+
+private:
+    QString m_directory;
+    QString m_markerFilePath;
+    HANDLE m_hStopEvent;
+    HANDLE m_hWatchingEvent;
+    quint32 m_markerCount;
+};
+
+/**
+ * A long-living jom process for one workspace.
+ * It keeps the parsed makefiles and the file time stamp cache between builds.
+ * Front end processes in the same directory send their command line to it and
+ * receive the output of the build.
+ */
+class BuildServer : public QObject
+{
+    Q_OBJECT
+public:
+    BuildServer(QObject *parent = 0);
+    ~BuildServer();
+
+    bool listen();
+    QString errorString() const { return m_errorString; }
+    int exec();
+
+    static QString serverName(const QString &directory);
+    static bool forwardBuild(const QStringList &arguments, int *exitCode);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onClientDisconnected();
+    void onOutputAvailable(int channel, const QByteArray &data);
+    void onBuildFinished(int exitCode);
+    void onFilesChanged(const QStringList &filePaths, bool filesAddedOrRemoved);
+    void onMarkerFileChanged();
+    void onOverflow();
+    void startNextBuild();
+
+private:
+    struct Request
+    {
+        QLocalSocket *socket;
+        QString directory;
+        QStringList arguments;
+        QStringList environment;
+    };
+
+    struct CachedMakefile
+    {
+        CachedMakefile() : makefile(0) {}
+        Makefile *makefile;
+        QStringList activeTargets;
+        QStringList sourceFiles;
+    };
+
+    void startPendingBuilds();
+    void startBuild(const Request &request);
+    void finishBuild(int exitCode);
+    void clearParseCache();
+    void reportOutdatedMakefiles(int count);
+
+private:
+    QString m_directory;
+    QString m_errorString;
+    QLocalServer *m_server;
+    OutputCapture *m_outputCapture;
+    DirectoryWatcher *m_watcher;
+    QList<Request> m_pendingRequests;
+    QLocalSocket *m_currentSocket;
+    bool m_building;
+    bool m_waitingForWatcher;
+    bool m_printWorkingDir;
+    ProcessEnvironment m_environment;
+    JobServer *m_jobServer;
+    Makefile *m_makefile;
+    TargetExecutor *m_executor;
+    QHash<QString, CachedMakefile> m_parseCache;
+};
+
+} // namespace NMakeFile
+
+#endif // BUILDSERVER_H
@@ -0,0 +1,276 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "buildwatcher.h"
+#include <fastfileinfo.h>
+#include <helperfunctions.h>
+#include <makefile.h>
+#include <makefilefactory.h>
+#include <options.h>
+#include <targetexecutor.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QProcess>
+
+#include <cstdio>
+
+namespace NMakeFile {
+
+static QString normalizedFilePath(const QString &filePath)
+{
+    return QDir::cleanPath(QFileInfo(filePath).absoluteFilePath()).toLower();
+}
+
+static QString normalizedFileName(QString fileName)
+{
+    removeDoubleQuotes(fileName);
+    return normalizedFilePath(fileName);
+}
+
+static void collectSourceFiles(const Makefile *makefile, QStringList *filePaths)
+{
+    *filePaths += makefile->sourceFiles();
+    foreach (const Makefile *subMakefile, makefile->subMakefiles())
+        collectSourceFiles(subMakefile, filePaths);
+}
+
+/**
+ * Returns true if the target might be out of date because of the changed files.
+ * Targets with unapplied inference rules might depend on any file.
+ */
+static bool isAffected(DescriptionBlock *target, const QSet<QString> &changedFiles,
+                       QHash<DescriptionBlock *, bool> *affectedTargets)
+{
+    QHash<DescriptionBlock *, bool>::const_iterator it = affectedTargets->constFind(target);
+    if (it != affectedTargets->constEnd())
+        return it.value();
+    affectedTargets->insert(target, true);     // for dependency cycles
+
+    Makefile *makefile = target->makefile();
+    CurrentDirectoryScope directoryScope(makefile->workingDirectory());
+    bool affected = !target->m_inferenceRules.isEmpty()
+            || !FastFileInfo(target->targetName()).exists()
+            || changedFiles.contains(normalizedFileName(target->targetName()));
+    for (int i = 0; !affected && i < target->m_dependents.count(); ++i) {
+        const QString &dependentName = target->m_dependents.at(i);
+        DescriptionBlock *dependent = makefile->target(dependentName);
+        if (!dependent)
+            dependent = makefile->target(makefile->dirPath() + QDir::separator() + dependentName);
+        affected = dependent ? isAffected(dependent, changedFiles, affectedTargets)
+                             : changedFiles.contains(normalizedFileName(dependentName));
+    }
+    foreach (DescriptionBlock *dependent, target->m_subMakeDependents) {
+        if (affected)
+            break;
+        affected = isAffected(dependent, changedFiles, affectedTargets);
+    }
+    affectedTargets->insert(target, affected);
+    return affected;
+}
+
+static void collectUnaffectedTargets(Makefile *makefile, const QSet<QString> &changedFiles,
+                                     QHash<DescriptionBlock *, bool> *affectedTargets,
+                                     QSet<DescriptionBlock *> *unaffectedTargets)
+{
+    foreach (DescriptionBlock *target, makefile->targets())
+        if (!isAffected(target, changedFiles, affectedTargets))
+            unaffectedTargets->insert(target);
+    foreach (Makefile *subMakefile, makefile->subMakefiles())
+        collectUnaffectedTargets(subMakefile, changedFiles, affectedTargets, unaffectedTargets);
+}
+
+BuildWatcher::BuildWatcher(const QStringList &arguments,
+                           const ProcessEnvironment &processEnvironment, QObject *parent)
+    : QObject(parent)
+    , m_arguments(arguments)
+    , m_processEnvironment(processEnvironment)
+    , m_makefile(0)
+    , m_fileSystemWatcher(new QFileSystemWatcher(this))
+    , m_executor(0)
+    , m_executorMakefile(0)
+    , m_lastBuildSucceeded(false)
+{
+    // Editors and compilers often write a file in several steps.
+    m_rebuildTimer.setSingleShot(true);
+    m_rebuildTimer.setInterval(100);
+    connect(&m_rebuildTimer, &QTimer::timeout, this, &BuildWatcher::rebuild);
+    connect(m_fileSystemWatcher, &QFileSystemWatcher::fileChanged,
+            this, &BuildWatcher::onFileChanged);
+    connect(m_fileSystemWatcher, &QFileSystemWatcher::directoryChanged,
+            this, &BuildWatcher::onDirectoryChanged);
+}
+
+BuildWatcher::~BuildWatcher()
+{
+    delete m_executor;
+    delete m_executorMakefile;
+    delete m_makefile;
+}
+
+/**
+ * Sets the makefile that is copied for each build. Takes ownership of makefile.
+ */
+void BuildWatcher::setMakefile(Makefile *makefile, const QStringList &activeTargets)
+{
+    delete m_makefile;
+    m_makefile = makefile;
+    m_activeTargets = activeTargets;
+    QStringList sourceFiles;
+    collectSourceFiles(makefile, &sourceFiles);
+    m_sourceFiles.clear();
+    foreach (const QString &sourceFile, sourceFiles)
+        m_sourceFiles.insert(normalizedFilePath(sourceFile));
+}
+
+void BuildWatcher::onBuildFinished(int exitCode)
+{
+    m_lastBuildSucceeded = exitCode == 0;
+    watchFiles();
+    printf("jom: build finished with exit code %d, watching %d files for changes\n",
+           exitCode, m_fileSystemWatcher->files().count());
+    fflush(stdout);
+}
+
+/**
+ * Watches every file that has been stat-ed, the makefiles and their directories.
+ * Directories are watched to notice files that are replaced or deleted.
+ */
+void BuildWatcher::watchFiles()
+{
+    QStringList filePaths = FastFileInfo::cachedFilePaths();
+    foreach (const QString &sourceFile, m_sourceFiles)
+        filePaths.append(sourceFile);
+    filePaths.removeDuplicates();
+
+    QSet<QString> directoryPaths;
+    foreach (const QString &filePath, filePaths)
+        directoryPaths.insert(QFileInfo(filePath).absolutePath());
+
+    if (!filePaths.isEmpty())
+        m_fileSystemWatcher->addPaths(filePaths);
+    if (!directoryPaths.isEmpty())
+        m_fileSystemWatcher->addPaths(directoryPaths.toList());
+}
+
+void BuildWatcher::onFileChanged(const QString &filePath)
+{
+    m_changedFiles.insert(filePath);
+    m_rebuildTimer.start();
+}
+
+void BuildWatcher::onDirectoryChanged(const QString &directoryPath)
+{
+    m_changedDirectories.insert(directoryPath);
+    m_rebuildTimer.start();
+}
+
+void BuildWatcher::rebuild()
+{
+    // The build itself changes files. Stop watching until it has finished.
+    const QStringList watchedFiles = m_fileSystemWatcher->files();
+    if (!watchedFiles.isEmpty())
+        m_fileSystemWatcher->removePaths(watchedFiles);
+    const QStringList watchedDirectories = m_fileSystemWatcher->directories();
+    if (!watchedDirectories.isEmpty())
+        m_fileSystemWatcher->removePaths(watchedDirectories);
+
+    // A changed directory means that files in it were added, removed or renamed.
+    QStringList changedFiles = m_changedFiles.toList();
+    if (!m_changedDirectories.isEmpty()) {
+        foreach (const QString &filePath, watchedFiles)
+            if (m_changedDirectories.contains(QFileInfo(filePath).absolutePath()))
+                changedFiles.append(filePath);
+    }
+    changedFiles.removeDuplicates();
+    m_changedFiles.clear();
+    m_changedDirectories.clear();
+    FastFileInfo::clearCacheForFiles(changedFiles);
+
+    bool makefileChanged = !m_makefile;
+    foreach (const QString &filePath, changedFiles) {
+        if (m_sourceFiles.contains(normalizedFilePath(filePath))) {
+            makefileChanged = true;
+            break;
+        }
+    }
+
+    printf("jom: %d files changed, rebuilding\n", changedFiles.count());
+    fflush(stdout);
+    if (makefileChanged && !reparse()) {
+        onBuildFinished(2);
+        return;
+    }
+
+    delete m_executor;
+    delete m_executorMakefile;
+    m_executorMakefile = m_makefile->clone();
+    m_executor = new TargetExecutor(m_processEnvironment);
+    connect(m_executor, &TargetExecutor::finished, this, &BuildWatcher::onBuildFinished,
+            Qt::QueuedConnection);
+
+    // After a successful build, only the targets that depend on a changed file
+    // can be out of date. The dependency graph below the others is skipped.
+    if (m_lastBuildSucceeded && !makefileChanged
+        && !m_executorMakefile->options()->buildAllTargets)
+    {
+        QSet<QString> normalizedChangedFiles;
+        foreach (const QString &filePath, changedFiles)
+            normalizedChangedFiles.insert(normalizedFilePath(filePath));
+        QHash<DescriptionBlock *, bool> affectedTargets;
+        QSet<DescriptionBlock *> unaffectedTargets;
+        collectUnaffectedTargets(m_executorMakefile, normalizedChangedFiles, &affectedTargets,
+                                 &unaffectedTargets);
+        m_executor->setUpToDateTargets(unaffectedTargets);
+        printf("jom: %d targets are not affected by the changes\n", unaffectedTargets.count());
+        fflush(stdout);
+    }
+    m_executor->apply(m_executorMakefile, m_activeTargets);
+    QMetaObject::invokeMethod(m_executor, "startProcesses", Qt::QueuedConnection);
+}
+
+/**
+ * Reads the makefile again after one of its source files changed.
+ * On error, the next change of a source file triggers another try.
+ */
+bool BuildWatcher::reparse()
+{
+    GlobalOptions globalOptions = g_options;
+    MakefileFactory factory;
+    factory.setEnvironment(QProcess::systemEnvironment());
+    factory.setGlobalOptions(&globalOptions);
+    const bool makefileRead = factory.apply(m_arguments);
+    if (!makefileRead) {
+        delete factory.makefile();
+        delete m_makefile;
+        m_makefile = 0;
+        fprintf(stderr, "Error: %s\n", qPrintable(factory.errorString()));
+        return false;
+    }
+    setMakefile(factory.makefile(), factory.activeTargets());
+    return true;
+}
+
+} // namespace NMakeFile
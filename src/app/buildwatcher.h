@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef BUILDWATCHER_H
+#define BUILDWATCHER_H
+
+#include <processenvironment.h>
+
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+
+namespace NMakeFile {
+
+class Makefile;
+class TargetExecutor;
+
+/**
+ * Keeps jom running after a build for /WATCH.
+ * It watches the files whose time stamps the build has looked at and starts
+ * a new build of the same targets when one of them changes.
+ * Only the changed files are stat-ed again, and after a successful build only
+ * the targets that depend on them are checked. The makefile is parsed again only
+ * if one of its source files changed.
+ */
+class BuildWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    BuildWatcher(const QStringList &arguments, const ProcessEnvironment &processEnvironment,
+                 QObject *parent = 0);
+    ~BuildWatcher();
+
+    void setMakefile(Makefile *makefile, const QStringList &activeTargets);
+
+public slots:
+    void onBuildFinished(int exitCode);
+
+private slots:
+    void onFileChanged(const QString &filePath);
+    void onDirectoryChanged(const QString &directoryPath);
+    void rebuild();
+
+private:
+    void watchFiles();
+    bool reparse();
+
+private:
+    QStringList m_arguments;
+    ProcessEnvironment m_processEnvironment;
+    Makefile *m_makefile;
+    QStringList m_activeTargets;
+    QSet<QString> m_sourceFiles;
+    QFileSystemWatcher *m_fileSystemWatcher;
+    QTimer m_rebuildTimer;
+    QSet<QString> m_changedFiles;
+    QSet<QString> m_changedDirectories;
+    TargetExecutor *m_executor;
+    Makefile *m_executorMakefile;
+    bool m_lastBuildSucceeded;
+};
+
+} // namespace NMakeFile
+
+#endif // BUILDWATCHER_H
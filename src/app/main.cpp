@@ -24,11 +24,20 @@
 ****************************************************************************/
 
 #include "application.h"
+#include "buildserver.h"
+#include "buildwatcher.h"
+#include "statusserver.h"
+#include "workerdaemon.h"
+#include <consolewriter.h>
 #include <helperfunctions.h>
 #include <jobserver.h>
+#include <sharedstatcache.h>
 #include <options.h>
+#include <remoteworker.h>
 #include <parser.h>
 #include <preprocessor.h>
+#include <profiler.h>
+#include <buildtrace.h>
 #include <targetexecutor.h>
 #include <exception.h>
 #include <makefilefactory.h>
@@ -38,19 +47,14 @@
 #include <QProcess>
 #include <QScopedPointer>
 #include <QTextCodec>
+#include <QThread>
 
 #include <windows.h>
 #include <Tlhelp32.h>
+#include <psapi.h>
 
 using namespace NMakeFile;
 
-static void showLogo()
-{
-    fprintf(stderr, "\njom %d.%d.%d - empower your cores\n\n",
-        JOM_VERSION_MAJOR, JOM_VERSION_MINOR, JOM_VERSION_PATCH);
-    fflush(stderr);
-}
-
 static void showUsage()
 {
     printf("Usage: jom @commandfile\n"
@@ -75,10 +79,29 @@ static void showUsage()
            "/X <filename> write stderr to file.\n"
            "/Y disable batch mode inference rules\n\n"
            "jom only options:\n"
+           "/CACHE restore target outputs from the local result cache\n"
+           "/DEBUG print scheduling statistics\n"
            "/DUMPGRAPH show the generated dependency graph\n"
            "/DUMPGRAPHDOT dump dependency graph in dot format\n"
+           "/FAILFAST kill all running jobs on the first error\n"
+           "/INPROCESS run $(MAKE) commands inside this jom process\n"
            "/J <n> use up to n processes in parallel\n"
-           "/VERSION print version and exit\n");
+           "/O[NONE|LINE|TARGET|RECURSE] synchronize the output of parallel jobs\n"
+           "/ONESHELL run the commands of a target in one batch file\n"
+           "/PROFILE print where jom spent its time on exit\n"
+           "/PROGRESS show a progress line with the estimated time left\n"
+           "/REMOTE <host:port,...> also run commands on these worker daemons\n"
+           "/SERVER run a build server that keeps this directory's makefiles in memory\n"
+           "/SHAREDSTATCACHE let sub-jom processes reuse the file time stamps of this jom\n"
+           "/SHELLWORKERS keep one shell per job alive to run commands\n"
+           "/STATUS <pid> print what the jom process with this id is doing\n"
+           "/STATUSSERVER answer /STATUS requests of the same user\n"
+           "/TRACE <filename> write a timeline of the build in Chrome's trace event format\n"
+           "/USESERVER let the build server of this directory do the build if one is running\n"
+           "/VERSION print version and exit\n"
+           "/WATCH rebuild whenever a file that the build looked at changes\n"
+           "/WORKER [host:]port run a worker daemon for /REMOTE builds,\n"
+           "        other hosts than 127.0.0.1 need a shared secret in JOMWORKERSECRET\n");
 }
 
 static TargetExecutor* g_pTargetExecutor = 0;
@@ -86,6 +109,7 @@ static TargetExecutor* g_pTargetExecutor = 0;
 BOOL WINAPI ConsoleCtrlHandlerRoutine(DWORD dwCtrlType)
 {
     Q_UNUSED(dwCtrlType);
+    ConsoleWriter::flush();
     fprintf(stderr, "jom terminated by user (pid=%lld)\n", QCoreApplication::applicationPid());
     fflush(stderr);
 
@@ -108,6 +132,98 @@ QStringList getCommandLineArguments()
     return commandLineArguments;
 }
 
+static bool isBuildServerRequested(const QStringList &arguments)
+{
+    foreach (const QString &argument, arguments) {
+        if (argument.compare(QLatin1String("/SERVER"), Qt::CaseInsensitive) == 0
+            || argument.compare(QLatin1String("-SERVER"), Qt::CaseInsensitive) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Builds are only sent to a build server if the user asked for it.
+ * The server might have been started with another environment or jom version.
+ */
+static bool isBuildServerUseRequested(const QStringList &arguments)
+{
+    foreach (const QString &argument, arguments) {
+        if (argument.compare(QLatin1String("/USESERVER"), Qt::CaseInsensitive) == 0
+            || argument.compare(QLatin1String("-USESERVER"), Qt::CaseInsensitive) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isProfilingRequested(const QStringList &arguments)
+{
+    foreach (const QString &argument, arguments) {
+        if (argument.compare(QLatin1String("/PROFILE"), Qt::CaseInsensitive) == 0
+            || argument.compare(QLatin1String("-PROFILE"), Qt::CaseInsensitive) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns true if jom shall run as a worker daemon.
+ * The optional argument after /WORKER is the address to listen on.
+ */
+static bool isWorkerRequested(const QStringList &arguments, QString *address)
+{
+    for (int i = 0; i < arguments.count(); ++i) {
+        const QString &argument = arguments.at(i);
+        if (argument.compare(QLatin1String("/WORKER"), Qt::CaseInsensitive) == 0
+            || argument.compare(QLatin1String("-WORKER"), Qt::CaseInsensitive) == 0)
+        {
+            if (i + 1 < arguments.count() && !arguments.at(i + 1).startsWith(QLatin1Char('/'))
+                && !arguments.at(i + 1).startsWith(QLatin1Char('-')))
+            {
+                *address = arguments.at(i + 1);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns true if the status of another jom process shall be printed.
+ * The argument after /STATUS is the process id of that jom.
+ */
+static bool isStatusRequested(const QStringList &arguments, qint64 *pid)
+{
+    for (int i = 0; i < arguments.count(); ++i) {
+        const QString &argument = arguments.at(i);
+        if (argument.compare(QLatin1String("/STATUS"), Qt::CaseInsensitive) == 0
+            || argument.compare(QLatin1String("-STATUS"), Qt::CaseInsensitive) == 0)
+        {
+            *pid = i + 1 < arguments.count() ? arguments.at(i + 1).toLongLong() : 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Prints the peak working set of this process for /DEBUG.
+ */
+static void printPeakWorkingSet()
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        fprintf(stderr, "jom: peak working set %lld KiB\n",
+                qint64(counters.PeakWorkingSetSize / 1024));
+    }
+}
+
 static bool initJobServer(const Application &app, ProcessEnvironment *environment,
                           JobServer **outJobServer)
 {
@@ -144,6 +260,23 @@ static bool initJobServer(const Application &app, ProcessEnvironment *environmen
     return true;
 }
 
+/**
+ * With /SHAREDSTATCACHE the top-level jom shares its file attribute cache with the
+ * sub-jom processes. Files that commands write besides their targets aren't
+ * invalidated in the shared cache. Therefore sharing must be requested.
+ */
+static void initSharedStatCache(const Application &app, const Options *options,
+                                ProcessEnvironment *environment)
+{
+    if (app.isSubJOM()) {
+        const QString name = environment->value(SharedStatCache::environmentVariableName());
+        if (!name.isEmpty())
+            SharedStatCache::attach(name);
+    } else if (options->shareStatCache && SharedStatCache::create()) {
+        SharedStatCache::instance()->advertise(environment);
+    }
+}
+
 int main(int argc, char* argv[])
 {
     int result = 0;
@@ -151,10 +284,53 @@ int main(int argc, char* argv[])
         SetConsoleCtrlHandler(&ConsoleCtrlHandlerRoutine, TRUE);
         Application app(argc, argv);
         QTextCodec::setCodecForLocale(QTextCodec::codecForName("IBM 850"));
+        const QStringList commandLineArguments = getCommandLineArguments();
+        if (isBuildServerRequested(commandLineArguments)) {
+            BuildServer server;
+            if (!server.listen()) {
+                fprintf(stderr, "jom: Cannot start build server: %s\n",
+                        qPrintable(server.errorString()));
+                return 2;
+            }
+            return server.exec();
+        }
+        qint64 statusPid;
+        if (isStatusRequested(commandLineArguments, &statusPid)) {
+            if (statusPid <= 0) {
+                fprintf(stderr, "jom: /STATUS needs the process id of a running jom.\n");
+                return 128;
+            }
+            if (!StatusServer::printStatus(statusPid)) {
+                fprintf(stderr, "jom: No jom process with id %lld is running with /STATUSSERVER.\n",
+                        statusPid);
+                return 2;
+            }
+            return 0;
+        }
+        QString workerAddress;
+        if (isWorkerRequested(commandLineArguments, &workerAddress)) {
+            WorkerDaemon worker(QThread::idealThreadCount());
+            if (!worker.listen(workerAddress)) {
+                fprintf(stderr, "jom: Cannot start worker: %s\n", qPrintable(worker.errorString()));
+                return 2;
+            }
+            return app.exec();
+        }
+        if (!app.isSubJOM() && isBuildServerUseRequested(commandLineArguments)
+            && BuildServer::forwardBuild(commandLineArguments, &result))
+        {
+            return result;
+        }
+
+        // Enable profiling before the makefile is read.
+        if (isProfilingRequested(commandLineArguments))
+            Profiler::setEnabled(true);
+
         MakefileFactory mf;
         Options* options = 0;
         mf.setEnvironment(QProcess::systemEnvironment());
-        if (!mf.apply(getCommandLineArguments(), &options)) {
+        const qint64 readMakefileStartTime = BuildTrace::now();
+        if (!mf.apply(commandLineArguments, &options)) {
             switch (mf.errorType()) {
             case MakefileFactory::CommandLineError:
                 showUsage();
@@ -168,7 +344,7 @@ int main(int argc, char* argv[])
 
         if (options->showUsageAndExit) {
             if (options->showLogo)
-                showLogo();
+                Application::showLogo();
             showUsage();
             return 0;
         } else if (options->showVersionAndExit) {
@@ -177,7 +353,7 @@ int main(int argc, char* argv[])
         }
 
         if (options->showLogo && !app.isSubJOM())
-            showLogo();
+            Application::showLogo();
 
         QScopedPointer<Makefile> mkfile(mf.makefile());
         if (options->displayMakeInformation) {
@@ -189,11 +365,22 @@ int main(int argc, char* argv[])
             mkfile->dumpTargets();
         }
 
+        if (!options->traceFile.isEmpty()) {
+            if (!BuildTrace::open(options->traceFile)) {
+                fprintf(stderr, "jom: Cannot open trace file %s for writing.\n",
+                        qPrintable(options->traceFile));
+                return 2;
+            }
+            BuildTrace::addEvent(QLatin1String("read makefile"), "jom", 0,
+                                 readMakefileStartTime, BuildTrace::now());
+        }
+
         JobServer *jobServer = 0;
         ProcessEnvironment processEnvironment = mkfile->macroTable()->environment();
         if (!initJobServer(app, &processEnvironment, &jobServer))
             return 3;
         QScopedPointer<JobServer> jobServerDeleter(jobServer);
+        initSharedStatCache(app, options, &processEnvironment);
 
         if (options->printWorkingDir) {
             printf("jom: Entering directory '%s\n",
@@ -206,14 +393,43 @@ int main(int argc, char* argv[])
             g_options.maxNumberOfJobs = 1;
         }
 
+        QScopedPointer<BuildWatcher> buildWatcher;
+        if (options->watchMode) {
+            buildWatcher.reset(new BuildWatcher(commandLineArguments, processEnvironment));
+            buildWatcher->setMakefile(mkfile->clone(), mf.activeTargets());
+        }
+
+        QScopedPointer<RemoteWorkerPool> remoteWorkerPool;
+        if (!options->remoteWorkers.isEmpty()) {
+            remoteWorkerPool.reset(new RemoteWorkerPool);
+            remoteWorkerPool->connectToWorkers(options->remoteWorkers);
+        }
+
         TargetExecutor executor(processEnvironment);
-        QObject::connect(&executor, SIGNAL(finished(int)), &app, SLOT(exit(int)));
+        if (remoteWorkerPool)
+            executor.setRemoteWorkerPool(remoteWorkerPool.data());
+        if (buildWatcher)
+            QObject::connect(&executor, SIGNAL(finished(int)), buildWatcher.data(), SLOT(onBuildFinished(int)));
+        else
+            QObject::connect(&executor, SIGNAL(finished(int)), &app, SLOT(exit(int)));
         g_pTargetExecutor = &executor;
+        // Sub-joms are reported by their parent.
+        QScopedPointer<StatusServer> statusServer;
+        if (options->runStatusServer && !app.isSubJOM()) {
+            statusServer.reset(new StatusServer(&executor));
+            if (!statusServer->listen()) {
+                fprintf(stderr, "jom: Cannot start status server: %s\n",
+                        qPrintable(statusServer->errorString()));
+            }
+        }
         executor.apply(mkfile.data(), mf.activeTargets());
 
         QMetaObject::invokeMethod(&executor, "startProcesses", Qt::QueuedConnection);
         result = app.exec();
         g_pTargetExecutor = 0;
+        BuildTrace::close();
+        if (options->debugMode)
+            printPeakWorkingSet();
         if (options->printWorkingDir) {
             printf("jom: Leaving directory '%s'\n",
                    qPrintable(QDir::toNativeSeparators(QDir::currentPath())));
@@ -223,5 +439,7 @@ int main(int argc, char* argv[])
         fprintf(stderr, "jom: %s\n", qPrintable(e.message()));
         result = 2;
     }
+    if (Profiler::isEnabled())
+        Profiler::printSummary(stderr);
     return result;
 }
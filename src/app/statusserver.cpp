@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "statusserver.h"
+
+#include <targetexecutor.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
+#include <cstdio>
+
+namespace NMakeFile {
+
+StatusServer::StatusServer(TargetExecutor *executor, QObject *parent)
+    : QObject(parent)
+    , m_executor(executor)
+    , m_server(new QLocalServer(this))
+{
+    connect(m_server, &QLocalServer::newConnection, this, &StatusServer::onNewConnection);
+}
+
+QString StatusServer::serverName(qint64 pid)
+{
+    return QLatin1String("jom-status-") + QString::number(pid);
+}
+
+bool StatusServer::listen()
+{
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(serverName(QCoreApplication::applicationPid()))) {
+        m_errorString = m_server->errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Prints the status of the jom process with the given process id to stdout.
+ * Returns false if that process does not answer.
+ */
+bool StatusServer::printStatus(qint64 pid)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName(pid));
+    if (!socket.waitForConnected(1000))
+        return false;
+
+    while (socket.waitForReadyRead(5000) || socket.bytesAvailable()) {
+        const QByteArray data = socket.readAll();
+        fwrite(data.constData(), 1, data.size(), stdout);
+    }
+    fflush(stdout);
+    return true;
+}
+
+void StatusServer::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        socket->write(m_executor->statusReport());
+        socket->disconnectFromServer();
+    }
+}
+
+} // namespace NMakeFile
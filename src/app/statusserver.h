@@ -0,0 +1,68 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef STATUSSERVER_H
+#define STATUSSERVER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+QT_BEGIN_NAMESPACE
+class QLocalServer;
+QT_END_NAMESPACE
+
+namespace NMakeFile {
+
+class TargetExecutor;
+
+/**
+ * Tells other processes what a running build is doing.
+ * Every client that connects receives the running jobs and the hot-path
+ * counters, and is disconnected. "jom /STATUS <pid>" is such a client.
+ */
+class StatusServer : public QObject
+{
+    Q_OBJECT
+public:
+    StatusServer(TargetExecutor *executor, QObject *parent = 0);
+
+    bool listen();
+    QString errorString() const { return m_errorString; }
+
+    static QString serverName(qint64 pid);
+    static bool printStatus(qint64 pid);
+
+private slots:
+    void onNewConnection();
+
+private:
+    TargetExecutor *m_executor;
+    QLocalServer *m_server;
+    QString m_errorString;
+};
+
+} // namespace NMakeFile
+
+#endif // STATUSSERVER_H
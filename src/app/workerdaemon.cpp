@@ -0,0 +1,305 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "workerdaemon.h"
+#include <helperfunctions.h>
+#include <remoteworker.h>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QUuid>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#include <qt_windows.h>
+#include <cstdio>
+
+namespace NMakeFile {
+
+WorkerDaemon::WorkerDaemon(int slotCount, QObject *parent)
+    : QObject(parent)
+    , m_server(new QTcpServer(this))
+    , m_slotCount(slotCount)
+    , m_secret(RemoteWorkerProtocol::sharedSecret())
+{
+    connect(m_server, &QTcpServer::newConnection, this, &WorkerDaemon::onNewConnection);
+}
+
+/**
+ * Listens on "port" or "address:port". Without an address only local
+ * connections are accepted. Other addresses require a shared secret.
+ */
+bool WorkerDaemon::listen(const QString &address)
+{
+    QString host = QLatin1String("127.0.0.1");
+    quint16 port = RemoteWorkerProtocol::defaultPort;
+    if (!address.isEmpty()) {
+        bool isPort;
+        const quint16 n = address.toUShort(&isPort);
+        if (isPort) {
+            port = n;
+        } else if (!RemoteWorkerProtocol::parseAddress(address, &host, &port)) {
+            m_errorString = QLatin1String("Invalid address ") + address;
+            return false;
+        }
+    }
+
+    QHostAddress hostAddress;
+    if (!hostAddress.setAddress(host)) {
+        m_errorString = host + QLatin1String(" is not an IP address");
+        return false;
+    }
+    const bool isLoopback = hostAddress.isInSubnet(QHostAddress(QHostAddress::LocalHost), 8)
+            || hostAddress == QHostAddress(QHostAddress::LocalHostIPv6);
+    if (!isLoopback && m_secret.isEmpty()) {
+        m_errorString = QLatin1String("Listening on ") + host
+                + QLatin1String(" requires a shared secret in JOMWORKERSECRET");
+        return false;
+    }
+    if (!m_server->listen(hostAddress, port)) {
+        m_errorString = m_server->errorString();
+        return false;
+    }
+
+    printf("jom: worker listening on %s:%d with %d slots\n",
+           qPrintable(host), m_server->serverPort(), m_slotCount);
+    fflush(stdout);
+    return true;
+}
+
+void WorkerDaemon::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, &WorkerDaemon::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, &WorkerDaemon::onDisconnected);
+
+        const QByteArray challenge = QUuid::createUuid().toRfc4122()
+                + QUuid::createUuid().toRfc4122();
+        m_challenges.insert(socket, challenge);
+        QByteArray payload;
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_2);
+        stream << RemoteWorkerProtocol::version << quint32(m_slotCount) << challenge;
+        RemoteWorkerProtocol::writeMessage(socket, RemoteWorkerProtocol::Hello, payload);
+    }
+}
+
+/**
+ * Compares in constant time, so that the timing tells nothing about the secret.
+ */
+static bool isEqualAuthenticationCode(const QByteArray &a, const QByteArray &b)
+{
+    if (a.size() != b.size())
+        return false;
+    char difference = 0;
+    for (int i = 0; i < a.size(); ++i)
+        difference |= a.at(i) ^ b.at(i);
+    return difference == 0;
+}
+
+void WorkerDaemon::authenticate(QTcpSocket *socket, const QByteArray &payload)
+{
+    const QByteArray expected
+            = RemoteWorkerProtocol::authenticationCode(m_challenges.take(socket), m_secret);
+    if (!isEqualAuthenticationCode(payload, expected)) {
+        fprintf(stderr, "jom: worker rejected a client from %s\n",
+                qPrintable(socket->peerAddress().toString()));
+        socket->close();
+        return;
+    }
+    m_authenticatedSockets.insert(socket);
+}
+
+void WorkerDaemon::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    quint8 type;
+    QByteArray payload;
+    while (RemoteWorkerProtocol::readMessage(socket, &type, &payload)) {
+        if (!m_authenticatedSockets.contains(socket)) {
+            if (type == RemoteWorkerProtocol::Authenticate && m_challenges.contains(socket))
+                authenticate(socket, payload);
+            else
+                socket->close();
+            continue;
+        }
+        switch (type) {
+        case RemoteWorkerProtocol::RunCommand:
+            runCommand(socket, payload);
+            break;
+        case RemoteWorkerProtocol::CancelCommand:
+            killCommand(socket);
+            break;
+        }
+    }
+}
+
+void WorkerDaemon::onDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    m_challenges.remove(socket);
+    m_authenticatedSockets.remove(socket);
+    killCommand(socket);
+    QProcess *process = m_processes.take(socket);
+    if (process) {
+        process->disconnect(this);
+        process->waitForFinished();
+        delete process;
+    }
+    socket->deleteLater();
+}
+
+static void sendCommandFinished(QTcpSocket *socket, int exitCode, bool crashed)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << qint32(exitCode) << crashed;
+    RemoteWorkerProtocol::writeMessage(socket, RemoteWorkerProtocol::CommandFinished, payload);
+}
+
+static QString quotedIfNeeded(const QString &filePath)
+{
+    if (filePath.contains(QLatin1Char(' ')) || filePath.contains(QLatin1Char('\t')))
+        return QLatin1Char('"') + filePath + QLatin1Char('"');
+    return filePath;
+}
+
+void WorkerDaemon::runCommand(QTcpSocket *socket, const QByteArray &payload)
+{
+    QString commandLine;
+    QString workingDirectory;
+    QStringList environment;
+    QList<RemoteInlineFile> inlineFiles;
+    QDataStream stream(payload);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream >> commandLine >> workingDirectory >> environment >> inlineFiles;
+    if (stream.status() != QDataStream::Ok || m_processes.contains(socket)) {
+        sendCommandFinished(socket, 2, true);
+        return;
+    }
+
+    QProcess *process = new QProcess(this);
+
+    // The inline files get local names that replace the ones of the client.
+    foreach (const RemoteInlineFile &inlineFile, inlineFiles) {
+        QTemporaryFile *file = new QTemporaryFile(
+                    QDir::tempPath() + QLatin1String("/jomworker.XXXXXX.jom"), process);
+        if (!file->open()) {
+            RemoteWorkerProtocol::writeMessage(socket, RemoteWorkerProtocol::StandardError,
+                                               "jom worker: cannot create inline file\n");
+            sendCommandFinished(socket, 2, false);
+            delete process;
+            return;
+        }
+        file->write(inlineFile.second);
+        file->close();
+        const QString localName = QDir::toNativeSeparators(file->fileName());
+        commandLine.replace(QLatin1Char('"') + inlineFile.first + QLatin1Char('"'),
+                            QLatin1Char('"') + localName + QLatin1Char('"'));
+        commandLine.replace(inlineFile.first, quotedIfNeeded(localName));
+    }
+
+    // Check if there are more than three double quotes in the command.
+    // We must properly escape it. See "cmd /?" for the reason.
+    if (commandLine.count(QLatin1Char('"')) >= 3) {
+        commandLine.prepend(QLatin1Char('"'));
+        commandLine.append(QLatin1Char('"'));
+    }
+
+    QString shell = qGetEnvironmentVariable(L"ComSpec");
+    if (shell.isEmpty())
+        shell = QLatin1String("cmd.exe");
+
+    connect(process, &QProcess::readyReadStandardOutput, this, &WorkerDaemon::onStandardOutput);
+    connect(process, &QProcess::readyReadStandardError, this, &WorkerDaemon::onStandardError);
+    connect(process, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SLOT(onProcessFinished(int, QProcess::ExitStatus)));
+    process->setWorkingDirectory(workingDirectory);
+    process->setEnvironment(environment);
+    process->setNativeArguments(QLatin1String("/C ") + commandLine);
+    m_processes.insert(socket, process);
+    process->start(shell, QStringList());
+    if (!process->waitForStarted()) {
+        m_processes.remove(socket);
+        const QByteArray message = "jom worker: cannot start command: "
+                + process->errorString().toLocal8Bit() + "\n";
+        RemoteWorkerProtocol::writeMessage(socket, RemoteWorkerProtocol::StandardError, message);
+        sendCommandFinished(socket, 2, false);
+        process->disconnect(this);
+        process->deleteLater();
+    }
+}
+
+/**
+ * Kills the command of the connection with all of its child processes.
+ * The client gets the usual finished message.
+ */
+void WorkerDaemon::killCommand(QTcpSocket *socket)
+{
+    QProcess *process = m_processes.value(socket);
+    if (!process || process->state() == QProcess::NotRunning)
+        return;
+    QProcess::execute(QLatin1String("taskkill"), QStringList()
+                      << QLatin1String("/T") << QLatin1String("/F") << QLatin1String("/PID")
+                      << QString::number(process->pid()->dwProcessId));
+}
+
+void WorkerDaemon::onStandardOutput()
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    RemoteWorkerProtocol::writeMessage(m_processes.key(process),
+                                       RemoteWorkerProtocol::StandardOutput,
+                                       process->readAllStandardOutput());
+}
+
+void WorkerDaemon::onStandardError()
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    RemoteWorkerProtocol::writeMessage(m_processes.key(process),
+                                       RemoteWorkerProtocol::StandardError,
+                                       process->readAllStandardError());
+}
+
+void WorkerDaemon::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    QTcpSocket *socket = m_processes.key(process);
+    m_processes.remove(socket);
+    const QByteArray standardOutput = process->readAllStandardOutput();
+    if (!standardOutput.isEmpty())
+        RemoteWorkerProtocol::writeMessage(socket, RemoteWorkerProtocol::StandardOutput,
+                                           standardOutput);
+    const QByteArray standardError = process->readAllStandardError();
+    if (!standardError.isEmpty())
+        RemoteWorkerProtocol::writeMessage(socket, RemoteWorkerProtocol::StandardError,
+                                           standardError);
+    sendCommandFinished(socket, exitCode, exitStatus != QProcess::NormalExit);
+    process->deleteLater();
+}
+
+} // namespace NMakeFile
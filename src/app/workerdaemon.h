@@ -0,0 +1,83 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef WORKERDAEMON_H
+#define WORKERDAEMON_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QProcess>
+#include <QtCore/QSet>
+
+QT_BEGIN_NAMESPACE
+class QTcpServer;
+class QTcpSocket;
+QT_END_NAMESPACE
+
+namespace NMakeFile {
+
+/**
+ * Runs command lines on behalf of jom processes that were started with /REMOTE.
+ * Every connection runs one command at a time. The number of connections a
+ * client should open is announced in the hello message.
+ * Connections must authenticate before they can run commands. Without a shared
+ * secret in JOMWORKERSECRET, the daemon only listens on loopback addresses.
+ */
+class WorkerDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    WorkerDaemon(int slotCount, QObject *parent = 0);
+
+    bool listen(const QString &address);
+    QString errorString() const { return m_errorString; }
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onStandardOutput();
+    void onStandardError();
+    void onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
+
+private:
+    void authenticate(QTcpSocket *socket, const QByteArray &payload);
+    void runCommand(QTcpSocket *socket, const QByteArray &payload);
+    void killCommand(QTcpSocket *socket);
+
+private:
+    QTcpServer *m_server;
+    int m_slotCount;
+    QByteArray m_secret;
+    QString m_errorString;
+    QHash<QTcpSocket *, QByteArray> m_challenges;
+    QSet<QTcpSocket *> m_authenticatedSockets;
+    QHash<QTcpSocket *, QProcess *> m_processes;
+};
+
+} // namespace NMakeFile
+
+#endif // WORKERDAEMON_H
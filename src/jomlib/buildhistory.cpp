@@ -0,0 +1,140 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "buildhistory.h"
+#include "helperfunctions.h"
+#include "makefile.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QStandardPaths>
+
+namespace NMakeFile {
+
+BuildHistory::BuildHistory(const QString &fileName)
+    : m_fileName(fileName)
+    , m_modified(false)
+{
+    load();
+}
+
+BuildHistory *BuildHistory::instance()
+{
+    static BuildHistory *history = 0;
+    if (!history) {
+        QString directory = qGetEnvironmentVariable(L"JOMCACHEDIR");
+        if (directory.isEmpty()) {
+            directory = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                    + QLatin1String("/jom");
+        }
+        const QByteArray currentPath = QDir::currentPath().toLower().toUtf8();
+        const QString fileName = QDir::cleanPath(directory) + QLatin1String("/durations/")
+                + QString::fromLatin1(QCryptographicHash::hash(currentPath, QCryptographicHash::Sha1).toHex().left(16))
+                + QLatin1String(".txt");
+        history = new BuildHistory(fileName);
+    }
+    return history;
+}
+
+QString BuildHistory::key(DescriptionBlock *target)
+{
+    QString targetName = target->targetName();
+    removeDoubleQuotes(targetName);
+    return QDir::cleanPath(QDir(target->makefile()->workingDirectory())
+                           .absoluteFilePath(targetName)).toLower();
+}
+
+/**
+ * Returns the expected build time of a target in milliseconds or -1 if it is unknown.
+ */
+qint64 BuildHistory::duration(const QString &key) const
+{
+    return m_durations.value(key, -1);
+}
+
+/**
+ * Records a build time. Earlier build times of the target still count for one half.
+ */
+void BuildHistory::addDuration(const QString &key, qint64 msecs)
+{
+    const qint64 previous = m_durations.value(key, -1);
+    m_durations.insert(key, previous < 0 ? msecs : (previous + msecs) / 2);
+    m_modified = true;
+}
+
+/**
+ * Each line of the file holds the duration in milliseconds and the key.
+ */
+void BuildHistory::load()
+{
+    QFile file(m_fileName);
+    if (!file.open(QFile::ReadOnly))
+        return;
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().trimmed();
+        const int idx = line.indexOf(' ');
+        if (idx <= 0)
+            continue;
+        bool ok;
+        const qint64 msecs = line.left(idx).toLongLong(&ok);
+        if (ok && msecs >= 0)
+            m_durations.insert(QString::fromUtf8(line.mid(idx + 1)), msecs);
+    }
+}
+
+bool BuildHistory::save()
+{
+    if (!m_modified)
+        return true;
+
+    // Write and rename, so that other jom processes never see half a file.
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+    const QString tempFilePath = m_fileName + QLatin1Char('.')
+            + QString::number(QCoreApplication::applicationPid()) + QLatin1String(".tmp");
+    QFile file(tempFilePath);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+        return false;
+    QByteArray content;
+    for (QHash<QString, qint64>::const_iterator it = m_durations.constBegin();
+         it != m_durations.constEnd(); ++it)
+    {
+        content += QByteArray::number(it.value()) + ' ' + it.key().toUtf8() + '\n';
+    }
+    const bool written = file.write(content) == content.size();
+    file.close();
+    if (written)
+        QFile::remove(m_fileName);
+    if (!written || !QFile::rename(tempFilePath, m_fileName)) {
+        QFile::remove(tempFilePath);
+        return false;
+    }
+    m_modified = false;
+    return true;
+}
+
+} // namespace NMakeFile
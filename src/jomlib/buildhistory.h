@@ -0,0 +1,66 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef BUILDHISTORY_H
+#define BUILDHISTORY_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+namespace NMakeFile {
+
+class DescriptionBlock;
+
+/**
+ * Remembers how long targets took to build in previous runs.
+ *
+ * There is one file per directory jom was started in. It lives in the
+ * durations folder of JOMCACHEDIR, which defaults to the jom folder in the
+ * user's cache location. Targets are identified by their absolute file path.
+ */
+class BuildHistory
+{
+public:
+    explicit BuildHistory(const QString &fileName);
+
+    static BuildHistory *instance();
+    static QString key(DescriptionBlock *target);
+
+    qint64 duration(const QString &key) const;
+    void addDuration(const QString &key, qint64 msecs);
+    bool save();
+
+private:
+    void load();
+
+private:
+    QString m_fileName;
+    QHash<QString, qint64> m_durations;
+    bool m_modified;
+};
+
+} // namespace NMakeFile
+
+#endif // BUILDHISTORY_H
@@ -0,0 +1,126 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "buildtrace.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QJsonDocument>
+
+namespace NMakeFile {
+
+bool BuildTrace::m_enabled = false;
+static QFile *traceFile = 0;
+static bool firstEvent = true;
+
+static QElapsedTimer &traceClock()
+{
+    static QElapsedTimer timer;
+    if (!timer.isValid())
+        timer.start();
+    return timer;
+}
+
+/**
+ * Returns the nanoseconds since the clock of the trace was first read.
+ * Call this early to have the startup of jom on the timeline.
+ */
+qint64 BuildTrace::now()
+{
+    return traceClock().nsecsElapsed();
+}
+
+bool BuildTrace::open(const QString &fileName)
+{
+    close();
+    traceFile = new QFile(fileName);
+    if (!traceFile->open(QFile::WriteOnly | QFile::Truncate)) {
+        delete traceFile;
+        traceFile = 0;
+        return false;
+    }
+    traceFile->write("{\"traceEvents\":[\n");
+    firstEvent = true;
+    m_enabled = true;
+    setSlotName(0, QLatin1String("jom"));
+    return true;
+}
+
+void BuildTrace::close()
+{
+    if (!traceFile)
+        return;
+    traceFile->write("\n]}\n");
+    delete traceFile;
+    traceFile = 0;
+    m_enabled = false;
+}
+
+static void writeEvent(const QJsonObject &event)
+{
+    if (!firstEvent)
+        traceFile->write(",\n");
+    firstEvent = false;
+    traceFile->write(QJsonDocument(event).toJson(QJsonDocument::Compact));
+}
+
+void BuildTrace::setSlotName(int slot, const QString &name)
+{
+    if (!m_enabled)
+        return;
+    QJsonObject args;
+    args.insert(QLatin1String("name"), name);
+    QJsonObject event;
+    event.insert(QLatin1String("name"), QLatin1String("thread_name"));
+    event.insert(QLatin1String("ph"), QLatin1String("M"));
+    event.insert(QLatin1String("pid"), QCoreApplication::applicationPid());
+    event.insert(QLatin1String("tid"), slot);
+    event.insert(QLatin1String("args"), args);
+    writeEvent(event);
+}
+
+/**
+ * Adds a complete event. The times are values returned by now().
+ */
+void BuildTrace::addEvent(const QString &name, const char *category, int slot,
+                          qint64 startTime, qint64 endTime, const QJsonObject &args)
+{
+    if (!m_enabled)
+        return;
+    QJsonObject event;
+    event.insert(QLatin1String("name"), name);
+    event.insert(QLatin1String("cat"), QLatin1String(category));
+    event.insert(QLatin1String("ph"), QLatin1String("X"));
+    event.insert(QLatin1String("ts"), startTime / 1e3);
+    event.insert(QLatin1String("dur"), (endTime - startTime) / 1e3);
+    event.insert(QLatin1String("pid"), QCoreApplication::applicationPid());
+    event.insert(QLatin1String("tid"), slot);
+    if (!args.isEmpty())
+        event.insert(QLatin1String("args"), args);
+    writeEvent(event);
+}
+
+} // namespace NMakeFile
@@ -0,0 +1,82 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef BUILDTRACE_H
+#define BUILDTRACE_H
+
+#include <QtCore/QJsonObject>
+#include <QtCore/QString>
+
+namespace NMakeFile {
+
+/**
+ * Writes a timeline of the build in the Trace Event Format if /TRACE is given.
+ * The file can be loaded into chrome://tracing or Perfetto.
+ *
+ * Thread ids in the trace are job slots. Slot 0 is jom itself.
+ * All functions must be called by the main thread.
+ */
+class BuildTrace
+{
+public:
+    static qint64 now();
+    static bool open(const QString &fileName);
+    static void close();
+    static bool isEnabled() { return m_enabled; }
+    static void setSlotName(int slot, const QString &name);
+    static void addEvent(const QString &name, const char *category, int slot,
+                         qint64 startTime, qint64 endTime,
+                         const QJsonObject &args = QJsonObject());
+
+private:
+    static bool m_enabled;
+};
+
+/**
+ * Adds an event for the lifetime of the scope to slot 0.
+ */
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name)
+        : m_name(name), m_startTime(BuildTrace::isEnabled() ? BuildTrace::now() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (BuildTrace::isEnabled())
+            BuildTrace::addEvent(QLatin1String(m_name), "jom", 0, m_startTime, BuildTrace::now());
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+    const char *m_name;
+    qint64 m_startTime;
+};
+
+} // namespace NMakeFile
+
+#endif // BUILDTRACE_H
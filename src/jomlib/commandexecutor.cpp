@@ -24,31 +24,53 @@
 ****************************************************************************/
 
 #include "commandexecutor.h"
+#include "buildtrace.h"
+#include "consolewriter.h"
+#include "counters.h"
 #include "options.h"
 #include "exception.h"
 #include "helperfunctions.h"
 #include "fastfileinfo.h"
+#include "remoteworker.h"
+#include "resultcache.h"
+#include "submake.h"
 
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QHash>
 #include <QtCore/QRegExp>
 #include <QStringList>
 #include <windows.h>
+#include <limits>
 
 namespace NMakeFile {
 
-ulong CommandExecutor::m_startUpTickCount = 0;
+QAtomicInt CommandExecutor::m_tempFileCounter;
 QString CommandExecutor::m_tempPath;
+CommandExecutor::TempFileStatistics CommandExecutor::m_tempFileStatistics = { 0, 0, 0 };
 
 CommandExecutor::CommandExecutor(QObject* parent, const ProcessEnvironment &environment)
 :   QObject(parent),
     m_pTarget(0),
+    m_prepared(false),
     m_ignoreProcessErrors(false),
-    m_active(false)
+    m_executingScript(false),
+    m_aborting(false),
+    m_active(false),
+    m_subMake(0),
+    m_outputTarget(0),
+    m_remoteSlot(0),
+    m_canRunRemotely(false),
+    m_runsSubMake(false),
+    m_slot(0),
+    m_exitCode(0),
+    m_targetStartTime(0),
+    m_commandStartTime(0)
 {
-    if (m_startUpTickCount == 0)
-        m_startUpTickCount = GetTickCount();
-
     if (m_tempPath.isNull()) {
         WCHAR buf[MAX_PATH];
         DWORD count = GetTempPathW(MAX_PATH, buf);
@@ -68,25 +90,274 @@ CommandExecutor::~CommandExecutor()
     cleanupTempFiles();
 }
 
-void CommandExecutor::start(DescriptionBlock* target)
+static bool startsWithShellBuiltin(const QString &commandLine);
+static bool isShellComment(const QString &commandLine);
+
+/**
+ * Does all the work that is needed before the commands of the target can be run:
+ * file name macro expansion, creation of inline files and analysis of the command lines.
+ * This can happen ahead of time while we're waiting for a job token.
+ */
+void CommandExecutor::prepare(DescriptionBlock* target)
 {
     m_pTarget = target;
+    m_prepared = true;
+    m_preparedCommands.clear();
+    m_resultCacheKey.clear();
+    m_canRunRemotely = false;
+    m_runsSubMake = false;
+    if (target->m_commands.isEmpty())
+        return;
+
+    target->expandFileNameMacros();
+    cleanupTempFiles();
+    createTempFiles();
+
+    const Options *options = target->makefile()->options();
+    m_preparedCommands.reserve(target->m_commands.count());
+    foreach (const Command &cmd, target->m_commands) {
+        PreparedCommand prepared;
+        prepared.commandLine = cmd.m_commandLine;
+        prepared.commandLine.replace(QLatin1String("%%"), QLatin1String("%"));
+        prepared.isShellComment = isShellComment(prepared.commandLine);
+        prepared.isSimple = isSimpleCommandLine(prepared.commandLine);
+        prepared.canExecuteDirectly = prepared.isSimple
+                && !startsWithShellBuiltin(prepared.commandLine);
+        prepared.isSubMake = options->runSubMakesInProcess
+                && SubMake::parseCommandLine(prepared.commandLine, options->fullAppPath,
+                                             &prepared.subMakeWorkingDirectory,
+                                             &prepared.subMakeArguments);
+        m_preparedCommands.append(prepared);
+    }
+
+    if (!options->remoteWorkers.isEmpty() || options->outputSync == Options::OutputSyncTarget) {
+        for (int i = 0; !m_runsSubMake && i < m_preparedCommands.count(); ++i) {
+            QString directory;
+            QStringList arguments;
+            m_runsSubMake = SubMake::parseCommandLine(m_preparedCommands.at(i).commandLine,
+                                                      options->fullAppPath,
+                                                      &directory, &arguments);
+        }
+    }
+
+    // Recursive make invocations need the job server of this machine.
+    m_canRunRemotely = !options->remoteWorkers.isEmpty() && !options->dryRun && !m_runsSubMake;
+
+    m_resultCacheKey = computeResultCacheKey();
+}
+
+/**
+ * Runs the commands of the next target on a worker daemon instead of a local process.
+ * Builtins like cd and set are still handled locally.
+ */
+void CommandExecutor::setRemoteSlot(RemoteSlot *remoteSlot)
+{
+    if (m_remoteSlot)
+        disconnect(m_remoteSlot, 0, this, 0);
+    m_remoteSlot = remoteSlot;
+    if (m_remoteSlot) {
+        connect(m_remoteSlot, &RemoteSlot::outputReceived,
+                this, &CommandExecutor::onRemoteOutputReceived);
+        connect(m_remoteSlot, &RemoteSlot::finished,
+                this, &CommandExecutor::onRemoteCommandFinished);
+    }
+}
+
+static inline bool isOption(const QString &argument)
+{
+    return argument.length() >= 2
+            && (argument.at(0) == QLatin1Char('/') || argument.at(0) == QLatin1Char('-'));
+}
+
+/**
+ * Returns true if the command line contains a compiler or linker option that
+ * writes files besides the target, like program databases or import libraries.
+ */
+static bool hasSideOutputOption(const QString &commandLine)
+{
+    static const char * const sideOutputOptions[] = {
+        "zi", "fd", "fr", "fa", "fm", "debug", "dll", "implib", "pdb", "map"
+    };
+    foreach (const QString &argument, splitCommandLine(commandLine)) {
+        if (!isOption(argument))
+            continue;
+        const QString option = argument.mid(1).toLower();
+        for (size_t i = 0; i < sizeof(sideOutputOptions) / sizeof(sideOutputOptions[0]); ++i)
+            if (option.startsWith(QLatin1String(sideOutputOptions[i])))
+                return true;
+    }
+    return false;
+}
+
+/**
+ * Appends the directories of the /I options of the command line.
+ */
+static void appendIncludeDirectories(const QString &commandLine, const QDir &workingDirectory,
+                                     QStringList *directories)
+{
+    const QStringList arguments = splitCommandLine(commandLine);
+    for (int i = 0; i < arguments.count(); ++i) {
+        const QString &argument = arguments.at(i);
+        if (!isOption(argument) || argument.at(1).toLower() != QLatin1Char('i'))
+            continue;
+        QString directory = argument.mid(2);
+        if (directory.isEmpty() && i + 1 < arguments.count())
+            directory = arguments.at(++i);
+        if (!directory.isEmpty())
+            directories->append(QDir::cleanPath(workingDirectory.absoluteFilePath(directory)));
+    }
+}
+
+/**
+ * Returns the key under which the result cache stores the output of the current target.
+ * It's a hash of the command lines, the contents of the inline files, the dependents
+ * and the files they include, and the environment variables that influence the
+ * compiler and linker.
+ * Returns an empty key if the target is not cacheable. That is the case if an included
+ * file cannot be found, or if the commands write more than the target file.
+ */
+QByteArray CommandExecutor::computeResultCacheKey() const
+{
+    const Options *options = m_pTarget->makefile()->options();
+    if (!options->useResultCache || options->dryRun || options->checkTimeStampsButDoNotBuild
+        || options->changeTimeStampsButDoNotBuild)
+    {
+        return QByteArray();
+    }
+
+    // Batch mode rules build several targets with one command.
+    if (options->batchModeEnabled) {
+        foreach (const InferenceRule *rule, m_pTarget->m_inferenceRules)
+            if (rule->m_batchMode)
+                return QByteArray();
+    }
+
+    // Only the target file is stored in the cache.
+    if (m_pTarget->m_hasSiblingTargets)
+        return QByteArray();
+
+    foreach (const PreparedCommand &prepared, m_preparedCommands)
+        if (prepared.isSubMake || hasSideOutputOption(prepared.commandLine))
+            return QByteArray();
+
+    ResultCache *cache = ResultCache::instance();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData("jom result cache 2\n");
+    QString workingDirectory = m_pTarget->makefile()->workingDirectory();
+    if (workingDirectory.isEmpty())
+        workingDirectory = QDir::currentPath();
+    hash.addData(workingDirectory.toLower().toUtf8());
+    hash.addData("\n");
+    hash.addData(m_pTarget->targetName().toUtf8());
+    hash.addData("\n");
+
+    // The names of the inline files differ from build to build.
+    QList<QPair<QString, QString> > tempFileNames;
+    for (int i = 0; i < m_tempFiles.count(); ++i) {
+        tempFileNames.append(qMakePair(QDir::toNativeSeparators(m_tempFiles.at(i).file->fileName()),
+                                       QString(QLatin1String("<<inline%1>>")).arg(i)));
+    }
+    foreach (const PreparedCommand &prepared, m_preparedCommands) {
+        QString commandLine = prepared.commandLine;
+        for (int i = 0; i < tempFileNames.count(); ++i)
+            commandLine.replace(tempFileNames.at(i).first, tempFileNames.at(i).second);
+        hash.addData(commandLine.toUtf8());
+        hash.addData("\n");
+    }
+    foreach (const TempFile &tempFile, m_tempFiles) {
+        const QByteArray contentHash = cache->contentHash(tempFile.file->fileName());
+        if (contentHash.isEmpty())
+            return QByteArray();
+        hash.addData(contentHash);
+    }
+
+    // The compiler reads headers that are not listed as dependents.
+    const QDir workingDir(workingDirectory);
+    const ProcessEnvironment &environment = m_process.environment();
+    QStringList includeDirectories;
+    foreach (const PreparedCommand &prepared, m_preparedCommands)
+        appendIncludeDirectories(prepared.commandLine, workingDir, &includeDirectories);
+    QStringList systemIncludeDirectories;
+    foreach (const QString &directory, environment.value(QLatin1String("INCLUDE"))
+                                                  .split(QLatin1Char(';'), QString::SkipEmptyParts))
+    {
+        systemIncludeDirectories.append(QDir::cleanPath(workingDir.absoluteFilePath(directory)));
+    }
+
+    foreach (const QString &dependent, m_pTarget->m_dependents) {
+        QString fileName = dependent;
+        removeDoubleQuotes(fileName);
+        const QString filePath = workingDir.absoluteFilePath(fileName);
+        const QByteArray contentHash = cache->contentHash(filePath);
+        if (contentHash.isEmpty())
+            return QByteArray();
+        hash.addData(fileName.toUtf8());
+        hash.addData("\n");
+        hash.addData(contentHash);
+        if (!cache->addIncludedFiles(&hash, filePath, includeDirectories,
+                                     systemIncludeDirectories))
+        {
+            return QByteArray();
+        }
+    }
+
+    static const char * const relevantVariables[] = {
+        "PATH", "INCLUDE", "LIB", "LIBPATH", "CL", "_CL_", "LINK", "_LINK_"
+    };
+    for (size_t i = 0; i < sizeof(relevantVariables) / sizeof(relevantVariables[0]); ++i) {
+        const QString name = QLatin1String(relevantVariables[i]);
+        hash.addData(relevantVariables[i]);
+        hash.addData("=");
+        hash.addData(environment.value(name).toUtf8());
+        hash.addData("\n");
+    }
+
+    return hash.result().toHex();
+}
+
+void CommandExecutor::start(DescriptionBlock* target)
+{
+    if (!m_prepared || m_pTarget != target)
+        prepare(target);
+    m_prepared = false;
     m_active = true;
+    m_exitCode = 0;
+    m_targetStartTime = BuildTrace::now();
 
     if (target->m_commands.isEmpty()) {
         finishExecution(false);
         return;
     }
 
-    target->expandFileNameMacros();
-    cleanupTempFiles();
-    createTempFiles();
+    m_process.setKillProcessTree(target->makefile()->options()->failFast);
+    m_workingDirectory = target->makefile()->workingDirectory();
+    if (m_workingDirectory.isEmpty() && target->makefile()->options()->runSubMakesInProcess)
+        m_workingDirectory = QDir::currentPath();
+
+    m_resultCacheOutput.clear();
+    if (!m_resultCacheKey.isEmpty()) {
+        QString outputFilePath = target->targetName();
+        removeDoubleQuotes(outputFilePath);
+        m_resultCacheOutput = QDir(m_workingDirectory).absoluteFilePath(outputFilePath);
+        if (ResultCache::instance()->restore(m_resultCacheKey, m_resultCacheOutput)) {
+            if (!target->makefile()->options()->suppressExecutedCommandsDisplay) {
+                writeToStandardOutput("jom: restored " + target->targetName().toLocal8Bit()
+                                      + " from the result cache\n");
+            }
+            m_resultCacheKey.clear();
+            finishExecution(false);
+            return;
+        }
+    }
 
     m_ignoreProcessErrors = false;
     m_currentCommandIdx = 0;
     m_nextWorkingDir.clear();
     m_process.setWorkingDirectory(m_nextWorkingDir);
-    executeCurrentCommandLine();
+    if (!m_remoteSlot && canExecuteAsScript())
+        executeCommandScript();
+    else
+        executeCurrentCommandLine();
 }
 
 void CommandExecutor::onProcessError(Process::ProcessError error)
@@ -99,19 +370,32 @@ void CommandExecutor::onProcessError(Process::ProcessError error)
 void CommandExecutor::onProcessFinished(int exitCode, Process::ExitStatus exitStatus)
 {
     //qDebug() << "onProcessFinished" << m_pTarget->m_targetName;
+    if (m_aborting) {
+        m_aborting = false;
+        m_executingScript = false;
+        m_active = false;
+        return;
+    }
+
+    CurrentDirectoryScope directoryScope(m_workingDirectory);
     if (exitStatus != Process::NormalExit)
         exitCode = 2;
+    m_exitCode = exitCode;
+    if (BuildTrace::isEnabled())
+        traceCommand(exitCode);
+
+    if (m_executingScript) {
+        // The script checks the exit codes of the commands itself.
+        m_executingScript = false;
+        if (exitCode != 0)
+            writeErrorMessage(exitCode);
+        finishExecution(exitCode != 0);
+        return;
+    }
 
     const Command &currentCommand = m_pTarget->m_commands.at(m_currentCommandIdx);
     if (static_cast<unsigned int>(exitCode) > currentCommand.m_maxExitCode) {
-        QByteArray msg = "jom: ";
-        msg += QDir::toNativeSeparators(
-                    QDir::current().absoluteFilePath(
-                        m_pTarget->makefile()->fileName())).toLocal8Bit();
-        msg += " [" + m_pTarget->targetName().toLocal8Bit() + "] Error ";
-        msg += QByteArray::number(exitCode);
-        msg += "\n";
-        writeToStandardError(msg);
+        writeErrorMessage(exitCode);
         finishExecution(true);
         return;
     }
@@ -124,14 +408,120 @@ void CommandExecutor::onProcessFinished(int exitCode, Process::ExitStatus exitSt
     }
 }
 
+/**
+ * Returns the command line that is running, or the name of the command script.
+ */
+QString CommandExecutor::currentCommandLine() const
+{
+    if (m_executingScript)
+        return QLatin1String("command script");
+    if (m_currentCommandIdx < m_preparedCommands.count())
+        return m_preparedCommands.at(m_currentCommandIdx).commandLine;
+    return QString();
+}
+
+/**
+ * Returns the time in nanoseconds since the current command was started.
+ */
+qint64 CommandExecutor::currentCommandTime() const
+{
+    return BuildTrace::now() - m_commandStartTime;
+}
+
+/**
+ * Returns the time in nanoseconds since the target was started.
+ */
+qint64 CommandExecutor::targetTime() const
+{
+    return BuildTrace::now() - m_targetStartTime;
+}
+
+void CommandExecutor::traceCommand(int exitCode)
+{
+    const QString name = currentCommandLine();
+    QJsonObject args;
+    args.insert(QLatin1String("exitCode"), exitCode);
+    if (m_remoteSlot)
+        args.insert(QLatin1String("remote"), true);
+    BuildTrace::addEvent(name, "command", m_slot, m_commandStartTime, BuildTrace::now(), args);
+}
+
+void CommandExecutor::writeErrorMessage(int exitCode)
+{
+    QByteArray msg = "jom: ";
+    msg += QDir::toNativeSeparators(
+                QDir::current().absoluteFilePath(
+                    m_pTarget->makefile()->fileName())).toLocal8Bit();
+    msg += " [" + m_pTarget->targetName().toLocal8Bit() + "] Error ";
+    msg += QByteArray::number(exitCode);
+    msg += "\n";
+    writeToStandardError(msg);
+}
+
 void CommandExecutor::finishExecution(bool commandFailed)
 {
+    // Later targets might create or remove programs.
+    m_programCache.clear();
+    m_executableCache.clear();
+    if (!commandFailed && !m_resultCacheKey.isEmpty())
+        ResultCache::instance()->store(m_resultCacheKey, m_resultCacheOutput);
+    m_resultCacheKey.clear();
+    if (BuildTrace::isEnabled()) {
+        QJsonObject args;
+        args.insert(QLatin1String("exitCode"), m_exitCode);
+        args.insert(QLatin1String("failed"), commandFailed);
+        args.insert(QLatin1String("makefile"), m_pTarget->makefile()->fileName());
+        BuildTrace::addEvent(m_pTarget->targetName(), "target", m_slot,
+                             m_targetStartTime, BuildTrace::now(), args);
+    }
     m_active = false;
     emit finished(this, commandFailed);
 }
 
+/**
+ * Kills the running command and all of its child processes.
+ * The finished signal is not emitted for an aborted command.
+ */
+void CommandExecutor::abort()
+{
+    if (!m_active)
+        return;
+
+    if (m_subMake) {
+        m_subMake->abort();
+        m_subMake->deleteLater();
+        m_subMake = 0;
+        m_active = false;
+        return;
+    }
+
+    if (m_remoteSlot && m_remoteSlot->isBusy()) {
+        m_aborting = true;
+        m_remoteSlot->kill();
+        return;
+    }
+
+    if (!m_process.isRunning()) {
+        m_active = false;
+        return;
+    }
+
+    m_aborting = true;
+    m_process.kill();
+}
+
 void CommandExecutor::waitForFinished()
 {
+    if (m_subMake) {
+        QEventLoop eventLoop;
+        connect(m_subMake, &SubMake::finished, &eventLoop, &QEventLoop::quit);
+        eventLoop.exec();
+        return;
+    }
+    if (m_remoteSlot) {
+        m_remoteSlot->waitForFinished();
+        return;
+    }
     m_process.waitForFinished();
 }
 
@@ -151,8 +541,96 @@ static bool startsWithShellBuiltin(const QString &commandLine)
     return rex.indexIn(commandLine) >= 0;
 }
 
+static QString shellCommand()
+{
+    QString shellCmd = qGetEnvironmentVariable(L"ComSpec");
+    if (shellCmd.isEmpty())
+        shellCmd = QLatin1String("cmd.exe");
+    return shellCmd;
+}
+
+/**
+ * Splits a command line at the command separators & && | ||.
+ * Returns the commands without leading @ characters.
+ */
+static QStringList shellCommands(const QString &commandLine)
+{
+    QStringList commands;
+    bool insideQuotes = false;
+    int start = 0;
+    for (int i = 0; i <= commandLine.length(); ++i) {
+        if (i < commandLine.length()) {
+            const QChar ch = commandLine.at(i);
+            if (ch == QLatin1Char('"'))
+                insideQuotes = !insideQuotes;
+            if (insideQuotes)
+                continue;
+            if (ch == QLatin1Char('^')) {
+                ++i;
+                continue;
+            }
+            if (ch != QLatin1Char('&') && ch != QLatin1Char('|'))
+                continue;
+            // Redirections like 2>&1
+            if (ch == QLatin1Char('&') && i > 0
+                && (commandLine.at(i - 1) == QLatin1Char('>')
+                    || commandLine.at(i - 1) == QLatin1Char('<')))
+            {
+                continue;
+            }
+        }
+        QString command = commandLine.mid(start, i - start).trimmed();
+        while (command.startsWith(QLatin1Char('@')))
+            command = command.mid(1).trimmed();
+        if (!command.isEmpty())
+            commands.append(command);
+        start = i + 1;
+    }
+    return commands;
+}
+
+static QString programName(const QString &commandLine);
+
+/**
+ * Returns true, if the command line can be run by a shell worker.
+ * The command line is put into parentheses and must not change the state
+ * of the shell, because the shell is reused for the following commands.
+ * Therefore every command must be a builtin that leaves the shell alone
+ * or a program that is no batch file.
+ */
+bool CommandExecutor::canExecuteInShellWorker(const QString &commandLine)
+{
+    static QRegExp rexUnsafe(QLatin1String("[()\\r\\n]|\\^$"));
+    if (rexUnsafe.indexIn(commandLine) >= 0)
+        return false;
+
+    static QRegExp rexHarmlessBuiltin(QLatin1String(
+        "^(copy|del|dir|echo|erase|md|mkdir|mklink|move|rd|rem|ren|rename|rmdir|type|ver|vol)"
+        "([\\s.:;,=/+]|$)"
+        ), Qt::CaseInsensitive, QRegExp::RegExp2);
+    foreach (const QString &command, shellCommands(commandLine)) {
+        if (rexHarmlessBuiltin.indexIn(command) >= 0)
+            continue;
+        const QString fileName = findProgramForShell(programName(command));
+        if (!fileName.endsWith(QLatin1String(".exe"), Qt::CaseInsensitive)
+            && !fileName.endsWith(QLatin1String(".com"), Qt::CaseInsensitive))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isShellComment(const QString &commandLine)
+{
+    static QRegExp rexShellComment(QLatin1String("^(:|rem\\s)"),
+                                   Qt::CaseInsensitive, QRegExp::RegExp2);
+    return rexShellComment.indexIn(commandLine) >= 0;
+}
+
 void CommandExecutor::executeCurrentCommandLine()
 {
+    m_commandStartTime = BuildTrace::now();
     const Command& cmd = m_pTarget->m_commands.at(m_currentCommandIdx);
     QString commandLine = cmd.m_commandLine;
 
@@ -165,13 +643,9 @@ void CommandExecutor::executeCurrentCommandLine()
         writeToStandardOutput(output);
     }
 
-    // Unescape commandline characters.
-    commandLine.replace(QLatin1String("%%"), QLatin1String("%"));
-
-    static QRegExp rexShellComment(QLatin1String("^(:|rem\\s)"),
-                                   Qt::CaseInsensitive, QRegExp::RegExp2);
-    if (m_pTarget->makefile()->options()->dryRun || (rexShellComment.indexIn(commandLine) >= 0))
-    {
+    const PreparedCommand &prepared = m_preparedCommands.at(m_currentCommandIdx);
+    commandLine = prepared.commandLine;
+    if (m_pTarget->makefile()->options()->dryRun || prepared.isShellComment) {
         onProcessFinished(0, Process::NormalExit);
         return;
     }
@@ -181,7 +655,7 @@ void CommandExecutor::executeCurrentCommandLine()
         m_nextWorkingDir.clear();
     }
 
-    const bool simpleCmdLine = isSimpleCommandLine(commandLine);
+    const bool simpleCmdLine = prepared.isSimple;
     if (simpleCmdLine)
     {
         // handle builtins
@@ -205,19 +679,27 @@ void CommandExecutor::executeCurrentCommandLine()
             builtInHandled = false;
         }
         if (builtInHandled) {
+            Counters::increment(Counters::ShellsAvoided);
             onProcessFinished(success ? 0 : 1, Process::NormalExit);
             return;
         }
     }
 
+    if (prepared.isSubMake && startSubMake(prepared)) {
+        Counters::increment(Counters::ShellsAvoided);
+        return;
+    }
+
+    if (m_remoteSlot) {
+        startRemoteCommand(commandLine);
+        return;
+    }
+
     bool executionSucceeded = false;
-    if (simpleCmdLine && !startsWithShellBuiltin(commandLine)) {
-        // ### It would be cool if we would not try to start every command directly.
-        //     If its a shell builtin not handled by "startsWithShellBuiltin" IncrediBuild
-        //     might complain about the failed process.
-        //     Instead try to locate the binary using the PATH and so on and directly
-        //     start the program using the absolute path.
-        //     Code to locate the binary must be compatible to what CreateProcess does.
+    if (prepared.canExecuteDirectly && isExecutableAvailable(commandLine)) {
+        // ### If the program is a shell builtin not handled by "startsWithShellBuiltin"
+        //     and a file with the same name exists, IncrediBuild might complain about
+        //     the failed process.
 
         //qDebug("+++ direct exec");
         m_ignoreProcessErrors = true;
@@ -226,6 +708,16 @@ void CommandExecutor::executeCurrentCommandLine()
         m_ignoreProcessErrors = false;
     }
 
+    if (!executionSucceeded && m_pTarget->makefile()->options()->useShellWorkers
+        && canExecuteInShellWorker(commandLine))
+    {
+        //qDebug("+++ shell worker exec");
+        executionSucceeded = m_process.startInShellWorker(commandLine);
+    }
+
+    if (executionSucceeded)
+        Counters::increment(Counters::ShellsAvoided);
+
     if (!executionSucceeded) {
         //qDebug("+++ shell exec");
 
@@ -241,11 +733,7 @@ void CommandExecutor::executeCurrentCommandLine()
             commandLine.append(doubleQuote);
         }
 
-        QString shellCmd = qGetEnvironmentVariable(L"ComSpec");
-        if (shellCmd.isEmpty())
-            shellCmd = QLatin1String("cmd.exe");
-
-        commandLine = shellCmd + QLatin1Literal(" /C ") + commandLine;
+        commandLine = shellCommand() + QLatin1Literal(" /C ") + commandLine;
         m_process.start(commandLine);
         executionSucceeded = m_process.isRunning();
     }
@@ -254,6 +742,207 @@ void CommandExecutor::executeCurrentCommandLine()
         qFatal("Can't start command: %s", qPrintable(commandLine));
 }
 
+/**
+ * Runs a $(MAKE) command line inside this jom process.
+ * Returns false if the sub-make must be started as a separate process.
+ */
+bool CommandExecutor::startSubMake(const PreparedCommand &prepared)
+{
+    QString directory = m_process.workingDirectory();
+    if (directory.isEmpty())
+        directory = QDir::currentPath();
+    if (!prepared.subMakeWorkingDirectory.isEmpty())
+        directory = QDir(directory).absoluteFilePath(prepared.subMakeWorkingDirectory);
+
+    m_subMake = new SubMake(m_process.environment(), this);
+    connect(m_subMake, &SubMake::finished, this, &CommandExecutor::onSubMakeFinished);
+    if (!m_subMake->start(directory, prepared.subMakeArguments)) {
+        delete m_subMake;
+        m_subMake = 0;
+        return false;
+    }
+    return true;
+}
+
+void CommandExecutor::startRemoteCommand(const QString &commandLine)
+{
+    QString workingDirectory = m_process.workingDirectory();
+    if (workingDirectory.isEmpty())
+        workingDirectory = QDir::currentPath();
+
+    QList<RemoteInlineFile> inlineFiles;
+    foreach (const TempFile &tempFile, m_tempFiles) {
+        if (!tempFile.file->open(QFile::ReadOnly)) {
+            QString msg = QLatin1String("cannot open %1 for read");
+            throw Exception(msg.arg(tempFile.file->fileName()));
+        }
+        inlineFiles.append(RemoteInlineFile(QDir::toNativeSeparators(tempFile.file->fileName()),
+                                            tempFile.file->readAll()));
+        tempFile.file->close();
+    }
+
+    m_remoteSlot->start(commandLine, QDir::toNativeSeparators(workingDirectory),
+                        m_process.environment(), inlineFiles);
+}
+
+void CommandExecutor::onRemoteOutputReceived(const QByteArray &data, bool isStandardError)
+{
+    if (isStandardError)
+        writeToStandardError(data);
+    else
+        writeToStandardOutput(data);
+}
+
+void CommandExecutor::onRemoteCommandFinished(int exitCode, bool crashed)
+{
+    m_process.printBufferedOutput();
+    onProcessFinished(exitCode, crashed ? Process::CrashExit : Process::NormalExit);
+}
+
+void CommandExecutor::onSubMakeFinished(int exitCode)
+{
+    if (sender() != m_subMake)
+        return;     // aborted
+    m_subMake->deleteLater();
+    m_subMake = 0;
+    onProcessFinished(exitCode, Process::NormalExit);
+}
+
+bool CommandExecutor::canExecuteAsScript()
+{
+    const Options *options = m_pTarget->makefile()->options();
+    if (!options->useCommandScripts || options->dryRun || m_pTarget->m_commands.count() < 2)
+        return false;
+
+    foreach (const PreparedCommand &prepared, m_preparedCommands) {
+        // The set builtin must change the environment of jom itself.
+        if (prepared.isSimple
+            && commandLineStartsWithCommand(prepared.commandLine, QLatin1String("set")))
+        {
+            return false;
+        }
+
+        // Sub-makes are run by jom itself.
+        if (prepared.isSubMake)
+            return false;
+
+        // In a batch file %1, %~dp0 and undefined variables expand differently than with cmd /C.
+        if (prepared.commandLine.contains(QLatin1Char('%')))
+            return false;
+
+        // A batch file that is started without "call" never returns to our script.
+        if (!prepared.isShellComment && startsBatchFile(prepared.commandLine))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Returns true, if one of the commands of the command line runs a .bat or .cmd file.
+ */
+bool CommandExecutor::startsBatchFile(const QString &commandLine)
+{
+    foreach (const QString &command, shellCommands(commandLine)) {
+        const QString fileName = findProgramForShell(programName(command));
+        if (fileName.endsWith(QLatin1String(".bat"), Qt::CaseInsensitive)
+            || fileName.endsWith(QLatin1String(".cmd"), Qt::CaseInsensitive))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Escapes a command line such that "echo(" prints it literally from within a batch file.
+ */
+static QString escapeForBatchEcho(const QString &commandLine)
+{
+    QString result;
+    result.reserve(commandLine.length() * 2);
+    bool insideQuotes = false;
+    foreach (const QChar &ch, commandLine) {
+        switch (ch.unicode()) {
+        case '"':
+            insideQuotes = !insideQuotes;
+            break;
+        case '%':
+            result += ch;
+            break;
+        case '^':
+        case '&':
+        case '|':
+        case '<':
+        case '>':
+            if (!insideQuotes)
+                result += QLatin1Char('^');
+            break;
+        }
+        result += ch;
+    }
+    return result;
+}
+
+/**
+ * Writes all commands of the current target into one batch file and runs it
+ * with a single shell process. Command echoing and the exit code checks
+ * are done by the batch file.
+ */
+void CommandExecutor::executeCommandScript()
+{
+    const Options *options = m_pTarget->makefile()->options();
+    QByteArray script = "@echo off\r\n";
+    foreach (const Command &cmd, m_pTarget->m_commands) {
+        if (!cmd.m_silent && !options->suppressExecutedCommandsDisplay) {
+            script += "echo(\t";
+            script += escapeForBatchEcho(cmd.m_commandLine).toLocal8Bit();
+            script += "\r\n";
+        }
+
+        QString commandLine = cmd.m_commandLine;
+        QString unescapedCommandLine = commandLine;
+        unescapedCommandLine.replace(QLatin1String("%%"), QLatin1String("%"));
+        if (isShellComment(unescapedCommandLine))
+            continue;
+
+        if (isSimpleCommandLine(unescapedCommandLine)
+            && commandLineStartsWithCommand(unescapedCommandLine, QLatin1String("cd"))
+            && !commandLine.mid(3).trimmed().startsWith(QLatin1String("/d"), Qt::CaseInsensitive))
+        {
+            // Our cd builtin changes the drive too.
+            commandLine.insert(3, QLatin1String("/d "));
+        }
+
+        const bool checkExitCode = cmd.m_maxExitCode != std::numeric_limits<unsigned int>::max();
+        if (checkExitCode) {
+            // Builtins like echo do not reset the error level.
+            script += "(call )\r\n";
+        }
+        script += commandLine.toLocal8Bit();
+        script += "\r\n";
+        if (checkExitCode) {
+            script += "if %ERRORLEVEL% LSS 0 exit /b %ERRORLEVEL%\r\n";
+            script += "if %ERRORLEVEL% GTR " + QByteArray::number(cmd.m_maxExitCode)
+                    + " exit /b %ERRORLEVEL%\r\n";
+        }
+    }
+    script += "exit /b 0\r\n";
+
+    TempFile tempFile;
+    tempFile.keep = false;
+    tempFile.file = createTempFile(QLatin1String(".bat"), script, tempFile.keep);
+    m_tempFiles.append(tempFile);
+
+    // The outer double quotes are stripped by cmd. See "cmd /?" for the reason.
+    const QString commandLine = shellCommand() + QLatin1Literal(" /C \"\"")
+            + QDir::toNativeSeparators(tempFile.file->fileName()) + QLatin1Literal("\"\"");
+    m_executingScript = true;
+    m_commandStartTime = BuildTrace::now();
+    m_process.start(commandLine);
+    if (!m_process.isRunning())
+        qFatal("Can't start command: %s", qPrintable(commandLine));
+}
+
 void CommandExecutor::createTempFiles()
 {
     QList<Command>::iterator it = m_pTarget->m_commands.begin();
@@ -261,41 +950,32 @@ void CommandExecutor::createTempFiles()
     for (; it != itEnd; ++it) {
         Command& cmd = *it;
         foreach (InlineFile* inlineFile, cmd.m_inlineFiles) {
-            QString fileName;
-            if (inlineFile->m_filename.isEmpty()) {
-                do {
-                    QString simplifiedTargetName = m_pTarget->targetName();
-                    simplifiedTargetName = fileNameFromFilePath(simplifiedTargetName);
-                    fileName = m_tempPath + simplifiedTargetName + QLatin1Char('.')
-                               + QString::number(GetCurrentProcessId()) + QLatin1Char('.')
-                               + QString::number(GetTickCount() - m_startUpTickCount)
-                               + QLatin1Literal(".jom");
-                } while (QFile::exists(fileName));
-            } else
-                fileName = inlineFile->m_filename;
+            // TODO: do something with inlineFile->m_unicode;
+            const QByteArray content = inlineFile->m_content.toLocal8Bit();
 
             TempFile tempFile;
             tempFile.keep = inlineFile->m_keep;
-            tempFile.file = new QFile(fileName);
-            if (!tempFile.file->open(QFile::WriteOnly)) {
-                delete tempFile.file;
-                QString msg = QLatin1String("cannot open %1 for write");
-                throw Exception(msg.arg(fileName));
+            if (inlineFile->m_filename.isEmpty()) {
+                tempFile.file = createTempFile(QLatin1String(".jom"), content, tempFile.keep);
+            } else {
+                tempFile.file = new QFile(inlineFile->m_filename);
+                if (!tempFile.file->open(QFile::WriteOnly)) {
+                    delete tempFile.file;
+                    QString msg = QLatin1String("cannot open %1 for write");
+                    throw Exception(msg.arg(inlineFile->m_filename));
+                }
+                tempFile.file->write(content);
+                tempFile.file->close();
             }
 
-            const QByteArray content = inlineFile->m_content.toLocal8Bit();
             if (m_pTarget->makefile()->options()->dumpInlineFiles) {
                 writeToStandardOutput("---");
-                writeToStandardOutput(fileName.toLocal8Bit());
+                writeToStandardOutput(tempFile.file->fileName().toLocal8Bit());
                 writeToStandardOutput("---\n");
                 writeToStandardOutput(content);
                 writeToStandardOutput("---end of inline file---\n");
             }
 
-            // TODO: do something with inlineFile->m_unicode;
-            tempFile.file->write(content);
-            tempFile.file->close();
-
             QString replacement = QDir::toNativeSeparators(tempFile.file->fileName());
             if (replacement.contains(QLatin1Char(' ')) || replacement.contains(QLatin1Char('\t'))) {
                 replacement.prepend(QLatin1Char('"'));
@@ -311,25 +991,118 @@ void CommandExecutor::createTempFiles()
     }
 }
 
+/**
+ * Returns the directory for the temporary files of this jom process.
+ * It's removed on exit if nothing was kept in it.
+ */
+static QString tempDirectory(const QString &tempPath)
+{
+    static QString directory;
+    if (directory.isNull()) {
+        directory = tempPath + QLatin1String("jom.")
+                + QString::number(GetCurrentProcessId()) + QLatin1Char('\\');
+        if (CreateDirectoryW(reinterpret_cast<const wchar_t *>(directory.utf16()), NULL)
+            || GetLastError() == ERROR_ALREADY_EXISTS)
+        {
+            qAddPostRoutine([] () {
+                RemoveDirectoryW(reinterpret_cast<const wchar_t *>(directory.utf16()));
+            });
+        } else {
+            directory = tempPath;
+        }
+    }
+    return directory;
+}
+
+/**
+ * The names are unique within this process, and the process id is part of the
+ * directory name. No need to check whether a file exists.
+ */
+QString CommandExecutor::createUniqueTempFileName(const QString &extension)
+{
+    return tempDirectory(m_tempPath) + fileNameFromFilePath(m_pTarget->targetName())
+            + QLatin1Char('.') + QString::number(m_tempFileCounter.fetchAndAddRelaxed(1))
+            + extension;
+}
+
+/**
+ * Creates a temporary file with the given content.
+ * Files that are not kept are marked as temporary, so that their content
+ * usually stays in the file system cache and is never written to disk.
+ */
+QFile *CommandExecutor::createTempFile(const QString &extension, const QByteArray &content,
+                                       bool keep)
+{
+    QElapsedTimer timer;
+    timer.start();
+    forever {
+        const QString fileName = createUniqueTempFileName(extension);
+        HANDLE hFile = CreateFileW(reinterpret_cast<const wchar_t *>(fileName.utf16()),
+                                   GENERIC_WRITE, 0, NULL, CREATE_NEW,
+                                   keep ? FILE_ATTRIBUTE_NORMAL : FILE_ATTRIBUTE_TEMPORARY,
+                                   NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            // Left over by a crashed jom that had the same process id.
+            if (GetLastError() == ERROR_FILE_EXISTS)
+                continue;
+            QString msg = QLatin1String("cannot open %1 for write");
+            throw Exception(msg.arg(fileName));
+        }
+
+        DWORD bytesWritten = 0;
+        const bool written = WriteFile(hFile, content.constData(), content.size(),
+                                       &bytesWritten, NULL)
+                && bytesWritten == DWORD(content.size());
+        CloseHandle(hFile);
+        if (!written) {
+            QFile::remove(fileName);
+            QString msg = QLatin1String("cannot write %1");
+            throw Exception(msg.arg(fileName));
+        }
+
+        m_tempFileStatistics.count++;
+        m_tempFileStatistics.bytes += content.size();
+        m_tempFileStatistics.nsecs += timer.nsecsElapsed();
+        return new QFile(fileName);
+    }
+}
+
 void CommandExecutor::cleanupTempFiles()
 {
+    if (m_tempFiles.isEmpty())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
     while (!m_tempFiles.isEmpty()) {
         const TempFile& tempfile = m_tempFiles.takeLast();
         if (!tempfile.keep) tempfile.file->remove();
         delete tempfile.file;
     }
+    m_tempFileStatistics.nsecs += timer.nsecsElapsed();
 }
 
 void CommandExecutor::writeToChannel(const QByteArray& data, FILE *channel)
 {
-    fputs(data, channel);
-    fflush(channel);
+    ConsoleWriter::writeText(channel, data);
+}
+
+/**
+ * Sends all output to the given executor instead of the console.
+ * Used for the executors of an in-process sub-make.
+ */
+void CommandExecutor::setOutputTarget(CommandExecutor *target)
+{
+    m_outputTarget = target;
+    m_process.setOutputTarget(target ? &target->m_process : 0);
 }
 
 void CommandExecutor::writeToStandardOutput(const QByteArray& output)
 {
     if (m_process.isBufferedOutputSet())
         m_process.writeToStdOutBuffer(output);
+    else if (m_outputTarget)
+        m_outputTarget->writeToStandardOutput(output);
     else
         writeToChannel(output, stdout);
 }
@@ -338,6 +1111,8 @@ void CommandExecutor::writeToStandardError(const QByteArray& output)
 {
     if (m_process.isBufferedOutputSet())
         m_process.writeToStdErrBuffer(output);
+    else if (m_outputTarget)
+        m_outputTarget->writeToStandardError(output);
     else
         writeToChannel(output, stderr);
 }
@@ -348,6 +1123,145 @@ bool CommandExecutor::isSimpleCommandLine(const QString &commandLine)
     return rex.indexIn(commandLine) == -1;
 }
 
+static QString programName(const QString &commandLine)
+{
+    if (commandLine.startsWith(QLatin1Char('"'))) {
+        const int idx = commandLine.indexOf(QLatin1Char('"'), 1);
+        return idx < 0 ? commandLine.mid(1) : commandLine.mid(1, idx - 1);
+    }
+
+    int idx = 0;
+    while (idx < commandLine.length() && !commandLine.at(idx).isSpace())
+        ++idx;
+    return commandLine.left(idx);
+}
+
+/**
+ * Returns false, if CreateProcess cannot find the program of the command line.
+ * We search where CreateProcess searches: the application directory, the current directory
+ * of jom, the system directories and the PATH. We look into the working directory
+ * of the command too, because a cd command might have changed it.
+ * In case of doubt true is returned. The results are cached until the target is finished.
+ */
+bool CommandExecutor::isExecutableAvailable(const QString &commandLine)
+{
+    QString program = programName(commandLine);
+    if (program.isEmpty()
+        || program.contains(QLatin1Char('/'))
+        || program.contains(QLatin1Char('\\'))
+        || program.contains(QLatin1Char(':')))
+    {
+        return true;
+    }
+
+    if (!program.contains(QLatin1Char('.')))
+        program += QLatin1String(".exe");
+
+    ProcessEnvironment::const_iterator it = m_process.environment().find(QLatin1String("PATH"));
+    const QString path = it != m_process.environment().constEnd()
+            ? it.value() : qGetEnvironmentVariable(L"PATH");
+    const QString currentDirectory = QDir::currentPath();
+    QString workingDirectory = m_process.workingDirectory();
+    if (workingDirectory.isEmpty())
+        workingDirectory = currentDirectory;
+
+    const QString cacheKey = program + QLatin1Char('|') + currentDirectory
+                             + QLatin1Char('|') + workingDirectory + QLatin1Char('|') + path;
+    QHash<QString, bool>::const_iterator cacheIt = m_executableCache.constFind(cacheKey);
+    if (cacheIt != m_executableCache.constEnd())
+        return cacheIt.value();
+
+    QStringList searchPath;
+    searchPath << QCoreApplication::applicationDirPath() << currentDirectory;
+    if (workingDirectory != currentDirectory)
+        searchPath << workingDirectory;
+    WCHAR buf[MAX_PATH];
+    UINT count = GetSystemDirectoryW(buf, MAX_PATH);
+    if (count && count < MAX_PATH)
+        searchPath << QString::fromWCharArray(buf, count);
+    count = GetWindowsDirectoryW(buf, MAX_PATH);
+    if (count && count < MAX_PATH)
+        searchPath << QString::fromWCharArray(buf, count);
+    searchPath += path.split(QLatin1Char(';'), QString::SkipEmptyParts);
+
+    bool found = false;
+    foreach (QString directory, searchPath) {
+        removeDoubleQuotes(directory);
+        if (QFile::exists(directory + QLatin1Char('/') + program)) {
+            found = true;
+            break;
+        }
+    }
+    m_executableCache.insert(cacheKey, found);
+    return found;
+}
+
+/**
+ * Returns the file that cmd starts for the program, or an empty string if there's none.
+ * Like cmd, we look into the working directory and the PATH, and try the
+ * extensions of PATHEXT in each directory.
+ * The results are cached until the target is finished.
+ */
+QString CommandExecutor::findProgramForShell(const QString &program)
+{
+    if (program.isEmpty())
+        return QString();
+
+    const ProcessEnvironment &environment = m_process.environment();
+    ProcessEnvironment::const_iterator it = environment.find(QLatin1String("PATH"));
+    const QString path = it != environment.constEnd()
+            ? it.value() : qGetEnvironmentVariable(L"PATH");
+    it = environment.find(QLatin1String("PATHEXT"));
+    QString pathExt = it != environment.constEnd()
+            ? it.value() : qGetEnvironmentVariable(L"PATHEXT");
+    if (pathExt.isEmpty())
+        pathExt = QLatin1String(".COM;.EXE;.BAT;.CMD");
+    QString workingDirectory = m_process.workingDirectory();
+    if (workingDirectory.isEmpty())
+        workingDirectory = QDir::currentPath();
+
+    const QString cacheKey = program + QLatin1Char('|') + workingDirectory
+                             + QLatin1Char('|') + path + QLatin1Char('|') + pathExt;
+    QHash<QString, QString>::const_iterator cacheIt = m_programCache.constFind(cacheKey);
+    if (cacheIt != m_programCache.constEnd())
+        return cacheIt.value();
+
+    QStringList directories;
+    QString name = program;
+    if (program.contains(QLatin1Char('/')) || program.contains(QLatin1Char('\\'))
+        || program.contains(QLatin1Char(':')))
+    {
+        const QFileInfo fileInfo(QDir(workingDirectory), program);
+        directories << fileInfo.absolutePath();
+        name = fileInfo.fileName();
+    } else {
+        directories << workingDirectory;
+        directories += path.split(QLatin1Char(';'), QString::SkipEmptyParts);
+    }
+
+    QStringList candidates;
+    if (name.contains(QLatin1Char('.')))
+        candidates << name;
+    foreach (const QString &extension, pathExt.split(QLatin1Char(';'), QString::SkipEmptyParts))
+        candidates << name + extension;
+
+    QString result;
+    foreach (QString directory, directories) {
+        removeDoubleQuotes(directory);
+        foreach (const QString &candidate, candidates) {
+            const QString fileName = directory + QLatin1Char('/') + candidate;
+            if (QFileInfo(fileName).isFile()) {
+                result = fileName;
+                break;
+            }
+        }
+        if (!result.isEmpty())
+            break;
+    }
+    m_programCache.insert(cacheKey, result);
+    return result;
+}
+
 bool CommandExecutor::exec_cd(const QString &commandLine)
 {
     QString args = commandLine.right(commandLine.count() - 3);    // cut of "cd "
@@ -29,7 +29,10 @@
 #include "makefile.h"
 #include "jomprocess.h"
 #include <QFile>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QHash>
 #include <QString>
+#include <QVector>
 
 QT_BEGIN_NAMESPACE
 class QStringList;
@@ -37,6 +40,9 @@ QT_END_NAMESPACE
 
 namespace NMakeFile {
 
+class RemoteSlot;
+class SubMake;
+
 class CommandExecutor : public QObject
 {
     Q_OBJECT
@@ -44,12 +50,35 @@ public:
     CommandExecutor(QObject* parent, const ProcessEnvironment &environment);
     ~CommandExecutor();
 
+    void prepare(DescriptionBlock* target);
     void start(DescriptionBlock* target);
     DescriptionBlock* target() { return m_pTarget; }
     bool isActive() const { return m_active; }
+    bool canRunRemotely() const { return m_canRunRemotely; }
+    bool runsSubMake() const { return m_runsSubMake; }
+    void setRemoteSlot(RemoteSlot *remoteSlot);
+    RemoteSlot *remoteSlot() const { return m_remoteSlot; }
+    void setSlot(int slot) { m_slot = slot; }
+    int slot() const { return m_slot; }
+    QString currentCommandLine() const;
+    qint64 currentCommandTime() const;
+    qint64 targetTime() const;
+    void abort();
     void waitForFinished();
     void cleanupTempFiles();
     void setBufferedOutput(bool b) { m_process.setBufferedOutput(b); }
+    void setLineBufferedOutput(bool b) { m_process.setLineBufferedOutput(b); }
+    void setOutputTarget(CommandExecutor *target);
+    void writeToStandardOutput(const QByteArray& data);
+    void writeToStandardError(const QByteArray& data);
+
+    struct TempFileStatistics
+    {
+        int count;
+        qint64 bytes;
+        qint64 nsecs;   // spent creating, writing and removing
+    };
+    static const TempFileStatistics &tempFileStatistics() { return m_tempFileStatistics; }
     bool isBufferedOutputSet() const { return m_process.isBufferedOutputSet(); }
 
 public slots:
@@ -62,20 +91,34 @@ signals:
 private slots:
     void onProcessError(Process::ProcessError error);
     void onProcessFinished(int exitCode, Process::ExitStatus exitStatus);
+    void onSubMakeFinished(int exitCode);
+    void onRemoteOutputReceived(const QByteArray &data, bool isStandardError);
+    void onRemoteCommandFinished(int exitCode, bool crashed);
 
 private:
     void finishExecution(bool commandFailed);
+    void traceCommand(int exitCode);
     void executeCurrentCommandLine();
+    bool canExecuteAsScript();
+    bool startsBatchFile(const QString &commandLine);
+    void executeCommandScript();
+    void writeErrorMessage(int exitCode);
     void createTempFiles();
+    QString createUniqueTempFileName(const QString &extension);
+    QFile *createTempFile(const QString &extension, const QByteArray &content, bool keep);
     void writeToChannel(const QByteArray& data, FILE *channel);
-    void writeToStandardOutput(const QByteArray& data);
-    void writeToStandardError(const QByteArray& data);
     bool isSimpleCommandLine(const QString &cmdLine);
+    bool isExecutableAvailable(const QString &commandLine);
+    bool canExecuteInShellWorker(const QString &commandLine);
+    QString findProgramForShell(const QString &program);
     bool exec_cd(const QString &commandLine);
+    void startRemoteCommand(const QString &commandLine);
+    QByteArray computeResultCacheKey() const;
 
 private:
-    static ulong        m_startUpTickCount;
+    static QAtomicInt   m_tempFileCounter;
     static QString      m_tempPath;
+    static TempFileStatistics m_tempFileStatistics;
     Process             m_process;
     DescriptionBlock*   m_pTarget;
 
@@ -86,10 +129,42 @@ private:
     };
 
     QList<TempFile>     m_tempFiles;
+
+    struct PreparedCommand
+    {
+        QString commandLine;    // unescaped command line
+        bool isShellComment;
+        bool isSimple;
+        bool canExecuteDirectly;
+        bool isSubMake;
+        QString subMakeWorkingDirectory;
+        QStringList subMakeArguments;
+    };
+
+    bool startSubMake(const PreparedCommand &prepared);
+
+    QVector<PreparedCommand> m_preparedCommands;
+    bool                m_prepared;
     int                 m_currentCommandIdx;
     QString             m_nextWorkingDir;
+    QString             m_workingDirectory;
+    SubMake*            m_subMake;
+    CommandExecutor*    m_outputTarget;
+    RemoteSlot*         m_remoteSlot;
+    bool                m_canRunRemotely;
+    bool                m_runsSubMake;
+    int                 m_slot;
+    int                 m_exitCode;
+    qint64              m_targetStartTime;
+    qint64              m_commandStartTime;
     bool                m_ignoreProcessErrors;
+    bool                m_executingScript;
+    bool                m_aborting;
     bool                m_active;
+    QByteArray          m_resultCacheKey;
+    QString             m_resultCacheOutput;
+    QHash<QString, QString> m_programCache;
+    QHash<QString, bool> m_executableCache;
 };
 
 } // namespace NMakeFile
@@ -0,0 +1,305 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "consolewriter.h"
+
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QCoreApplication>
+
+#include <errno.h>
+
+#ifdef Q_OS_WIN
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace NMakeFile {
+
+static const int batchSize = 64 * 1024;
+static const int maxQueuedBytes = 4 * 1024 * 1024;
+static const unsigned long flushInterval = 5;  // ms
+
+static QAtomicPointer<ConsoleWriter> theInstance;
+static QMutex instanceMutex;
+
+ConsoleWriter::ConsoleWriter()
+    : m_queuedBytes(0)
+    , m_writing(false)
+    , m_flushRequested(false)
+    , m_quit(false)
+    , m_statusLineChanged(false)
+    , m_statusLineLength(0)
+    , m_atLineStart(true)
+{
+    m_statistics.batches = 0;
+    m_statistics.bytes = 0;
+}
+
+ConsoleWriter *ConsoleWriter::instance()
+{
+    ConsoleWriter *writer = theInstance.loadAcquire();
+    if (writer)
+        return writer;
+
+    QMutexLocker locker(&instanceMutex);
+    writer = theInstance.load();
+    if (!writer) {
+        writer = new ConsoleWriter;
+        writer->start();
+        theInstance.storeRelease(writer);
+        qAddPostRoutine(shutDown);
+    }
+    return writer;
+}
+
+/**
+ * Writes everything that is still queued and stops the writer thread.
+ */
+void ConsoleWriter::shutDown()
+{
+    ConsoleWriter *writer = theInstance.fetchAndStoreOrdered(0);
+    if (!writer)
+        return;
+    writer->m_mutex.lock();
+    writer->m_quit = true;
+    writer->m_outputAvailable.wakeOne();
+    writer->m_mutex.unlock();
+    writer->wait();
+    delete writer;
+}
+
+/**
+ * Queues output that must be written without newline translation, e.g. the output of a job.
+ */
+void ConsoleWriter::write(FILE *stream, const char *data, size_t count)
+{
+    instance()->enqueue(stream, data, int(count), true);
+}
+
+/**
+ * Queues output of jom itself like echoed command lines and status messages.
+ */
+void ConsoleWriter::writeText(FILE *stream, const QByteArray &text)
+{
+    instance()->enqueue(stream, text.constData(), text.size(), false);
+}
+
+/**
+ * Blocks until all queued output has been written.
+ * Call this before writing to stdout or stderr directly.
+ */
+void ConsoleWriter::flush()
+{
+    ConsoleWriter *writer = theInstance.loadAcquire();
+    if (writer)
+        writer->waitUntilWritten();
+}
+
+/**
+ * Shows the line below the console output. An empty line removes the status line.
+ * The line must not contain line breaks and should fit into the console window.
+ */
+void ConsoleWriter::setStatusLine(const QByteArray &line)
+{
+    ConsoleWriter *writer = instance();
+    QMutexLocker locker(&writer->m_mutex);
+    if (writer->m_statusLine == line)
+        return;
+    writer->m_statusLine = line;
+    writer->m_statusLineChanged = true;
+    writer->m_outputAvailable.wakeOne();
+}
+
+bool ConsoleWriter::isConsole(FILE *stream)
+{
+#ifdef Q_OS_WIN
+    return _isatty(_fileno(stream)) != 0;
+#else
+    return isatty(fileno(stream)) != 0;
+#endif
+}
+
+ConsoleWriter::Statistics ConsoleWriter::statistics()
+{
+    Statistics result = { 0, 0 };
+    ConsoleWriter *writer = theInstance.loadAcquire();
+    if (writer) {
+        QMutexLocker locker(&writer->m_mutex);
+        result = writer->m_statistics;
+    }
+    return result;
+}
+
+void ConsoleWriter::enqueue(FILE *stream, const char *data, int count, bool binary)
+{
+    if (count <= 0)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    while (m_queuedBytes >= maxQueuedBytes && !m_quit)
+        m_outputWritten.wait(&m_mutex);
+
+    const bool wasEmpty = m_queue.isEmpty();
+    if (!wasEmpty && m_queue.last().stream == stream && m_queue.last().binary == binary) {
+        m_queue.last().data.append(data, count);
+    } else {
+        Entry entry;
+        entry.stream = stream;
+        entry.binary = binary;
+        entry.data = QByteArray(data, count);
+        m_queue.append(entry);
+    }
+    m_queuedBytes += count;
+
+    // The writer waits for the flush interval once it has seen the first entry.
+    if (wasEmpty || m_queuedBytes >= batchSize)
+        m_outputAvailable.wakeOne();
+}
+
+void ConsoleWriter::waitUntilWritten()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_queue.isEmpty() || m_statusLineChanged || m_writing) {
+        m_flushRequested = true;
+        m_outputAvailable.wakeOne();
+        m_outputWritten.wait(&m_mutex);
+    }
+}
+
+void ConsoleWriter::run()
+{
+    QMutexLocker locker(&m_mutex);
+    forever {
+        while (m_queue.isEmpty() && !m_statusLineChanged && !m_quit)
+            m_outputAvailable.wait(&m_mutex);
+        if (m_queue.isEmpty() && !m_statusLineChanged)
+            break;
+
+        // Give more output the chance to arrive before writing the batch.
+        if (!m_queue.isEmpty() && m_queuedBytes < batchSize && !m_flushRequested && !m_quit)
+            m_outputAvailable.wait(&m_mutex, flushInterval);
+
+        QVector<Entry> entries;
+        entries.swap(m_queue);
+        if (!entries.isEmpty()) {
+            m_statistics.batches++;
+            m_statistics.bytes += m_queuedBytes;
+        }
+        m_queuedBytes = 0;
+        m_flushRequested = false;
+        const QByteArray statusLine = m_statusLine;
+        m_statusLineChanged = false;
+        m_writing = true;
+        m_outputWritten.wakeAll();
+        locker.unlock();
+
+        eraseStatusLine();
+        foreach (const Entry &entry, entries) {
+            writeEntry(entry);
+            m_atLineStart = entry.data.endsWith('\n');
+        }
+
+        // Never draw the status line into an incomplete line of a job.
+        if (!statusLine.isEmpty() && m_atLineStart) {
+            Entry entry;
+            entry.stream = stderr;
+            entry.binary = false;
+            entry.data = statusLine;
+            writeEntry(entry);
+            m_statusLineLength = statusLine.length();
+        }
+        finishBatch();
+
+        locker.relock();
+        m_writing = false;
+        m_outputWritten.wakeAll();
+    }
+}
+
+void ConsoleWriter::eraseStatusLine()
+{
+    if (m_statusLineLength == 0)
+        return;
+    Entry entry;
+    entry.stream = stderr;
+    entry.binary = false;
+    entry.data = '\r' + QByteArray(m_statusLineLength, ' ') + '\r';
+    writeEntry(entry);
+    m_statusLineLength = 0;
+}
+
+/**
+ * Switches the stream between binary and text mode. The newline translation
+ * happens when the stream's buffer is written, so the buffer is flushed first.
+ */
+void ConsoleWriter::setBinaryMode(FILE *stream, bool binary)
+{
+#ifdef Q_OS_WIN
+    if (m_originalModes.contains(stream) == binary)
+        return;
+    fflush(stream);
+    if (binary)
+        m_originalModes.insert(stream, _setmode(_fileno(stream), _O_BINARY));
+    else
+        _setmode(_fileno(stream), m_originalModes.take(stream));
+#else
+    Q_UNUSED(stream);
+    Q_UNUSED(binary);
+#endif
+}
+
+/**
+ * Restores the modes of the streams and flushes them once for the whole batch.
+ */
+void ConsoleWriter::finishBatch()
+{
+    foreach (FILE *stream, m_originalModes.keys())
+        setBinaryMode(stream, false);
+    fflush(stdout);
+    fflush(stderr);
+}
+
+void ConsoleWriter::writeEntry(const Entry &entry)
+{
+    const char *str = entry.data.constData();
+    size_t count = entry.data.size();
+    setBinaryMode(entry.stream, entry.binary);
+    if (!fwrite(str, sizeof(char), count, entry.stream) && errno == ENOMEM) {
+        // The buffer was too big for writing. Write it in chunks.
+        const size_t chunkSize = 4096;
+        for (;;) {
+            size_t k = qMin(chunkSize, count);
+            fwrite(str, sizeof(char), k, entry.stream);
+            if (k >= count)
+                break;
+            str += k;
+            count -= k;
+        }
+    }
+}
+
+} // namespace NMakeFile
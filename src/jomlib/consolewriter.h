@@ -0,0 +1,109 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef CONSOLEWRITER_H
+#define CONSOLEWRITER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+#include <cstdio>
+
+namespace NMakeFile {
+
+/**
+ * Writes jom's console output in a thread of its own.
+ *
+ * Writes are queued in the order they were made and consecutive writes to the
+ * same stream are merged. The writer thread waits a few milliseconds for more
+ * output before it writes a batch, and flushes the streams once per batch.
+ * Writers wait if too much output is pending.
+ *
+ * A status line can be shown below the output on stderr. It is erased before
+ * each batch and drawn again only if the output ended with a complete line.
+ */
+class ConsoleWriter : public QThread
+{
+public:
+    static void write(FILE *stream, const char *data, size_t count);
+    static void writeText(FILE *stream, const QByteArray &text);
+    static void flush();
+    static void setStatusLine(const QByteArray &line);
+    static bool isConsole(FILE *stream);
+
+    struct Statistics
+    {
+        int batches;
+        qint64 bytes;
+    };
+    static Statistics statistics();
+
+private:
+    ConsoleWriter();
+    static ConsoleWriter *instance();
+    static void shutDown();
+
+    void enqueue(FILE *stream, const char *data, int count, bool binary);
+    void waitUntilWritten();
+    void run();
+
+    struct Entry
+    {
+        FILE *stream;
+        bool binary;
+        QByteArray data;
+    };
+
+    void writeEntry(const Entry &entry);
+    void setBinaryMode(FILE *stream, bool binary);
+    void finishBatch();
+    void eraseStatusLine();
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_outputAvailable;
+    QWaitCondition m_outputWritten;
+    QVector<Entry> m_queue;
+    int m_queuedBytes;
+    bool m_writing;
+    bool m_flushRequested;
+    bool m_quit;
+    Statistics m_statistics;
+    QByteArray m_statusLine;
+    bool m_statusLineChanged;
+
+    // Used by the writer thread only.
+    int m_statusLineLength;
+    bool m_atLineStart;
+    QHash<FILE *, int> m_originalModes;     // of the streams that are in binary mode
+};
+
+} // namespace NMakeFile
+
+#endif // CONSOLEWRITER_H
@@ -0,0 +1,69 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "counters.h"
+
+namespace NMakeFile {
+
+std::atomic<qint64> Counters::m_values[Counters::NumberOfCounters];
+
+const char *Counters::name(Counter counter)
+{
+    static const char * const names[NumberOfCounters] = {
+        "stat calls",
+        "stat cache hits",
+        "macro expansions",
+        "target lookups",
+        "processes started",
+        "shells avoided",
+        "output bytes buffered",
+        "job token waits"
+    };
+    return names[counter];
+}
+
+/**
+ * Returns one line per counter in the form "name: value".
+ */
+QByteArray Counters::dump()
+{
+    QByteArray result;
+    for (int i = 0; i < NumberOfCounters; ++i) {
+        const Counter counter = static_cast<Counter>(i);
+        result += name(counter);
+        result += ": ";
+        result += QByteArray::number(value(counter));
+        result += '\n';
+    }
+    return result;
+}
+
+void Counters::reset()
+{
+    for (int i = 0; i < NumberOfCounters; ++i)
+        m_values[i].store(0, std::memory_order_relaxed);
+}
+
+} // namespace NMakeFile
@@ -0,0 +1,79 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QtGlobal>
+
+#include <atomic>
+
+namespace NMakeFile {
+
+/**
+ * Event counters of jom's hot paths.
+ *
+ * Counting is always on. An increment is a relaxed atomic add, so the
+ * counters may be bumped from any thread. They are printed with /DEBUG
+ * and served by the status server while the build runs.
+ */
+class Counters
+{
+public:
+    enum Counter
+    {
+        StatCalls,
+        StatCacheHits,
+        MacroExpansions,
+        TargetLookups,
+        ProcessesStarted,
+        ShellsAvoided,
+        OutputBytesBuffered,
+        TokenWaits,
+        NumberOfCounters
+    };
+
+    static void increment(Counter counter, qint64 n = 1)
+    {
+        m_values[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    static qint64 value(Counter counter)
+    {
+        return m_values[counter].load(std::memory_order_relaxed);
+    }
+
+    static const char *name(Counter counter);
+    static QByteArray dump();
+    static void reset();
+
+private:
+    static std::atomic<qint64> m_values[NumberOfCounters];
+};
+
+} // namespace NMakeFile
+
+#endif // COUNTERS_H
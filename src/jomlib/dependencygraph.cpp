@@ -24,9 +24,13 @@
 ****************************************************************************/
 
 #include "dependencygraph.h"
+#include "buildhistory.h"
 #include "makefile.h"
 #include "options.h"
+#include "buildtrace.h"
+#include "consolewriter.h"
 #include "fastfileinfo.h"
+#include "profiler.h"
 
 #include <QFile>
 #include <QDebug>
@@ -36,7 +40,12 @@ namespace NMakeFile {
 
 DependencyGraph::DependencyGraph()
 :   m_root(0),
-    m_bDirtyLeaves(true)
+    m_bDirtyLeaves(true),
+    m_history(0),
+    m_targetCount(0),
+    m_remainingTargetCount(0),
+    m_remainingKnownDuration(0),
+    m_remainingUnknownDurationCount(0)
 {
 }
 
@@ -50,16 +59,36 @@ DependencyGraph::Node* DependencyGraph::createNode(DescriptionBlock* target, Nod
     Node* node = new Node;
     node->target = target;
     node->state = Node::UnknownState;
+    node->isCounted = !target->m_commands.isEmpty() || !target->m_inferenceRules.isEmpty();
+    node->expectedDuration = -1;
     if (parent) {
         addEdge(parent, node);
     }
 
+    if (node->isCounted) {
+        m_targetCount++;
+        m_remainingTargetCount++;
+        if (m_history)
+            node->expectedDuration = m_history->duration(BuildHistory::key(target));
+        if (node->expectedDuration >= 0)
+            m_remainingKnownDuration += node->expectedDuration;
+        else
+            m_remainingUnknownDurationCount++;
+    }
+
     m_nodeContainer[target] = node;
     return node;
 }
 
 void DependencyGraph::deleteNode(Node* node)
 {
+    if (node->isCounted) {
+        m_remainingTargetCount--;
+        if (node->expectedDuration >= 0)
+            m_remainingKnownDuration -= node->expectedDuration;
+        else
+            m_remainingUnknownDurationCount--;
+    }
     m_nodeContainer.remove(node->target);
     if (node == m_root) m_root = 0;
     delete node;
@@ -67,6 +96,8 @@ void DependencyGraph::deleteNode(Node* node)
 
 void DependencyGraph::build(DescriptionBlock* target)
 {
+    ProfileScope profileScope("build dependency graph");
+    TraceScope traceScope("build dependency graph");
     m_bDirtyLeaves = true;
     m_root = createNode(target, 0);
     QSet<Node *> seen;
@@ -102,11 +133,14 @@ void DependencyGraph::markParentsRecursivlyUnbuildable(Node *node)
 
 bool DependencyGraph::isTargetUpToDate(DescriptionBlock* target)
 {
+    CurrentDirectoryScope directoryScope(target->makefile()->workingDirectory());
     FastFileInfo fi(target->targetName());
     if (fi.exists()) {
         target->m_bFileExists = true;
         target->m_timeStamp = fi.lastModified();
     }
+    if (m_upToDateTargets.contains(target))
+        return true;
 
     bool isUpToDate;
     if (target->m_dependents.isEmpty()) {
@@ -186,6 +220,12 @@ void DependencyGraph::internalBuild(Node *node, QSet<Node *> &seen)
     if (c == seen.count())
         return;
 
+    if (m_upToDateTargets.contains(node->target)) {
+        m_leaves.append(node);
+        return;
+    }
+
+    CurrentDirectoryScope directoryScope(node->target->makefile()->workingDirectory());
     foreach (const QString& dependentName, node->target->m_dependents) {
         Makefile* const makefile = node->target->makefile();
         DescriptionBlock* dependent = makefile->target(dependentName);
@@ -198,6 +238,7 @@ void DependencyGraph::internalBuild(Node *node, QSet<Node *> &seen)
                 QByteArray msg = "Error: dependent '";
                 msg += dependentName.toLocal8Bit();
                 msg += "' does not exist.\n";
+                ConsoleWriter::flush();
                 fputs(msg.constData(), stderr);
                 exit(2);
             }
@@ -213,6 +254,16 @@ void DependencyGraph::internalBuild(Node *node, QSet<Node *> &seen)
         internalBuild(child, seen);
     }
 
+    foreach (DescriptionBlock *dependent, node->target->m_subMakeDependents) {
+        Node* child = m_nodeContainer.value(dependent);
+        if (child)
+            addEdge(node, child);
+        else
+            child = createNode(dependent, node);
+
+        internalBuild(child, seen);
+    }
+
     if (node->children.isEmpty())
         m_leaves.append(node);
 }
@@ -258,6 +309,10 @@ void DependencyGraph::clear()
     qDeleteAll(m_nodeContainer);
     m_nodeContainer.clear();
     m_leaves.clear();
+    m_targetCount = 0;
+    m_remainingTargetCount = 0;
+    m_remainingKnownDuration = 0;
+    m_remainingUnknownDurationCount = 0;
 }
 
 void DependencyGraph::addEdge(Node* parent, Node* child)
@@ -273,6 +328,15 @@ bool DependencyGraph::isEmpty() const
     return m_nodeContainer.isEmpty();
 }
 
+/**
+ * Returns the build time of the target in previous runs in milliseconds, or -1.
+ */
+qint64 DependencyGraph::expectedDuration(DescriptionBlock *target) const
+{
+    const Node *node = m_nodeContainer.value(target);
+    return node ? node->expectedDuration : -1;
+}
+
 void DependencyGraph::removeLeaf(DescriptionBlock* target)
 {
     Node* nodeToRemove = m_nodeContainer.value(target);
@@ -299,6 +363,7 @@ void DependencyGraph::removeLeaf(Node* node)
 
 DescriptionBlock *DependencyGraph::findAvailableTarget(bool ignoreTimeStamps)
 {
+    ProfileScope profileScope("find available target");
     if (m_leaves.isEmpty())
         return 0;
 
@@ -325,8 +390,10 @@ DescriptionBlock *DependencyGraph::findAvailableTarget(bool ignoreTimeStamps)
         makefileSet.insert(leaf->target->makefile());
         multiHash.insert(leaf->target->makefile(), leaf->target);
     }
-    foreach (Makefile *mf, makefileSet)
+    foreach (Makefile *mf, makefileSet) {
+        CurrentDirectoryScope directoryScope(mf->workingDirectory());
         mf->applyInferenceRules(multiHash.values(mf));
+    }
 
     // return the first leaf that is not currently executed
     foreach (Node *leaf, m_leaves) {
@@ -31,6 +31,7 @@
 
 namespace NMakeFile {
 
+class BuildHistory;
 class DescriptionBlock;
 
 class DependencyGraph
@@ -49,6 +50,14 @@ public:
     void dotDump();
     void clear();
 
+    void setUpToDateTargets(const QSet<DescriptionBlock *> &targets) { m_upToDateTargets = targets; }
+    void setBuildHistory(const BuildHistory *history) { m_history = history; }
+    int targetCount() const { return m_targetCount; }
+    int remainingTargetCount() const { return m_remainingTargetCount; }
+    qint64 remainingKnownDuration() const { return m_remainingKnownDuration; }
+    int remainingUnknownDurationCount() const { return m_remainingUnknownDurationCount; }
+    qint64 expectedDuration(DescriptionBlock *target) const;
+
 private:
     bool isTargetUpToDate(DescriptionBlock* target);
 
@@ -57,6 +66,8 @@ private:
         enum State {UnknownState, ExecutingState, Unbuildable};
 
         State state;
+        bool isCounted;
+        qint64 expectedDuration;    // ms, -1 if unknown
         DescriptionBlock* target;
         QList<Node*> children;
         QList<Node*> parents;
@@ -77,6 +88,14 @@ private:
     QHash<DescriptionBlock*, Node*> m_nodeContainer;
     QList<Node *> m_leaves;
     bool m_bDirtyLeaves;
+    QSet<DescriptionBlock *> m_upToDateTargets;     // their dependents aren't looked at
+
+    // Progress of the build. Only targets that might have commands are counted.
+    const BuildHistory *m_history;
+    int m_targetCount;
+    int m_remainingTargetCount;
+    qint64 m_remainingKnownDuration;
+    int m_remainingUnknownDurationCount;
 };
 
 } // namespace NMakeFile
@@ -24,10 +24,14 @@
 ****************************************************************************/
 
 #include "fastfileinfo.h"
+#include "counters.h"
+#include "profiler.h"
+#include "sharedstatcache.h"
 
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
 #include <QtCore/QHash>
+#include <QtCore/QSet>
 #include <windows.h>
 
 namespace NMakeFile {
@@ -53,19 +57,94 @@ static WIN32_FILE_ATTRIBUTE_DATA createInvalidFAD()
 }
 
 static QHash<QString, WIN32_FILE_ATTRIBUTE_DATA> fadHash;
+static QMultiHash<quint32, QString> fadHashKeysByPathHash;
+static QString fadBaseDirectory;
+static quint32 fadHashGeneration = 0;
+
+/**
+ * Relative file names are qualified with the base directory, if one is set.
+ * This keeps the cache entries of makefiles in different directories apart.
+ */
+static inline QString cacheKey(const QString &fileName)
+{
+    if (fadBaseDirectory.isEmpty() || QDir::isAbsolutePath(fileName))
+        return fileName;
+    return fadBaseDirectory + fileName;
+}
+
+static void clearPrivateCache()
+{
+    fadHash.clear();
+    fadHashKeysByPathHash.clear();
+}
+
+/**
+ * Inserts into the private cache. With a shared cache, the key is also recorded
+ * under the path hash of the shared cache, which is what its invalidation log contains.
+ */
+static void insertIntoPrivateCache(const QString &key, const WIN32_FILE_ATTRIBUTE_DATA &fad,
+                                   const QString &nativeFilePath, bool hasSharedCache)
+{
+    fadHash.insert(key, fad);
+    if (!hasSharedCache)
+        return;
+    const quint32 pathHash = SharedStatCache::pathHash(nativeFilePath);
+    if (!fadHashKeysByPathHash.contains(pathHash, key))
+        fadHashKeysByPathHash.insert(pathHash, key);
+}
+
+/**
+ * Another jom process has built targets. Drops the private entries of the
+ * paths that were invalidated since we last looked.
+ */
+static void dropInvalidatedEntries(const SharedStatCache *sharedCache, quint32 generation)
+{
+    QSet<quint32> pathHashes;
+    if (!sharedCache->invalidatedPathHashes(fadHashGeneration, generation, &pathHashes)) {
+        clearPrivateCache();
+        return;
+    }
+    foreach (quint32 pathHash, pathHashes) {
+        foreach (const QString &key, fadHashKeysByPathHash.values(pathHash))
+            fadHash.remove(key);
+        fadHashKeysByPathHash.remove(pathHash);
+    }
+}
 
 FastFileInfo::FastFileInfo(const QString &fileName)
 {
+    ProfileScope profileScope("file info");
     static const WIN32_FILE_ATTRIBUTE_DATA invalidFAD = createInvalidFAD();
-    *z(m_attributes) = fadHash.value(fileName, invalidFAD);
-    if (z(m_attributes)->dwFileAttributes != INVALID_FILE_ATTRIBUTES)
+    SharedStatCache *sharedCache = SharedStatCache::instance();
+    if (sharedCache) {
+        const quint32 generation = sharedCache->generation();
+        if (generation != fadHashGeneration) {
+            dropInvalidatedEntries(sharedCache, generation);
+            fadHashGeneration = generation;
+        }
+    }
+
+    const QString key = cacheKey(fileName);
+    *z(m_attributes) = fadHash.value(key, invalidFAD);
+    if (z(m_attributes)->dwFileAttributes != INVALID_FILE_ATTRIBUTES) {
+        Counters::increment(Counters::StatCacheHits);
         return;
+    }
 
     static const QString longPathPrefix = QStringLiteral("\\\\?\\");
     QString nativeFilePath = QDir::toNativeSeparators(QFileInfo(fileName).absoluteFilePath());
+    if (sharedCache && sharedCache->find(nativeFilePath, &m_attributes)) {
+        Counters::increment(Counters::StatCacheHits);
+        insertIntoPrivateCache(key, *z(m_attributes), nativeFilePath, true);
+        return;
+    }
+
+    const QString sharedCacheKey = nativeFilePath;
     if (!nativeFilePath.startsWith(longPathPrefix))
         nativeFilePath.prepend(longPathPrefix);
 
+    ProfileScope statScope("stat");
+    Counters::increment(Counters::StatCalls);
     if (!GetFileAttributesEx(reinterpret_cast<const TCHAR*>(nativeFilePath.utf16()),
                              GetFileExInfoStandard, &m_attributes))
     {
@@ -73,7 +152,9 @@ FastFileInfo::FastFileInfo(const QString &fileName)
         return;
     }
 
-    fadHash.insert(fileName, *z(m_attributes));
+    insertIntoPrivateCache(key, *z(m_attributes), sharedCacheKey, sharedCache != 0);
+    if (sharedCache)
+        sharedCache->insert(sharedCacheKey, m_attributes, fadHashGeneration);
 }
 
 bool FastFileInfo::exists() const
@@ -93,7 +174,123 @@ FileTime FastFileInfo::lastModified() const
 
 void FastFileInfo::clearCacheForFile(const QString &fileName)
 {
-    fadHash.remove(fileName);
+    fadHash.remove(cacheKey(fileName));
+    if (SharedStatCache *sharedCache = SharedStatCache::instance())
+        sharedCache->invalidate(QDir::toNativeSeparators(QFileInfo(fileName).absoluteFilePath()));
+}
+
+static QString normalizedFilePath(const QDir &currentDirectory, const QString &fileName)
+{
+    return QDir::toNativeSeparators(QDir::cleanPath(currentDirectory.absoluteFilePath(fileName))).toLower();
+}
+
+/**
+ * Removes the cache entries of the given files, no matter whether they were
+ * cached under a relative or an absolute name.
+ */
+void FastFileInfo::clearCacheForFiles(const QStringList &filePaths)
+{
+    const QDir currentDirectory = QDir::current();
+    SharedStatCache *sharedCache = SharedStatCache::instance();
+    QSet<QString> normalizedFilePaths;
+    foreach (const QString &filePath, filePaths) {
+        normalizedFilePaths.insert(normalizedFilePath(currentDirectory, filePath));
+        if (sharedCache)
+            sharedCache->invalidate(QDir::toNativeSeparators(currentDirectory.absoluteFilePath(filePath)));
+    }
+
+    QHash<QString, WIN32_FILE_ATTRIBUTE_DATA>::iterator it = fadHash.begin();
+    while (it != fadHash.end()) {
+        if (normalizedFilePaths.contains(normalizedFilePath(currentDirectory, it.key())))
+            it = fadHash.erase(it);
+        else
+            ++it;
+    }
+}
+
+/**
+ * Removes the cache entries of all files that are not below the directory.
+ */
+void FastFileInfo::clearCacheOutside(const QString &directory)
+{
+    QString prefix = QDir::toNativeSeparators(QDir::cleanPath(directory)).toLower();
+    if (!prefix.endsWith(QLatin1Char('\\')))
+        prefix.append(QLatin1Char('\\'));
+
+    const QDir currentDirectory = QDir::current();
+    QHash<QString, WIN32_FILE_ATTRIBUTE_DATA>::iterator it = fadHash.begin();
+    while (it != fadHash.end()) {
+        if (!normalizedFilePath(currentDirectory, it.key()).startsWith(prefix))
+            it = fadHash.erase(it);
+        else
+            ++it;
+    }
+
+    SharedStatCache *sharedCache = SharedStatCache::instance();
+    if (!sharedCache)
+        return;
+    const quint32 generation = sharedCache->generation();
+    if (generation != fadHashGeneration)
+        dropInvalidatedEntries(sharedCache, generation);
+
+    // Our private cache has already dropped what is invalidated here.
+    sharedCache->invalidateOutside(QDir::toNativeSeparators(QDir::cleanPath(directory)));
+    fadHashGeneration = sharedCache->generation();
+}
+
+void FastFileInfo::clearCache()
+{
+    clearPrivateCache();
+    if (SharedStatCache *sharedCache = SharedStatCache::instance())
+        sharedCache->invalidateAll();
+}
+
+/**
+ * Returns the absolute paths of all files that are in the cache.
+ */
+QStringList FastFileInfo::cachedFilePaths()
+{
+    const QDir currentDirectory = QDir::current();
+    QStringList result;
+    result.reserve(fadHash.count());
+    QHash<QString, WIN32_FILE_ATTRIBUTE_DATA>::const_iterator it = fadHash.constBegin();
+    for (; it != fadHash.constEnd(); ++it)
+        result.append(QDir::cleanPath(currentDirectory.absoluteFilePath(it.key())));
+    return result;
+}
+
+void FastFileInfo::setBaseDirectory(const QString &directory)
+{
+    fadBaseDirectory = QDir::toNativeSeparators(directory);
+    if (!fadBaseDirectory.isEmpty() && !fadBaseDirectory.endsWith(QLatin1Char('\\')))
+        fadBaseDirectory.append(QLatin1Char('\\'));
+}
+
+QString FastFileInfo::baseDirectory()
+{
+    return fadBaseDirectory;
+}
+
+CurrentDirectoryScope::CurrentDirectoryScope(const QString &directory)
+{
+    if (directory.isEmpty())
+        return;
+    m_previousBaseDirectory = FastFileInfo::baseDirectory();
+    FastFileInfo::setBaseDirectory(directory);
+    m_previousDirectory = QDir::currentPath();
+    if (m_previousDirectory == directory)
+        return;
+    if (!QDir::setCurrent(directory))
+        qWarning("Cannot change the current directory to %s.", qPrintable(directory));
+}
+
+CurrentDirectoryScope::~CurrentDirectoryScope()
+{
+    if (m_previousDirectory.isNull())
+        return;
+    if (QDir::currentPath() != m_previousDirectory)
+        QDir::setCurrent(m_previousDirectory);
+    fadBaseDirectory = m_previousBaseDirectory;
 }
 
 } // NMakeFile
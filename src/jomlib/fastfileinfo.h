@@ -27,6 +27,7 @@
 #define FASTFILEINFO_H
 
 #include "filetime.h"
+#include <QtCore/QStringList>
 
 namespace NMakeFile {
 
@@ -39,6 +40,12 @@ public:
     FileTime lastModified() const;
 
     static void clearCacheForFile(const QString &fileName);
+    static void clearCacheForFiles(const QStringList &filePaths);
+    static void clearCacheOutside(const QString &directory);
+    static void clearCache();
+    static QStringList cachedFilePaths();
+    static void setBaseDirectory(const QString &directory);
+    static QString baseDirectory();
 
     struct InternalType
     {
@@ -49,6 +56,21 @@ private:
     InternalType m_attributes;
 };
 
+/**
+ * Changes the current directory and the base directory of the FastFileInfo cache
+ * for the lifetime of this object. An empty directory leaves both untouched.
+ */
+class CurrentDirectoryScope
+{
+public:
+    CurrentDirectoryScope(const QString &directory);
+    ~CurrentDirectoryScope();
+
+private:
+    QString m_previousDirectory;
+    QString m_previousBaseDirectory;
+};
+
 } // NMakeFile
 
 #endif // FASTFILEINFO_H
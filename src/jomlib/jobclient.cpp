@@ -24,12 +24,19 @@
 ****************************************************************************/
 
 #include "jobclient.h"
+#include "buildtrace.h"
+#include "counters.h"
 #include "jobclientacquirehelper.h"
+#include "jobserver.h"
 #include "helperfunctions.h"
+#include "profiler.h"
 
-#include <QSystemSemaphore>
 #include <QThread>
 
+#ifdef Q_OS_WIN
+#include <qt_windows.h>
+#endif
+
 namespace NMakeFile {
 
 JobClient::JobClient(ProcessEnvironment *environment, QObject *parent)
@@ -39,17 +46,34 @@ JobClient::JobClient(ProcessEnvironment *environment, QObject *parent)
     , m_acquireThread(new QThread(this))
     , m_acquireHelper(0)
     , m_isAcquiring(false)
+    , m_localServer(0)
+    , m_localAcquisitionPending(false)
+    , m_pendingCount(0)
+    , m_reserve(0)
+    , m_demand(0)
+    , m_acquisitionStartTime(0)
+    , m_waitingTime(0)
+    , m_lastReserveChangeTime(0)
+    , m_idleTokenTime(0)
 {
+    m_timer.start();
 }
 
 JobClient::~JobClient()
 {
     if (isAcquiring())
         qWarning("JobClient destroyed while still acquiring.");
+    if (m_localAcquisitionPending)
+        m_localServer->removeWaitingClient(this);
+    if (m_semaphore)
+        setDemand(0);
     m_acquireThread->quit();
     m_acquireThread->wait(2500);
     delete m_acquireHelper;
-    delete m_semaphore;
+#ifdef Q_OS_WIN
+    if (m_semaphore)
+        CloseHandle(m_semaphore);
+#endif
 }
 
 bool JobClient::start()
@@ -57,53 +81,207 @@ bool JobClient::start()
     Q_ASSERT(!m_semaphore && !m_acquireHelper);
     Q_ASSERT(!m_acquireThread->isRunning());
 
-    const QString semaphoreKey = m_environment->value(QLatin1String("_JOMSRVKEY_"));
+    const QString semaphoreKey = m_environment->value(JobServer::environmentVariableName());
     if (semaphoreKey.isEmpty()) {
         setError(QLatin1String("Cannot determine jobserver name."));
         return false;
     }
-    m_semaphore = new QSystemSemaphore(semaphoreKey);
-    if (m_semaphore->error() != QSystemSemaphore::NoError) {
-        setError(m_semaphore->errorString());
+
+#ifdef Q_OS_WIN
+    m_semaphore = OpenSemaphoreW(SEMAPHORE_MODIFY_STATE | SYNCHRONIZE, FALSE,
+                                 reinterpret_cast<const wchar_t *>(semaphoreKey.utf16()));
+#endif
+    if (!m_semaphore) {
+        setError(QLatin1String("Cannot open semaphore ") + semaphoreKey + QLatin1String(": ")
+                 + qt_error_string());
         return false;
     }
 
+    m_localServer = JobServer::instance(semaphoreKey);
+    if (m_localServer) {
+        connect(m_localServer, &JobServer::sharingStarted, this, &JobClient::onSharingStarted);
+    } else {
+#ifdef Q_OS_WIN
+        // Tell the job server in the parent process that its tokens must be shared.
+        HANDLE hClientEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE,
+            reinterpret_cast<const wchar_t *>(JobServer::clientEventName(semaphoreKey).utf16()));
+        if (hClientEvent) {
+            SetEvent(hClientEvent);
+            CloseHandle(hClientEvent);
+        }
+#endif
+    }
+
     m_acquireHelper = new JobClientAcquireHelper(m_semaphore);
     m_acquireHelper->moveToThread(m_acquireThread);
     connect(this, &JobClient::startAcquisition, m_acquireHelper, &JobClientAcquireHelper::acquire);
     connect(m_acquireHelper, &JobClientAcquireHelper::acquired, this, &JobClient::onHelperAcquired);
-    m_acquireThread->start();
     return true;
 }
 
-void JobClient::asyncAcquire()
+/**
+ * Starts acquiring job tokens in the helper thread.
+ * The acquired() signal is emitted for the first token. Up to count - 1 further tokens,
+ * that are available without waiting, are put into the reserve.
+ */
+void JobClient::asyncAcquire(int count)
 {
     Q_ASSERT(m_semaphore);
     Q_ASSERT(m_acquireHelper);
-    Q_ASSERT(m_acquireThread->isRunning());
 
+    Counters::increment(Counters::TokenWaits);
     m_isAcquiring = true;
-    emit startAcquisition();
+    m_acquisitionStartTime = m_timer.nsecsElapsed();
+    if (m_localServer && !m_localServer->isShared()) {
+        // Take free tokens without the helper thread, or wait until a job of this process
+        // gives back its token.
+        int acquiredCount = 0;
+        while (acquiredCount < qMax(1, count) && m_acquireHelper->tryAcquire())
+            ++acquiredCount;
+        if (acquiredCount > 0) {
+            QMetaObject::invokeMethod(this, "onHelperAcquired", Qt::QueuedConnection,
+                                      Q_ARG(int, acquiredCount));
+        } else {
+            m_localAcquisitionPending = true;
+            m_pendingCount = qMax(1, count);
+            m_localServer->addWaitingClient(this);
+        }
+        return;
+    }
+    acquireInHelperThread(qMax(1, count));
+}
+
+/**
+ * Lets the helper thread wait for the semaphore.
+ * The thread is only started when it's needed for the first time.
+ */
+void JobClient::acquireInHelperThread(int count)
+{
+    if (!m_acquireThread->isRunning())
+        m_acquireThread->start();
+    emit startAcquisition(count);
+}
+
+/**
+ * Acquires a job token if one is available right now.
+ * Tokens from the reserve are handed out first.
+ * Returns true on success.
+ */
+bool JobClient::tryAcquire()
+{
+    ProfileScope profileScope("try to acquire job token");
+    if (m_reserve > 0) {
+        setReserve(m_reserve - 1);
+        return true;
+    }
+    return m_acquireHelper && m_acquireHelper->tryAcquire();
 }
 
-void JobClient::onHelperAcquired()
+void JobClient::onHelperAcquired(int count)
 {
     m_isAcquiring = false;
+    const qint64 waitingTime = m_timer.nsecsElapsed() - m_acquisitionStartTime;
+    m_waitingTime += waitingTime;
+    Profiler::addSample("wait for job token", waitingTime);
+    if (BuildTrace::isEnabled()) {
+        const qint64 now = BuildTrace::now();
+        BuildTrace::addEvent(QLatin1String("wait for job token"), "jom", 0,
+                             now - waitingTime, now);
+    }
+    setReserve(m_reserve + count - 1);
     emit acquired();
 }
 
+/**
+ * A job client in another process connected to our job server.
+ * A pending acquisition must now wait for the system semaphore.
+ */
+void JobClient::onSharingStarted()
+{
+    if (!m_localAcquisitionPending)
+        return;
+    m_localAcquisitionPending = false;
+    acquireInHelperThread(m_pendingCount);
+}
+
 bool JobClient::isAcquiring() const
 {
     return m_isAcquiring;
 }
 
+/**
+ * Gives back a job token.
+ * The token is kept in the reserve if there's demand for it.
+ */
 void JobClient::release()
 {
     Q_ASSERT(m_semaphore);
 
-    if (!m_semaphore->release())
-        qWarning("QSystemSemaphore::release failed: %s (%d)",
-                 qPrintable(m_semaphore->errorString()), m_semaphore->error());
+    if (m_localAcquisitionPending) {
+        // Hand the token directly to the pending acquisition.
+        m_localServer->removeWaitingClient(this);
+        receiveLocalToken();
+        return;
+    }
+
+    if (m_reserve < m_demand)
+        setReserve(m_reserve + 1);
+    else
+        releaseToServer();
+}
+
+/**
+ * Sets the number of job tokens that will be needed soon.
+ * Tokens in the reserve that exceed the demand are returned to the job server.
+ */
+void JobClient::setDemand(int demand)
+{
+    m_demand = demand;
+    while (m_reserve > m_demand) {
+        setReserve(m_reserve - 1);
+        releaseToServer();
+    }
+}
+
+/**
+ * Returns the accumulated time job tokens spent unused in the reserve,
+ * in nanoseconds per token.
+ */
+qint64 JobClient::idleTokenTime() const
+{
+    return m_idleTokenTime + m_reserve * (m_timer.nsecsElapsed() - m_lastReserveChangeTime);
+}
+
+void JobClient::setReserve(int reserve)
+{
+    const qint64 now = m_timer.nsecsElapsed();
+    m_idleTokenTime += m_reserve * (now - m_lastReserveChangeTime);
+    m_lastReserveChangeTime = now;
+    m_reserve = reserve;
+}
+
+void JobClient::releaseToServer()
+{
+    if (m_localServer && !m_localServer->isShared()) {
+        // Another job client of this process, e.g. of an in-process sub-make, may be waiting.
+        if (JobClient *client = m_localServer->takeWaitingClient()) {
+            client->receiveLocalToken();
+            return;
+        }
+    }
+#ifdef Q_OS_WIN
+    if (!ReleaseSemaphore(m_semaphore, 1, NULL))
+        qWarning("ReleaseSemaphore failed with error code %d.", GetLastError());
+#endif
+}
+
+/**
+ * Completes the pending acquisition with a token that a job of this process gave back.
+ */
+void JobClient::receiveLocalToken()
+{
+    m_localAcquisitionPending = false;
+    QMetaObject::invokeMethod(this, "onHelperAcquired", Qt::QueuedConnection, Q_ARG(int, 1));
 }
 
 QString JobClient::errorString() const
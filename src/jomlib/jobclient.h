@@ -27,16 +27,17 @@
 #define JOBCLIENT_H
 
 #include "processenvironment.h"
+#include <QElapsedTimer>
 #include <QObject>
 
 QT_BEGIN_NAMESPACE
-class QSystemSemaphore;
 class QThread;
 QT_END_NAMESPACE
 
 namespace NMakeFile {
 
 class JobClientAcquireHelper;
+class JobServer;
 
 class JobClient : public QObject
 {
@@ -46,27 +47,47 @@ public:
     ~JobClient();
 
     bool start();
-    void asyncAcquire();
+    void asyncAcquire(int count = 1);
+    bool tryAcquire();
     bool isAcquiring() const;
     void release();
+    void setDemand(int demand);
     QString errorString() const;
 
+    qint64 waitingTime() const { return m_waitingTime; }
+    qint64 idleTokenTime() const;
+
 signals:
-    void startAcquisition();
+    void startAcquisition(int count);
     void acquired();
 
 private slots:
-    void onHelperAcquired();
+    void onHelperAcquired(int count);
+    void onSharingStarted();
 
 private:
     void setError(const QString &errorMessage);
+    void setReserve(int reserve);
+    void releaseToServer();
+    void acquireInHelperThread(int count);
+    void receiveLocalToken();
 
     ProcessEnvironment *m_environment;
     QString m_errorString;
-    QSystemSemaphore *m_semaphore;
+    Qt::HANDLE m_semaphore;
     QThread *m_acquireThread;
     JobClientAcquireHelper *m_acquireHelper;
     bool m_isAcquiring;
+    JobServer *m_localServer;
+    bool m_localAcquisitionPending;
+    int m_pendingCount;
+    int m_reserve;
+    int m_demand;
+    QElapsedTimer m_timer;
+    qint64 m_acquisitionStartTime;
+    qint64 m_waitingTime;
+    qint64 m_lastReserveChangeTime;
+    qint64 m_idleTokenTime;
 };
 
 } // namespace NMakeFile
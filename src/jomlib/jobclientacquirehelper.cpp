@@ -25,21 +25,46 @@
 
 #include "jobclientacquirehelper.h"
 
+#ifdef Q_OS_WIN
+#include <qt_windows.h>
+#endif
+
 namespace NMakeFile {
 
-JobClientAcquireHelper::JobClientAcquireHelper(QSystemSemaphore *semaphore)
+JobClientAcquireHelper::JobClientAcquireHelper(Qt::HANDLE semaphore)
     : m_semaphore(semaphore)
 {
 }
 
-void JobClientAcquireHelper::acquire()
+/**
+ * Acquires a job token if one is available right now.
+ * This function may be called from any thread.
+ */
+bool JobClientAcquireHelper::tryAcquire()
+{
+#ifdef Q_OS_WIN
+    return WaitForSingleObject(m_semaphore, 0) == WAIT_OBJECT_0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Blocks until one job token is acquired.
+ * Then takes up to count - 1 additional tokens that are available without blocking.
+ */
+void JobClientAcquireHelper::acquire(int count)
 {
-    if (!m_semaphore->acquire()) {
-        qWarning("QSystemSemaphore::acquire failed: %s (%d)",
-                 qPrintable(m_semaphore->errorString()), m_semaphore->error());
+#ifdef Q_OS_WIN
+    if (WaitForSingleObject(m_semaphore, INFINITE) != WAIT_OBJECT_0) {
+        qWarning("WaitForSingleObject failed with error code %d.", GetLastError());
         return;
     }
-    emit acquired();
+#endif
+    int acquiredCount = 1;
+    while (acquiredCount < count && tryAcquire())
+        ++acquiredCount;
+    emit acquired(acquiredCount);
 }
 
 } // namespace NMakeFile
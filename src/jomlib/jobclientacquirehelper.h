@@ -27,7 +27,6 @@
 #define JOBCLIENTACQUIRETHREAD_H
 
 #include <QObject>
-#include <QSystemSemaphore>
 
 namespace NMakeFile {
 
@@ -35,16 +34,18 @@ class JobClientAcquireHelper : public QObject
 {
     Q_OBJECT
 public:
-    explicit JobClientAcquireHelper(QSystemSemaphore *semaphore);
+    explicit JobClientAcquireHelper(Qt::HANDLE semaphore);
+
+    bool tryAcquire();
 
 public slots:
-    void acquire();
+    void acquire(int count);
 
 signals:
-    void acquired();
+    void acquired(int count);
 
 private:
-    QSystemSemaphore *m_semaphore;
+    Qt::HANDLE m_semaphore;
 };
 
 } // namespace NMakeFile
@@ -28,19 +28,63 @@
 #include "helperfunctions.h"
 #include <QByteArray>
 #include <QCoreApplication>
-#include <QSystemSemaphore>
+
+#ifdef Q_OS_WIN
+#include <QWinEventNotifier>
+#include <qt_windows.h>
+#endif
 
 namespace NMakeFile {
 
+JobServer *JobServer::m_instance = 0;
+
 JobServer::JobServer(ProcessEnvironment *environment)
     : m_semaphore(0)
     , m_environment(environment)
+    , m_clientEvent(0)
+    , m_clientEventNotifier(0)
+    , m_shared(true)
 {
 }
 
 JobServer::~JobServer()
 {
-    delete m_semaphore;
+    if (m_instance == this)
+        m_instance = 0;
+#ifdef Q_OS_WIN
+    delete m_clientEventNotifier;
+    if (m_clientEvent)
+        CloseHandle(m_clientEvent);
+    if (m_semaphore)
+        CloseHandle(m_semaphore);
+#endif
+}
+
+/**
+ * Returns the job server of this process that has the given key,
+ * or 0 if the job server lives in another process.
+ */
+JobServer *JobServer::instance(const QString &key)
+{
+    return (m_instance && m_instance->m_key == key) ? m_instance : 0;
+}
+
+/**
+ * Returns the name of the environment variable that holds the name of the semaphore
+ * with the job tokens.
+ */
+QString JobServer::environmentVariableName()
+{
+    return QLatin1String("_JOMSEMAPHORE_");
+}
+
+/**
+ * Returns the name of the event that job clients in other processes signal
+ * to make the job server share its job tokens.
+ */
+QString JobServer::clientEventName(const QString &key)
+{
+    return key + QLatin1String("-client");
 }
 
 bool JobServer::start(int maxNumberOfJobs)
@@ -52,16 +96,79 @@ bool JobServer::start(int maxNumberOfJobs)
     const QString semaphoreKey = QLatin1String("jomsrv-")
             + QString::number(QCoreApplication::applicationPid()) + QLatin1Char('-')
             + QString::number(randomId);
-    m_semaphore = new QSystemSemaphore(semaphoreKey, maxNumberOfJobs - 1, QSystemSemaphore::Create);
-    if (m_semaphore->error() != QSystemSemaphore::NoError) {
-        setError(m_semaphore->errorString());
+
+#ifdef Q_OS_WIN
+    // As long as no other jom process is connected, a job token that one of our jobs
+    // gives back is handed directly to a waiting acquisition of this process.
+    // The first client from another process signals the client event.
+    m_clientEvent = CreateEventW(NULL, FALSE, FALSE,
+        reinterpret_cast<const wchar_t *>(clientEventName(semaphoreKey).utf16()));
+    if (m_clientEvent) {
+        m_shared = false;
+        m_clientEventNotifier = new QWinEventNotifier(m_clientEvent);
+        connect(m_clientEventNotifier, &QWinEventNotifier::activated,
+                this, &JobServer::startSharing);
+    }
+
+    // All free tokens are always in the semaphore, where every client can take them.
+    m_semaphore = CreateSemaphoreW(NULL, maxNumberOfJobs - 1, MAXLONG,
+        reinterpret_cast<const wchar_t *>(semaphoreKey.utf16()));
+    if (m_semaphore && GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(m_semaphore);
+        m_semaphore = 0;
+        SetLastError(ERROR_ALREADY_EXISTS);
+    }
+    if (!m_semaphore) {
+        setError(QLatin1String("Cannot create semaphore ") + semaphoreKey + QLatin1String(": ")
+                 + qt_error_string());
         return false;
     }
-    m_environment->insert(QLatin1String("_JOMSRVKEY_"), semaphoreKey);
+#else
+    setError(QLatin1String("Job servers are not supported on this platform."));
+    return false;
+#endif
+    m_key = semaphoreKey;
+    m_instance = this;
+    m_environment->insert(environmentVariableName(), semaphoreKey);
     m_environment->insert(QLatin1String("_JOMJOBCOUNT_"), QString::number(maxNumberOfJobs));
     return true;
 }
 
+void JobServer::startSharing()
+{
+    if (m_shared)
+        return;
+    m_shared = true;
+    m_waitingClients.clear();
+#ifdef Q_OS_WIN
+    m_clientEventNotifier->setEnabled(false);
+#endif
+    emit sharingStarted();
+}
+
+/**
+ * Registers a job client of this process that waits for a job token while the
+ * job server is not shared. The next token that a client gives back is handed to it.
+ */
+void JobServer::addWaitingClient(JobClient *client)
+{
+    Q_ASSERT(!m_shared);
+    m_waitingClients.append(client);
+}
+
+void JobServer::removeWaitingClient(JobClient *client)
+{
+    m_waitingClients.removeOne(client);
+}
+
+/**
+ * Returns the client that waits longest for a job token, or 0 if no client is waiting.
+ */
+JobClient *JobServer::takeWaitingClient()
+{
+    return m_waitingClients.isEmpty() ? 0 : m_waitingClients.takeFirst();
+}
+
 QString JobServer::errorString() const
 {
     return m_errorString;
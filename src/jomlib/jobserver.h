@@ -27,15 +27,20 @@
 #define JOBSERVER_H
 
 #include "processenvironment.h"
+#include <QList>
+#include <QObject>
 
 QT_BEGIN_NAMESPACE
-class QSystemSemaphore;
+class QWinEventNotifier;
 QT_END_NAMESPACE
 
 namespace NMakeFile {
 
-class JobServer
+class JobClient;
+
+class JobServer : public QObject
 {
+    Q_OBJECT
 public:
     JobServer(ProcessEnvironment *environment);
     ~JobServer();
@@ -43,12 +48,33 @@ public:
     bool start(int maxNumberOfJobs);
     QString errorString() const;
 
+    static JobServer *instance(const QString &key);
+    static QString clientEventName(const QString &key);
+    static QString environmentVariableName();
+
+    bool isShared() const { return m_shared; }
+    void addWaitingClient(JobClient *client);
+    void removeWaitingClient(JobClient *client);
+    JobClient *takeWaitingClient();
+
+signals:
+    void sharingStarted();
+
+private slots:
+    void startSharing();
+
 private:
     void setError(const QString &errorMessage);
 
+    static JobServer *m_instance;
     QString m_errorString;
-    QSystemSemaphore *m_semaphore;
+    QString m_key;
+    Qt::HANDLE m_semaphore;
     ProcessEnvironment *m_environment;
+    Qt::HANDLE m_clientEvent;
+    QWinEventNotifier *m_clientEventNotifier;
+    QList<JobClient *> m_waitingClients;
+    bool m_shared;
 };
 
 } // namespace NMakeFile
@@ -1,7 +1,7 @@
 TEMPLATE = lib
 TARGET = jomlib
 DESTDIR = ../../lib
-QT = core
+QT = core network
 CONFIG += qt staticlib debug_and_release build_all
 DEFINES += _CRT_SECURE_NO_WARNINGS
 DEFINES += QT_NO_CAST_FROM_ASCII QT_NO_CAST_TO_ASCII
@@ -62,6 +62,8 @@ win32-* {
 }
 
 HEADERS +=  \
+    buildhistory.h \
+    buildtrace.h \
     fastfileinfo.h \
     filetime.h \
     helperfunctions.h \
@@ -73,17 +75,28 @@ HEADERS +=  \
     exception.h \
     dependencygraph.h \
     options.h \
+    outputbuffer.h \
     parser.h \
     preprocessor.h \
+    profiler.h \
     ppexprparser.h \
     targetexecutor.h \
     commandexecutor.h \
+    consolewriter.h \
+    counters.h \
     jomprocess.h \
     processenvironment.h \
     jobclient.h \
-    jobclientacquirehelper.h
+    jobclientacquirehelper.h \
+    remoteworker.h \
+    resultcache.h \
+    sharedstatcache.h \
+    spscqueue.h \
+    submake.h
 
 SOURCES += \
+    buildhistory.cpp \
+    buildtrace.cpp \
     fastfileinfo.cpp \
     filetime.cpp \
     helperfunctions.cpp \
@@ -95,14 +108,22 @@ SOURCES += \
     exception.cpp \
     dependencygraph.cpp \
     options.cpp \
+    outputbuffer.cpp \
     parser.cpp \
     preprocessor.cpp \
+    profiler.cpp \
     ppexpr_grammar.cpp \
     ppexprparser.cpp \
     targetexecutor.cpp \
     commandexecutor.cpp \
+    consolewriter.cpp \
+    counters.cpp \
     jobclient.cpp \
-    jobclientacquirehelper.cpp
+    jobclientacquirehelper.cpp \
+    remoteworker.cpp \
+    resultcache.cpp \
+    sharedstatcache.cpp \
+    submake.cpp
 
 OTHER_FILES += \
     ppexpr.g \
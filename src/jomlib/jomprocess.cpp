@@ -27,13 +27,16 @@
 #include <cstdlib>
 
 #include "jomprocess.h"
+#include "consolewriter.h"
+#include "counters.h"
 #include "helperfunctions.h"
 #include "iocompletionport.h"
+#include "outputbuffer.h"
+#include "profiler.h"
 
 #include <QByteArray>
 #include <QEventLoop>
 #include <QDir>
-#include <QElapsedTimer>
 #include <QMap>
 #include <QMetaType>
 #include <QMutex>
@@ -52,8 +55,6 @@
 
 namespace NMakeFile {
 
-Q_GLOBAL_STATIC(QElapsedTimer, runtime)
-
 struct Pipe
 {
     Pipe()
@@ -84,16 +85,7 @@ static void safelyCloseHandle(HANDLE &h)
     }
 }
 
-struct TimeStampedBuffer
-{
-    TimeStampedBuffer(const qint64 t, const QByteArray &b)
-        : timestamp(t), buffer(b)
-    {
-    }
-
-    qint64 timestamp;
-    QByteArray buffer;
-};
+static bool startAsyncRead(Pipe *pipe, QByteArray &intermediateOutputBuffer);
 
 class ProcessPrivate;
 
@@ -102,13 +94,84 @@ class OutputChannel : public IoCompletionPortObserver
 public:
     bool startRead();
     void completionPortNotified(DWORD numberOfBytes, DWORD errorCode);
+    void writeOutput(const char *data, size_t count);
+    void writeCompleteLines(const char *data, size_t count);
+    void flushIncompleteLine();
+    void writeThrough(const char *data, size_t count);
 
     ProcessPrivate *d;
     Pipe *pipe;
     FILE *stream;
+    OutputBuffer::Channel channel;
     QByteArray intermediateOutputBuffer;
-    QList<TimeStampedBuffer> buffers;
-    QMutex outputBufferLock;
+    QByteArray incompleteLine;
+};
+
+class ShellWorker;
+
+/**
+ * Reads the output of a shell worker and forwards it to the output channel
+ * of the owning process until the sentinel line is seen.
+ */
+class ShellOutputChannel : public IoCompletionPortObserver
+{
+public:
+    ShellOutputChannel()
+        : skipOutput(true), sentinelSeen(false), readPending(false)
+    {
+    }
+
+    void completionPortNotified(DWORD numberOfBytes, DWORD errorCode);
+    bool startRead();
+    void processOutput(const char *data, int count);
+    void forwardOutput(int count);
+
+    ShellWorker *worker;
+    OutputChannel *sink;
+    Pipe pipe;
+    QByteArray intermediateOutputBuffer;
+    QByteArray pendingOutput;
+    bool skipOutput;            // true until the sentinel of the startup handshake arrived
+    bool sentinelSeen;
+    QByteArray sentinelPayload;
+    bool readPending;           // guarded by the worker's mutex
+};
+
+/**
+ * A long-lived shell that receives command lines on its stdin.
+ * After each command the shell echoes a sentinel line with the exit code
+ * to stdout and another sentinel line to stderr.
+ */
+class ShellWorker
+{
+public:
+    ShellWorker(ProcessPrivate *process)
+        : d(process),
+          hProcess(INVALID_HANDLE_VALUE),
+          hProcessThread(INVALID_HANDLE_VALUE),
+          retired(false)
+    {
+        stdoutChannel.worker = this;
+        stderrChannel.worker = this;
+    }
+
+    ~ShellWorker()
+    {
+        safelyCloseHandle(hProcess);
+        safelyCloseHandle(hProcessThread);
+    }
+
+    ProcessPrivate *d;
+    HANDLE hProcess;
+    HANDLE hProcessThread;
+    Pipe stdinPipe;
+    ShellOutputChannel stdoutChannel;
+    ShellOutputChannel stderrChannel;
+    QByteArray sentinel;
+    QByteArray envBlock;
+    QMutex mutex;
+    QWinEventNotifier deathNotifier;
+    bool retired;               // guarded by mutex
 };
 
 class ProcessPrivate
@@ -118,17 +181,30 @@ public:
         : q(process),
           hProcess(INVALID_HANDLE_VALUE),
           hProcessThread(INVALID_HANDLE_VALUE),
-          exitCode(STILL_ACTIVE)
+          exitCode(STILL_ACTIVE),
+          shellWorker(0),
+          executingInShellWorker(false),
+          hJob(NULL),
+          outputTarget(0)
     {
         stdoutChannel.d = this;
         stdoutChannel.pipe = &stdoutPipe;
         stdoutChannel.stream = stdout;
+        stdoutChannel.channel = OutputBuffer::StandardOutput;
         stderrChannel.d = this;
         stderrChannel.pipe = &stderrPipe;
         stderrChannel.stream = stderr;
+        stderrChannel.channel = OutputBuffer::StandardError;
     }
 
     bool startRead();
+    bool assignToJobObject(HANDLE hProcess);
+    void forwardBufferedOutput();
+
+    OutputChannel &outputChannel(OutputBuffer::Channel channel)
+    {
+        return channel == OutputBuffer::StandardOutput ? stdoutChannel : stderrChannel;
+    }
 
     Process *q;
     HANDLE hProcess;
@@ -138,18 +214,36 @@ public:
     Pipe stdinPipe;     // we don't use it but some processes demand it (e.g. xcopy)
     OutputChannel stdoutChannel;
     OutputChannel stderrChannel;
+    OutputBuffer outputBuffer;
     QMutex bufferedOutputModeSwitchMutex;
     DWORD exitCode;
     QWinEventNotifier deathNotifier;
+    ShellWorker *shellWorker;
+    QList<ShellWorker *> retiredShellWorkers;   // waiting for their cancelled reads
+    bool executingInShellWorker;
+    HANDLE hJob;    // contains all processes started by us if killing process trees is enabled
+    ProcessPrivate *outputTarget;
 };
 
+bool ProcessPrivate::assignToJobObject(HANDLE hProcess)
+{
+    if (!hJob) {
+        hJob = CreateJobObject(NULL, NULL);
+        if (!hJob)
+            return false;
+    }
+    return AssignProcessToJobObject(hJob, hProcess);
+}
+
 Process::Process(QObject *parent)
     : QObject(parent),
       d(new ProcessPrivate(this)),
       m_state(NotRunning),
       m_exitCode(0),
       m_exitStatus(NormalExit),
-      m_bufferedOutput(true)
+      m_bufferedOutput(true),
+      m_lineBufferedOutput(false),
+      m_killProcessTree(false)
 {
     static bool staticsInitialized = false;
     if (!staticsInitialized) {
@@ -157,7 +251,6 @@ Process::Process(QObject *parent)
         qRegisterMetaType<ExitStatus>("Process::ExitStatus");
         qRegisterMetaType<ProcessError>("Process::ProcessError");
         qRegisterMetaType<ProcessState>("Process::ProcessState");
-        runtime()->start();
     }
     connect(&d->deathNotifier, &QWinEventNotifier::activated,
             this, &Process::tryToRetrieveExitCode);
@@ -170,7 +263,15 @@ Process::~Process()
 
     if (m_state == Running)
         qWarning("Process: destroyed while process still running.");
+    stopShellWorker();
     printBufferedOutput();
+    foreach (ShellWorker *worker, d->retiredShellWorkers) {
+        IoCompletionPort::instance()->unregisterObserver(&worker->stdoutChannel);
+        IoCompletionPort::instance()->unregisterObserver(&worker->stderrChannel);
+        delete worker;
+    }
+    if (d->hJob)
+        CloseHandle(d->hJob);
     delete d;
 }
 
@@ -188,18 +289,43 @@ void Process::setBufferedOutput(bool b)
     d->bufferedOutputModeSwitchMutex.unlock();
 }
 
+/**
+ * If line buffering is set, unbuffered output is only written in complete lines.
+ * Output of parallel jobs can't be mixed within one line then.
+ */
+void Process::setLineBufferedOutput(bool b)
+{
+    if (m_lineBufferedOutput == b)
+        return;
+
+    d->bufferedOutputModeSwitchMutex.lock();
+
+    m_lineBufferedOutput = b;
+    if (!m_lineBufferedOutput) {
+        d->stdoutChannel.flushIncompleteLine();
+        d->stderrChannel.flushIncompleteLine();
+    }
+
+    d->bufferedOutputModeSwitchMutex.unlock();
+}
+
+/**
+ * Sends the output to the given process instead of the console.
+ * Buffered output is passed on when it's printed. The target must outlive this process.
+ */
+void Process::setOutputTarget(Process *target)
+{
+    d->outputTarget = target ? target->d : 0;
+}
+
 void Process::writeToStdOutBuffer(const QByteArray &output)
 {
-    d->stdoutChannel.outputBufferLock.lock();
-    d->stdoutChannel.buffers.append(TimeStampedBuffer(runtime()->elapsed(), output));
-    d->stdoutChannel.outputBufferLock.unlock();
+    d->outputBuffer.appendMessage(OutputBuffer::StandardOutput, output);
 }
 
 void Process::writeToStdErrBuffer(const QByteArray &output)
 {
-    d->stderrChannel.outputBufferLock.lock();
-    d->stderrChannel.buffers.append(TimeStampedBuffer(runtime()->elapsed(), output));
-    d->stderrChannel.outputBufferLock.unlock();
+    d->outputBuffer.appendMessage(OutputBuffer::StandardError, output);
 }
 
 void Process::setWorkingDirectory(const QString &path)
@@ -346,6 +472,7 @@ static bool setupPipe(Pipe &pipe, SECURITY_ATTRIBUTES *sa, PipeType pt)
 
 void Process::start(const QString &commandLine)
 {
+    ProfileScope profileScope("start process");
     m_state = Starting;
 
     SECURITY_ATTRIBUTES sa = {0};
@@ -376,6 +503,8 @@ void Process::start(const QString &commandLine)
     si.dwFlags = STARTF_USESTDHANDLES;
 
     DWORD dwCreationFlags = CREATE_UNICODE_ENVIRONMENT;
+    if (m_killProcessTree)
+        dwCreationFlags |= CREATE_SUSPENDED;
     PROCESS_INFORMATION pi;
     wchar_t *strCommandLine = _wcsdup((const wchar_t*)commandLine.utf16());     // CreateProcess can modify this string
     const wchar_t *strWorkingDir = 0;
@@ -395,6 +524,12 @@ void Process::start(const QString &commandLine)
         return;
     }
 
+    if (m_killProcessTree) {
+        // If the job object cannot be used, kill() falls back to terminating the process only.
+        d->assignToJobObject(pi.hProcess);
+        ResumeThread(pi.hThread);
+    }
+
     // Close the pipe handles. This process doesn't need them anymore.
     safelyCloseHandle(d->stdinPipe.hRead);
     safelyCloseHandle(d->stdinPipe.hWrite);
@@ -406,6 +541,28 @@ void Process::start(const QString &commandLine)
     d->hProcess = pi.hProcess;
     d->hProcessThread = pi.hThread;
     m_state = Running;
+    Counters::increment(Counters::ProcessesStarted);
+}
+
+/**
+ * Terminates the running process.
+ * If killing process trees is enabled, all processes in the job object of this process
+ * are terminated. The finished signal is emitted as usual.
+ */
+void Process::kill()
+{
+    if (m_state != Running)
+        return;
+
+    if (d->hJob && TerminateJobObject(d->hJob, 2))
+        return;
+
+    if (d->executingInShellWorker) {
+        if (d->shellWorker)
+            TerminateProcess(d->shellWorker->hProcess, 2);
+    } else {
+        TerminateProcess(d->hProcess, 2);
+    }
 }
 
 void Process::tryToRetrieveExitCode()
@@ -432,10 +589,20 @@ void Process::onProcessFinished()
     safelyCloseHandle(d->stderrPipe.hRead);
     safelyCloseHandle(d->hProcess);
     safelyCloseHandle(d->hProcessThread);
+    const int exitCode = d->exitCode;
+    d->exitCode = STILL_ACTIVE;
+    reportFinished(exitCode);
+}
+
+void Process::reportFinished(int exitCode)
+{
+    d->bufferedOutputModeSwitchMutex.lock();
+    d->stdoutChannel.flushIncompleteLine();
+    d->stderrChannel.flushIncompleteLine();
+    d->bufferedOutputModeSwitchMutex.unlock();
     printBufferedOutput();
     m_state = NotRunning;
-    m_exitCode = d->exitCode;
-    d->exitCode = STILL_ACTIVE;
+    m_exitCode = exitCode;
 
     //### for now we assume a crash if exit code is less than -1 or the magic number
     const bool crashed = (m_exitCode == 0xf291 || m_exitCode < 0);
@@ -443,6 +610,236 @@ void Process::onProcessFinished()
     emit finished(m_exitCode, exitStatus);
 }
 
+static bool writeToPipe(HANDLE hPipe, const QByteArray &data)
+{
+    OVERLAPPED overlapped;
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!overlapped.hEvent)
+        return false;
+
+    DWORD bytesWritten = 0;
+    BOOL success = WriteFile(hPipe, data.constData(), data.size(), NULL, &overlapped);
+    if (success || GetLastError() == ERROR_IO_PENDING)
+        success = GetOverlappedResult(hPipe, &overlapped, &bytesWritten, TRUE);
+    CloseHandle(overlapped.hEvent);
+    return success && bytesWritten == static_cast<DWORD>(data.size());
+}
+
+static QByteArray sentinelCommands(const QByteArray &sentinel)
+{
+    return "echo " + sentinel + " %ERRORLEVEL%\r\n"
+           ">&2 echo " + sentinel + "\r\n";
+}
+
+/**
+ * Runs the command line in this process' shell worker.
+ * The shell worker is started on demand and restarted if the environment has changed.
+ * Returns false, if the shell worker cannot be used.
+ */
+bool Process::startInShellWorker(const QString &commandLine)
+{
+    if (d->shellWorker && d->shellWorker->envBlock != m_envBlock)
+        stopShellWorker();
+    if (!d->shellWorker && !startShellWorker())
+        return false;
+
+    ShellWorker *worker = d->shellWorker;
+    worker->mutex.lock();
+    worker->stdoutChannel.sentinelSeen = false;
+    worker->stderrChannel.sentinelSeen = false;
+    worker->mutex.unlock();
+
+    // "(call )" resets the error level that is not touched by most builtins.
+    const QString workingDirectory = m_workingDirectory.isEmpty()
+            ? QDir::currentPath() : m_workingDirectory;
+    QByteArray input = "cd /d \"" + QDir::toNativeSeparators(workingDirectory).toLocal8Bit()
+            + "\"\r\n(call )\r\n(" + commandLine.toLocal8Bit() + ") <NUL\r\n";
+    input += sentinelCommands(worker->sentinel);
+
+    m_state = Running;
+    d->executingInShellWorker = true;
+    if (!writeToPipe(worker->stdinPipe.hWrite, input)) {
+        d->executingInShellWorker = false;
+        m_state = NotRunning;
+        stopShellWorker();
+        return false;
+    }
+    return true;
+}
+
+bool Process::startShellWorker()
+{
+    ShellWorker *worker = new ShellWorker(d);
+    worker->envBlock = m_envBlock;
+    worker->stdoutChannel.sink = &d->stdoutChannel;
+    worker->stderrChannel.sink = &d->stderrChannel;
+
+    unsigned int randomValue;
+    if (rand_s(&randomValue) != 0)
+        randomValue = rand();
+    worker->sentinel = "jom-shell-worker-" + QByteArray::number(GetCurrentProcessId(), 16)
+            + '-' + QByteArray::number(randomValue, 16);
+
+    SECURITY_ATTRIBUTES sa = {0};
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = TRUE;
+
+    if (!setupPipe(worker->stdinPipe, &sa, InputPipe)
+        || !setupPipe(worker->stdoutChannel.pipe, &sa, OutputPipe)
+        || !setupPipe(worker->stderrChannel.pipe, &sa, OutputPipe))
+    {
+        delete worker;
+        return false;
+    }
+
+    IoCompletionPort::instance()->registerObserver(&worker->stdoutChannel,
+                                                   worker->stdoutChannel.pipe.hRead);
+    IoCompletionPort::instance()->registerObserver(&worker->stderrChannel,
+                                                   worker->stderrChannel.pipe.hRead);
+    d->shellWorker = worker;
+    if (!worker->stdoutChannel.startRead() || !worker->stderrChannel.startRead()) {
+        stopShellWorker();
+        return false;
+    }
+
+    STARTUPINFO si = {0};
+    si.cb = sizeof(si);
+    si.hStdInput = worker->stdinPipe.hRead;
+    si.hStdOutput = worker->stdoutChannel.pipe.hWrite;
+    si.hStdError = worker->stderrChannel.pipe.hWrite;
+    si.dwFlags = STARTF_USESTDHANDLES;
+
+    QString shellCmd = qGetEnvironmentVariable(L"ComSpec");
+    if (shellCmd.isEmpty())
+        shellCmd = QLatin1String("cmd.exe");
+    shellCmd += QLatin1String(" /D /Q");
+
+    DWORD dwCreationFlags = CREATE_UNICODE_ENVIRONMENT;
+    if (m_killProcessTree)
+        dwCreationFlags |= CREATE_SUSPENDED;
+    PROCESS_INFORMATION pi;
+    wchar_t *strCommandLine = _wcsdup((const wchar_t*)shellCmd.utf16());
+    void *envBlock = (m_envBlock.isEmpty() ? 0 : m_envBlock.data());
+    BOOL bResult = CreateProcess(NULL, strCommandLine,
+                                 0, 0, TRUE, dwCreationFlags, envBlock,
+                                 NULL, &si, &pi);
+    free(strCommandLine);
+    if (!bResult) {
+        stopShellWorker();
+        return false;
+    }
+    if (m_killProcessTree) {
+        d->assignToJobObject(pi.hProcess);
+        ResumeThread(pi.hThread);
+    }
+
+    safelyCloseHandle(worker->stdinPipe.hRead);
+    safelyCloseHandle(worker->stdoutChannel.pipe.hWrite);
+    safelyCloseHandle(worker->stderrChannel.pipe.hWrite);
+    worker->hProcess = pi.hProcess;
+    worker->hProcessThread = pi.hThread;
+    worker->deathNotifier.setHandle(pi.hProcess);
+    connect(&worker->deathNotifier, &QWinEventNotifier::activated,
+            this, &Process::onShellWorkerDied);
+    worker->deathNotifier.setEnabled(true);
+
+    // Everything the shell prints before the first sentinel, e.g. its banner, is skipped.
+    if (!writeToPipe(worker->stdinPipe.hWrite, sentinelCommands(worker->sentinel))) {
+        stopShellWorker();
+        return false;
+    }
+    return true;
+}
+
+void Process::stopShellWorker()
+{
+    ShellWorker *worker = d->shellWorker;
+    if (!worker)
+        return;
+
+    d->shellWorker = 0;
+    worker->deathNotifier.setEnabled(false);
+    worker->mutex.lock();
+    worker->retired = true;
+    worker->mutex.unlock();
+
+    // The shell exits when its stdin is closed.
+    safelyCloseHandle(worker->stdinPipe.hWrite);
+    if (d->executingInShellWorker && worker->hProcess != INVALID_HANDLE_VALUE)
+        TerminateProcess(worker->hProcess, 2);
+    safelyCloseHandle(worker->hProcess);
+    safelyCloseHandle(worker->hProcessThread);
+
+    // Closing the pipes cancels the pending reads that still refer to the worker.
+    // The worker is deleted when both channels have seen their last completion.
+    safelyCloseHandle(worker->stdoutChannel.pipe.hRead);
+    safelyCloseHandle(worker->stderrChannel.pipe.hRead);
+    d->retiredShellWorkers.append(worker);
+    deleteRetiredShellWorkers();
+}
+
+/**
+ * Deletes the retired shell workers that have no pending reads anymore.
+ */
+void Process::deleteRetiredShellWorkers()
+{
+    QList<ShellWorker *>::iterator it = d->retiredShellWorkers.begin();
+    while (it != d->retiredShellWorkers.end()) {
+        ShellWorker *worker = *it;
+        worker->mutex.lock();
+        const bool readsPending = worker->stdoutChannel.readPending
+                || worker->stderrChannel.readPending;
+        worker->mutex.unlock();
+        if (readsPending) {
+            ++it;
+            continue;
+        }
+
+        // Unregistering waits for a completion handler that might still be running.
+        IoCompletionPort::instance()->unregisterObserver(&worker->stdoutChannel);
+        IoCompletionPort::instance()->unregisterObserver(&worker->stderrChannel);
+        delete worker;
+        it = d->retiredShellWorkers.erase(it);
+    }
+}
+
+void Process::onShellWorkerSentinel()
+{
+    ShellWorker *worker = d->shellWorker;
+    if (!worker || !d->executingInShellWorker)
+        return;
+
+    worker->mutex.lock();
+    const bool commandFinished = worker->stdoutChannel.sentinelSeen
+            && worker->stderrChannel.sentinelSeen;
+    const int exitCode = worker->stdoutChannel.sentinelPayload.toInt();
+    worker->mutex.unlock();
+    if (!commandFinished)
+        return;
+
+    d->executingInShellWorker = false;
+    reportFinished(exitCode);
+}
+
+void Process::onShellWorkerDied()
+{
+    ShellWorker *worker = d->shellWorker;
+    if (!worker || WaitForSingleObject(worker->hProcess, 0) != WAIT_OBJECT_0)
+        return;
+
+    DWORD exitCode;
+    if (!GetExitCodeProcess(worker->hProcess, &exitCode))
+        exitCode = 2;
+
+    // The next command will start a new shell worker.
+    const bool commandInterrupted = d->executingInShellWorker;
+    d->executingInShellWorker = false;
+    stopShellWorker();
+    if (commandInterrupted)
+        reportFinished(exitCode);
+}
+
 bool Process::waitForFinished()
 {
     if (m_state != Running)
@@ -467,7 +864,7 @@ bool ProcessPrivate::startRead()
  * Starts the asynchronous read operation.
  * Returns true, if initiating the read operation was successful.
  */
-bool OutputChannel::startRead()
+static bool startAsyncRead(Pipe *pipe, QByteArray &intermediateOutputBuffer)
 {
     DWORD dwRead;
     BOOL bSuccess;
@@ -491,28 +888,9 @@ bool OutputChannel::startRead()
     return true;
 }
 
-static void fwrite_binary(FILE *stream, const char *str, size_t count)
-{
-    const int fd = _fileno(stream);
-    const int origMode = _setmode(fd, _O_BINARY);
-    if (fwrite(str, sizeof(char), count, stream)) {
-        // Write operation was successful.
-        fflush(stream);
-    } else if (errno == ENOMEM) {
-        // The buffer was too big for writing. Write it in chunks.
-        const size_t chunkSize = 4096;
-        for (;;) {
-            size_t k = qMin(chunkSize, count);
-            fwrite(str, sizeof(char), k, stream);
-            fflush(stream);
-            if (k >= count)
-                break;
-            str += k;
-            count -= k;
-        }
-    }
-    if (origMode != -1)
-        _setmode(fd, origMode);
+bool OutputChannel::startRead()
+{
+    return startAsyncRead(pipe, intermediateOutputBuffer);
 }
 
 /**
@@ -521,54 +899,198 @@ static void fwrite_binary(FILE *stream, const char *str, size_t count)
  */
 void OutputChannel::completionPortNotified(DWORD numberOfBytes, DWORD errorCode)
 {
-    if (numberOfBytes)  {
-        d->bufferedOutputModeSwitchMutex.lock();
+    if (numberOfBytes)
+        writeOutput(intermediateOutputBuffer.data(), numberOfBytes);
+
+    if (errorCode == ERROR_SUCCESS)
+        if (startRead())
+            return;
+
+    QMetaObject::invokeMethod(d->q, "tryToRetrieveExitCode", Qt::QueuedConnection);
+}
+
+void OutputChannel::writeOutput(const char *data, size_t count)
+{
+    d->bufferedOutputModeSwitchMutex.lock();
 
-        if (d->q->isBufferedOutputSet()) {
-            outputBufferLock.lock();
-            QByteArray data(intermediateOutputBuffer.data(), numberOfBytes);
-            buffers.append(TimeStampedBuffer(runtime()->elapsed(), data));
-            outputBufferLock.unlock();
+    if (d->q->isBufferedOutputSet()) {
+        d->outputBuffer.append(channel, data, int(count));
+    } else if (d->q->isLineBufferedOutputSet()) {
+        writeCompleteLines(data, count);
+    } else {
+        writeThrough(data, count);
+    }
+
+    d->bufferedOutputModeSwitchMutex.unlock();
+}
+
+/**
+ * Writes the output up to the last line break and keeps the rest until its line is complete.
+ * Overlong lines are written in pieces to keep the memory usage low.
+ */
+void OutputChannel::writeCompleteLines(const char *data, size_t count)
+{
+    static const int maxIncompleteLineSize = 64 * 1024;
+    const char *end = data + count;
+    const char *lineEnd = end;
+    while (lineEnd > data && lineEnd[-1] != '\n')
+        --lineEnd;
+
+    if (lineEnd > data) {
+        if (incompleteLine.isEmpty()) {
+            writeThrough(data, lineEnd - data);
         } else {
-            fwrite_binary(stream, intermediateOutputBuffer.data(), numberOfBytes);
+            incompleteLine.append(data, int(lineEnd - data));
+            flushIncompleteLine();
         }
+    }
+    incompleteLine.append(lineEnd, int(end - lineEnd));
+    if (incompleteLine.size() > maxIncompleteLineSize)
+        flushIncompleteLine();
+}
+
+void OutputChannel::flushIncompleteLine()
+{
+    if (incompleteLine.isEmpty())
+        return;
+    writeThrough(incompleteLine.constData(), incompleteLine.size());
+    incompleteLine.clear();
+}
+
+/**
+ * Writes unbuffered output to the console or to the output target.
+ */
+void OutputChannel::writeThrough(const char *data, size_t count)
+{
+    if (d->outputTarget)
+        d->outputTarget->outputChannel(channel).writeOutput(data, count);
+    else
+        ConsoleWriter::write(stream, data, count);
+}
 
-        d->bufferedOutputModeSwitchMutex.unlock();
+/**
+ * Is called whenever we receive output of the shell worker.
+ * Note: This function is running in the IOCP thread!
+ */
+void ShellOutputChannel::completionPortNotified(DWORD numberOfBytes, DWORD errorCode)
+{
+    worker->mutex.lock();
+    readPending = false;
+    const bool retired = worker->retired;
+    worker->mutex.unlock();
+
+    if (retired) {
+        QMetaObject::invokeMethod(worker->d->q, "deleteRetiredShellWorkers",
+                                  Qt::QueuedConnection);
+        return;
     }
 
+    if (numberOfBytes)
+        processOutput(intermediateOutputBuffer.constData(), numberOfBytes);
+
     if (errorCode == ERROR_SUCCESS)
         if (startRead())
             return;
 
-    QMetaObject::invokeMethod(d->q, "tryToRetrieveExitCode", Qt::QueuedConnection);
+    QMetaObject::invokeMethod(worker->d->q, "onShellWorkerDied", Qt::QueuedConnection);
 }
 
-void Process::printBufferedOutput()
+/**
+ * Starts the next asynchronous read and remembers that the worker must not be deleted
+ * before its completion has arrived. Retired workers don't read anymore.
+ */
+bool ShellOutputChannel::startRead()
 {
-    while (!d->stdoutChannel.buffers.isEmpty()
-        || !d->stderrChannel.buffers.isEmpty())
-    {
-        OutputChannel *channels[2] = { &d->stdoutChannel, &d->stderrChannel };
-
-        size_t i = 0;
-        if (channels[0]->buffers.isEmpty()
-            || (!channels[1]->buffers.isEmpty()
-                && channels[0]->buffers.first().timestamp > channels[1]->buffers.first().timestamp))
-        {
-            i = 1;
+    worker->mutex.lock();
+    if (worker->retired) {
+        worker->mutex.unlock();
+        return false;
+    }
+    readPending = true;
+    worker->mutex.unlock();
+    if (startAsyncRead(&pipe, intermediateOutputBuffer))
+        return true;
+
+    worker->mutex.lock();
+    readPending = false;
+    const bool retired = worker->retired;
+    worker->mutex.unlock();
+    if (retired) {
+        // The worker was retired while we were starting the read.
+        QMetaObject::invokeMethod(worker->d->q, "deleteRetiredShellWorkers",
+                                  Qt::QueuedConnection);
+    }
+    return false;
+}
+
+void ShellOutputChannel::processOutput(const char *data, int count)
+{
+    const QByteArray &sentinel = worker->sentinel;
+    pendingOutput.append(data, count);
+    for (;;) {
+        const int idx = pendingOutput.indexOf(sentinel);
+        if (idx < 0) {
+            // Hold back the beginning of a sentinel that might be split across reads.
+            int k = qMin(pendingOutput.size(), sentinel.size() - 1);
+            while (k > 0 && !pendingOutput.endsWith(sentinel.left(k)))
+                --k;
+            forwardOutput(pendingOutput.size() - k);
+            return;
         }
 
-        OutputChannel *const channel = channels[i];
-        channel->outputBufferLock.lock();
-        const QByteArray &ba = channel->buffers.first().buffer;
-        fwrite_binary(channel->stream, ba.data(), ba.count());
-        channel->buffers.removeFirst();
-        channel->outputBufferLock.unlock();
+        forwardOutput(idx);
+        const int eol = pendingOutput.indexOf('\n', sentinel.size());
+        if (eol < 0)
+            return;
+
+        const QByteArray payload = pendingOutput.mid(sentinel.size(),
+                                                     eol - sentinel.size()).trimmed();
+        pendingOutput.remove(0, eol + 1);
+        if (skipOutput) {
+            skipOutput = false;
+            continue;
+        }
+
+        worker->mutex.lock();
+        sentinelSeen = true;
+        sentinelPayload = payload;
+        worker->mutex.unlock();
+        QMetaObject::invokeMethod(worker->d->q, "onShellWorkerSentinel", Qt::QueuedConnection);
     }
 }
 
-} // namespace NMakeFile
+void ShellOutputChannel::forwardOutput(int count)
+{
+    if (count <= 0)
+        return;
+    if (!skipOutput)
+        sink->writeOutput(pendingOutput.constData(), count);
+    pendingOutput.remove(0, count);
+}
+
+void Process::printBufferedOutput()
+{
+    ProfileScope profileScope("print buffered output");
+    if (d->outputTarget)
+        d->forwardBufferedOutput();
+    else
+        d->outputBuffer.replay(stdout, stderr, ConsoleWriter::write);
+}
 
-QT_BEGIN_NAMESPACE
-Q_DECLARE_TYPEINFO(NMakeFile::TimeStampedBuffer, Q_MOVABLE_TYPE);
-QT_END_NAMESPACE
+/**
+ * Passes the buffered output on to the output target.
+ * The target's buffering mode is only switched by the main thread, which is running this.
+ */
+void ProcessPrivate::forwardBufferedOutput()
+{
+    OutputBuffer::Channel channel;
+    QByteArray data;
+    while (outputBuffer.takeNext(&channel, &data)) {
+        if (outputTarget->q->isBufferedOutputSet())
+            outputTarget->outputBuffer.appendMessage(channel, data);
+        else
+            outputTarget->outputChannel(channel).writeOutput(data.constData(), data.size());
+    }
+}
+
+} // namespace NMakeFile
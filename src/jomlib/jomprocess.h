@@ -36,6 +36,8 @@
 
 namespace NMakeFile {
 
+class OutputBuffer;
+
 class Process : public QProcess
 {
     Q_OBJECT
@@ -54,16 +56,27 @@ public:
     };
 
     Process(QObject *parent = 0);
+    ~Process();
     void setBufferedOutput(bool bufferedOutput);
+    void setKillProcessTree(bool b) { m_killProcessTree = b; }
     bool isBufferedOutputSet() const;
+    void setLineBufferedOutput(bool b);
+    bool isLineBufferedOutputSet() const { return m_lineBufferedOutput; }
     void setEnvironment(const ProcessEnvironment &e);
     ProcessEnvironment environment() const;
     bool isRunning() const;
     void start(const QString &commandLine);
+    bool startInShellWorker(const QString &) { return false; }
+    void kill();
+    void setOutputTarget(Process *target) { m_outputTarget = target; }
     void writeToStdOutBuffer(const QByteArray &output);
     void writeToStdErrBuffer(const QByteArray &output);
+    void printBufferedOutput();
     ExitStatus exitStatus() const;
 
+protected:
+    void setupChildProcess();
+
 signals:
     void error(Process::ProcessError);
     void finished(int, Process::ExitStatus);
@@ -71,6 +84,21 @@ signals:
 private slots:
     void forwardError(QProcess::ProcessError);
     void forwardFinished(int, QProcess::ExitStatus);
+    void onReadyReadStandardOutput();
+    void onReadyReadStandardError();
+
+private:
+    void updateProcessChannelMode();
+    void writeOutput(int channel, const QByteArray &output);
+    void writeThrough(int channel, const QByteArray &output);
+    void flushIncompleteLines();
+
+    bool m_killProcessTree;
+    bool m_bufferedOutput;
+    bool m_lineBufferedOutput;
+    OutputBuffer *m_outputBuffer;
+    Process *m_outputTarget;
+    QByteArray m_incompleteLines[2];
 };
 
 } // namespace NMakeFile
@@ -108,8 +136,13 @@ public:
 
     void setBufferedOutput(bool b);
     bool isBufferedOutputSet() const { return m_bufferedOutput; }
+    void setLineBufferedOutput(bool b);
+    bool isLineBufferedOutputSet() const { return m_lineBufferedOutput; }
+    void setKillProcessTree(bool b) { m_killProcessTree = b; }
+    void setOutputTarget(Process *target);
     void writeToStdOutBuffer(const QByteArray &output);
     void writeToStdErrBuffer(const QByteArray &output);
+    void printBufferedOutput();
     void setWorkingDirectory(const QString &path);
     const QString &workingDirectory() const { return m_workingDirectory; }
     void setEnvironment(const ProcessEnvironment &environment);
@@ -124,14 +157,21 @@ signals:
 
 public slots:
     void start(const QString &commandLine);
+    bool startInShellWorker(const QString &commandLine);
+    void kill();
     bool waitForFinished();
 
 private:
-    void printBufferedOutput();
+    void reportFinished(int exitCode);
+    bool startShellWorker();
+    void stopShellWorker();
 
 private slots:
     void tryToRetrieveExitCode();
     void onProcessFinished();
+    void onShellWorkerSentinel();
+    void onShellWorkerDied();
+    void deleteRetiredShellWorkers();
 
 private:
     class ProcessPrivate *d;
@@ -142,6 +182,8 @@ private:
     int m_exitCode;
     ExitStatus m_exitStatus;
     bool m_bufferedOutput;
+    bool m_lineBufferedOutput;
+    bool m_killProcessTree;
 
     friend class ProcessPrivate;
 };
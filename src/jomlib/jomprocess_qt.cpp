@@ -24,25 +24,69 @@
 ****************************************************************************/
 
 #include "jomprocess.h"
+#include "consolewriter.h"
+#include "counters.h"
+#include "outputbuffer.h"
+#include "profiler.h"
 #include <cstdio>
 
+#ifdef Q_OS_UNIX
+#include <signal.h>
+#include <unistd.h>
+#endif
+
 namespace NMakeFile {
 
 Process::Process(QObject *parent)
-    : QProcess(parent)
+    : QProcess(parent),
+      m_killProcessTree(false),
+      m_bufferedOutput(true),
+      m_lineBufferedOutput(false),
+      m_outputBuffer(new OutputBuffer),
+      m_outputTarget(0)
 {
     connect(this, SIGNAL(error(QProcess::ProcessError)), SLOT(forwardError(QProcess::ProcessError)));
     connect(this, SIGNAL(finished(int, QProcess::ExitStatus)), SLOT(forwardFinished(int, QProcess::ExitStatus)));
+    connect(this, SIGNAL(readyReadStandardOutput()), SLOT(onReadyReadStandardOutput()));
+    connect(this, SIGNAL(readyReadStandardError()), SLOT(onReadyReadStandardError()));
+}
+
+Process::~Process()
+{
+    printBufferedOutput();
+    delete m_outputBuffer;
 }
 
 void Process::setBufferedOutput(bool bufferedOutput)
 {
-    QProcess::setProcessChannelMode(bufferedOutput ? SeparateChannels : ForwardedChannels);
+    m_bufferedOutput = bufferedOutput;
+    updateProcessChannelMode();
+    if (!bufferedOutput)
+        printBufferedOutput();
 }
 
 bool Process::isBufferedOutputSet() const
 {
-    return QProcess::processChannelMode() == SeparateChannels;
+    return m_bufferedOutput;
+}
+
+/**
+ * If line buffering is set, unbuffered output is only written in complete lines.
+ * Output of parallel jobs can't be mixed within one line then.
+ */
+void Process::setLineBufferedOutput(bool b)
+{
+    m_lineBufferedOutput = b;
+    updateProcessChannelMode();
+    if (!b)
+        flushIncompleteLines();
+}
+
+void Process::updateProcessChannelMode()
+{
+    // We must read the output ourselves for buffering it or for splitting it into lines.
+    QProcess::setProcessChannelMode(m_bufferedOutput || m_lineBufferedOutput
+                                    ? SeparateChannels : ForwardedChannels);
 }
 
 void Process::setEnvironment(const ProcessEnvironment &e)
@@ -69,20 +113,122 @@ bool Process::isRunning() const
 
 void Process::start(const QString &commandLine)
 {
+    ProfileScope profileScope("start process");
     QProcess::start(commandLine);
-    QProcess::waitForStarted();
+    if (QProcess::waitForStarted())
+        Counters::increment(Counters::ProcessesStarted);
 }
 
 void Process::writeToStdOutBuffer(const QByteArray &output)
 {
-    fputs(output.data(), stdout);
-    fflush(stdout);
+    if (isBufferedOutputSet())
+        m_outputBuffer->appendMessage(OutputBuffer::StandardOutput, output);
+    else
+        writeThrough(OutputBuffer::StandardOutput, output);
 }
 
 void Process::writeToStdErrBuffer(const QByteArray &output)
 {
-    fputs(output.data(), stderr);
-    fflush(stderr);
+    if (isBufferedOutputSet())
+        m_outputBuffer->appendMessage(OutputBuffer::StandardError, output);
+    else
+        writeThrough(OutputBuffer::StandardError, output);
+}
+
+void Process::printBufferedOutput()
+{
+    ProfileScope profileScope("print buffered output");
+    if (!m_outputTarget) {
+        m_outputBuffer->replay(stdout, stderr, ConsoleWriter::write);
+        return;
+    }
+
+    OutputBuffer::Channel channel;
+    QByteArray data;
+    while (m_outputBuffer->takeNext(&channel, &data)) {
+        if (channel == OutputBuffer::StandardOutput)
+            m_outputTarget->writeToStdOutBuffer(data);
+        else
+            m_outputTarget->writeToStdErrBuffer(data);
+    }
+}
+
+void Process::onReadyReadStandardOutput()
+{
+    writeOutput(OutputBuffer::StandardOutput, readAllStandardOutput());
+}
+
+void Process::onReadyReadStandardError()
+{
+    writeOutput(OutputBuffer::StandardError, readAllStandardError());
+}
+
+/**
+ * Writes the output up to the last line break if line buffering is set
+ * and keeps the rest until its line is complete.
+ */
+void Process::writeOutput(int channel, const QByteArray &output)
+{
+    if (m_bufferedOutput) {
+        m_outputBuffer->append(OutputBuffer::Channel(channel), output.constData(), output.size());
+        return;
+    }
+
+    QByteArray &incompleteLine = m_incompleteLines[channel];
+    const int lineEnd = output.lastIndexOf('\n') + 1;
+    if (!m_lineBufferedOutput || lineEnd > 0) {
+        const int count = m_lineBufferedOutput ? lineEnd : output.size();
+        incompleteLine.append(output.constData(), count);
+        writeThrough(channel, incompleteLine);
+        incompleteLine = output.mid(count);
+    } else {
+        incompleteLine.append(output);
+    }
+}
+
+void Process::flushIncompleteLines()
+{
+    for (int channel = 0; channel < 2; ++channel) {
+        QByteArray &incompleteLine = m_incompleteLines[channel];
+        if (incompleteLine.isEmpty())
+            continue;
+        writeThrough(channel, incompleteLine);
+        incompleteLine.clear();
+    }
+}
+
+/**
+ * Writes unbuffered output to the console or to the output target.
+ */
+void Process::writeThrough(int channel, const QByteArray &output)
+{
+    if (m_outputTarget)
+        m_outputTarget->writeOutput(channel, output);
+    else
+        ConsoleWriter::write(channel == OutputBuffer::StandardOutput ? stdout : stderr,
+                             output.constData(), output.size());
+}
+
+/**
+ * Terminates the process.
+ * If killing process trees is enabled, the whole process group of the process is killed.
+ */
+void Process::kill()
+{
+#ifdef Q_OS_UNIX
+    if (m_killProcessTree && pid() > 0 && ::kill(-pid(), SIGKILL) == 0)
+        return;
+#endif
+    QProcess::kill();
+}
+
+void Process::setupChildProcess()
+{
+#ifdef Q_OS_UNIX
+    // Put the child into its own process group that can be killed as a whole.
+    if (m_killProcessTree)
+        ::setpgid(0, 0);
+#endif
 }
 
 Process::ExitStatus Process::exitStatus() const
@@ -108,6 +254,10 @@ void Process::forwardError(QProcess::ProcessError qe)
 
 void Process::forwardFinished(int exitCode, QProcess::ExitStatus status)
 {
+    onReadyReadStandardOutput();
+    onReadyReadStandardError();
+    flushIncompleteLines();
+    printBufferedOutput();
     emit finished(exitCode, static_cast<Process::ExitStatus>(status));
 }
 
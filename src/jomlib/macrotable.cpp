@@ -24,6 +24,7 @@
 ****************************************************************************/
 
 #include "macrotable.h"
+#include "counters.h"
 #include "exception.h"
 
 #include <QStringList>
@@ -224,6 +225,7 @@ QString MacroTable::expandMacros(const QString& str, bool inDependentsLine) cons
 
 QString MacroTable::expandMacros(const QString& str, bool inDependentsLine, QSet<QString>& usedMacros) const
 {
+    Counters::increment(Counters::MacroExpansions);
     QString ret;
     ret.reserve(str.count());
 
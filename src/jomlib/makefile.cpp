@@ -26,6 +26,7 @@
 #include "makefile.h"
 #include "exception.h"
 #include "options.h"
+#include "profiler.h"
 
 #include <QFileInfo>
 #include <QDebug>
@@ -114,6 +115,7 @@ void Command::evaluateModifiers()
 DescriptionBlock::DescriptionBlock(Makefile* mkfile)
 :   m_bFileExists(false),
     m_bVisitedByCycleCheck(false),
+    m_hasSiblingTargets(false),
     m_canAddCommands(ACSUnknown),
     m_pMakefile(mkfile)
 {
@@ -408,17 +410,81 @@ Makefile::Makefile(const QString &fileName)
     m_firstTarget(0),
     m_macroTable(0),
     m_options(0),
-    m_parallelExecutionDisabled(false)
+    m_parallelExecutionDisabled(false),
+    m_nonRecursive(false)
 {
 }
 
 Makefile::~Makefile()
 {
+    qDeleteAll(m_subMakefiles);
+    qDeleteAll(m_targets);
     delete m_macroTable;
     delete m_options;
     qDeleteAll(m_inferenceRules);
 }
 
+/**
+ * Returns a deep copy of this makefile and its sub-makefiles.
+ * Building modifies the targets of a makefile. Callers that want to build
+ * the same makefile more than once build copies of it.
+ */
+Makefile *Makefile::clone() const
+{
+    QHash<const DescriptionBlock *, DescriptionBlock *> clonedTargets;
+    Makefile *result = cloneImpl(clonedTargets);
+    result->remapSubMakeDependents(clonedTargets);
+    return result;
+}
+
+Makefile *Makefile::cloneImpl(QHash<const DescriptionBlock *, DescriptionBlock *> &clonedTargets) const
+{
+    Makefile *result = new Makefile(m_fileName);
+    result->m_dirPath = m_dirPath;
+    result->m_preciousTargets = m_preciousTargets;
+    if (m_macroTable)
+        result->m_macroTable = new MacroTable(*m_macroTable);
+    if (m_options)
+        result->m_options = new Options(*m_options);
+    result->m_parallelExecutionDisabled = m_parallelExecutionDisabled;
+    result->m_nonRecursive = m_nonRecursive;
+    result->m_workingDirectory = m_workingDirectory;
+    result->m_sourceFiles = m_sourceFiles;
+
+    QHash<const InferenceRule *, InferenceRule *> clonedRules;
+    foreach (InferenceRule *rule, m_inferenceRules) {
+        InferenceRule *clonedRule = new InferenceRule(*rule);
+        result->m_inferenceRules.append(clonedRule);
+        clonedRules.insert(rule, clonedRule);
+    }
+
+    QHash<QString, DescriptionBlock*>::const_iterator it = m_targets.constBegin();
+    for (; it != m_targets.constEnd(); ++it) {
+        DescriptionBlock *target = new DescriptionBlock(*it.value());
+        target->m_pMakefile = result;
+        for (int i = 0; i < target->m_inferenceRules.count(); ++i)
+            target->m_inferenceRules[i] = clonedRules.value(target->m_inferenceRules.at(i));
+        result->m_targets.insert(it.key(), target);
+        clonedTargets.insert(it.value(), target);
+    }
+    result->m_firstTarget = clonedTargets.value(m_firstTarget);
+
+    foreach (Makefile *subMakefile, m_subMakefiles)
+        result->m_subMakefiles.append(subMakefile->cloneImpl(clonedTargets));
+    return result;
+}
+
+void Makefile::remapSubMakeDependents(const QHash<const DescriptionBlock *, DescriptionBlock *> &clonedTargets)
+{
+    foreach (DescriptionBlock *target, m_targets) {
+        QList<DescriptionBlock *> &dependents = target->m_subMakeDependents;
+        for (int i = 0; i < dependents.count(); ++i)
+            dependents[i] = clonedTargets.value(dependents.at(i));
+    }
+    foreach (Makefile *subMakefile, m_subMakefiles)
+        subMakefile->remapSubMakeDependents(clonedTargets);
+}
+
 void Makefile::clear()
 {
     QHash<QString, DescriptionBlock*>::iterator it = m_targets.begin();
@@ -521,6 +587,7 @@ void Makefile::filterRulesByDependent(QVector<InferenceRule*>& rules, const QStr
 
 void Makefile::applyInferenceRules(QList<DescriptionBlock*> targets)
 {
+    ProfileScope profileScope("apply inference rules");
     foreach (DescriptionBlock *t, targets)
         applyInferenceRules(t);
 
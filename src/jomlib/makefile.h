@@ -26,6 +26,7 @@
 #ifndef MAKEFILE_H
 #define MAKEFILE_H
 
+#include "counters.h"
 #include "fastfileinfo.h"
 #include "macrotable.h"
 #include <QStringList>
@@ -100,10 +101,12 @@ public:
     Makefile* makefile() const { return m_pMakefile; }
 
     QStringList m_dependents;
+    QList<DescriptionBlock*> m_subMakeDependents;   // goal targets of merged sub-makefiles
     FileTime m_timeStamp;
     bool m_bFileExists;
     bool m_bVisitedByCycleCheck;
     QVector<InferenceRule*> m_inferenceRules;
+    bool m_hasSiblingTargets;   // the commands were given for several targets at once
 
     enum AddCommandsState { ACSUnknown, ACSEnabled, ACSDisabled };
     AddCommandsState m_canAddCommands;
@@ -115,6 +118,7 @@ private:
                                        bool dependentsForbidden);
 
 private:
+    friend class Makefile;
     QString m_targetName;
     Makefile* m_pMakefile;
 };
@@ -142,6 +146,7 @@ public:
     Makefile(const QString &fileName);
     ~Makefile();
 
+    Makefile *clone() const;
     void clear();
 
     void append(DescriptionBlock* target)
@@ -157,6 +162,7 @@ public:
 
     DescriptionBlock* target(const QString& name) const
     {
+        Counters::increment(Counters::TargetLookups);
         DescriptionBlock* result = 0;
         const QString lowerName = name.toLower();
         result = m_targets.value(lowerName, 0);
@@ -192,6 +198,23 @@ public:
     const Options* options() const { return m_options; }
     void setParallelExecutionDisabled(bool disabled) { m_parallelExecutionDisabled = disabled; }
     bool isParallelExecutionDisabled() const { return m_parallelExecutionDisabled; }
+    void setNonRecursive(bool nonRecursive) { m_nonRecursive = nonRecursive; }
+    bool isNonRecursive() const { return m_nonRecursive; }
+
+    /**
+     * The directory this makefile's targets are built in.
+     * An empty string means the current directory of the process.
+     */
+    const QString &workingDirectory() const { return m_workingDirectory; }
+    void setWorkingDirectory(const QString &directory) { m_workingDirectory = directory; }
+    void addSubMakefile(Makefile *makefile) { m_subMakefiles.append(makefile); }
+    const QList<Makefile *> &subMakefiles() const { return m_subMakefiles; }
+
+    /**
+     * The makefile and the files it included, as absolute paths.
+     */
+    const QStringList &sourceFiles() const { return m_sourceFiles; }
+    void setSourceFiles(const QStringList &fileNames) { m_sourceFiles = fileNames; }
 
     void setMacroTable(MacroTable *mt) { m_macroTable = mt; }
     const MacroTable* macroTable() const { return m_macroTable; }
@@ -206,6 +229,8 @@ public:
     void addPreciousTarget(const QString& targetName);
 
 private:
+    Makefile *cloneImpl(QHash<const DescriptionBlock *, DescriptionBlock *> &clonedTargets) const;
+    void remapSubMakeDependents(const QHash<const DescriptionBlock *, DescriptionBlock *> &clonedTargets);
     void filterRulesByDependent(QVector<InferenceRule*>& rules, const QString& targetName);
     QStringList findInferredDependents(InferenceRule* rule, const QStringList& dependents);
     void applyInferenceRules(DescriptionBlock* target);
@@ -224,6 +249,10 @@ private:
     QSet<const InferenceRule*> m_batchModeRules;
     QMultiHash<const InferenceRule*, DescriptionBlock*> m_batchModeTargets;
     bool m_parallelExecutionDisabled;
+    bool m_nonRecursive;
+    QString m_workingDirectory;
+    QList<Makefile *> m_subMakefiles;
+    QStringList m_sourceFiles;
 };
 
 } // namespace NMakeFile
@@ -24,12 +24,15 @@
 ****************************************************************************/
 
 #include "exception.h"
+#include "fastfileinfo.h"
 #include "makefilefactory.h"
 #include "macrotable.h"
 #include "makefile.h"
 #include "options.h"
 #include "parser.h"
 #include "preprocessor.h"
+#include "profiler.h"
+#include "submake.h"
 
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDir>
@@ -38,6 +41,7 @@ namespace NMakeFile {
 
 MakefileFactory::MakefileFactory()
 :   m_makefile(0),
+    m_globalOptions(&g_options),
     m_errorType(NoError)
 {
 }
@@ -95,6 +99,7 @@ static QString encloseInDoubleQuotesIfNeeded(const QString& path)
 
 bool MakefileFactory::apply(const QStringList& commandLineArguments, Options **outopt)
 {
+    ProfileScope profileScope("read makefile");
     if (m_makefile)
         clear();
 
@@ -105,7 +110,8 @@ bool MakefileFactory::apply(const QStringList& commandLineArguments, Options **o
     macroTable->setEnvironment(m_environment);
 
     QString filename;
-    if (!options->readCommandLineArguments(commandLineArguments, filename, m_activeTargets, *macroTable)) {
+    if (!options->readCommandLineArguments(commandLineArguments, filename, m_activeTargets,
+                                           *macroTable, m_globalOptions)) {
         m_errorType = CommandLineError;
         return false;
     }
@@ -164,7 +170,17 @@ bool MakefileFactory::apply(const QStringList& commandLineArguments, Options **o
         preprocessor.setMacroTable(macroTable);
         preprocessor.openFile(filename);
         Parser parser;
-        parser.apply(&preprocessor, m_makefile, m_activeTargets);
+        {
+            ProfileScope parseScope("parse");
+            parser.apply(&preprocessor, m_makefile, m_activeTargets);
+        }
+        m_makefile->setSourceFiles(preprocessor.openedFiles());
+
+        if (m_makefile->isNonRecursive()) {
+            m_makefile->setWorkingDirectory(QDir::currentPath());
+            QHash<QString, Makefile *> subMakefiles;
+            mergeSubMakefiles(m_makefile, subMakefiles);
+        }
     } catch (Exception &e) {
         m_errorType = ParserError;
         m_errorString = e.toString();
@@ -173,4 +189,127 @@ bool MakefileFactory::apply(const QStringList& commandLineArguments, Options **o
     return m_errorType == NoError;
 }
 
+/**
+ * Follows the $(MAKE) invocations of a makefile that contains .NONRECURSIVE.
+ * A target whose commands are all sub-make invocations loses its commands and gets
+ * the goal targets of the sub-makefiles as dependents instead. This way the targets
+ * of all makefiles end up in one dependency graph.
+ */
+void MakefileFactory::mergeSubMakefiles(Makefile *makefile,
+                                        QHash<QString, Makefile *> &subMakefiles)
+{
+    const QString makeProgram = makefile->options()->fullAppPath;
+    foreach (DescriptionBlock *target, makefile->targets()) {
+        if (target->m_commands.isEmpty())
+            continue;
+
+        bool mergeable = true;
+        QList<DescriptionBlock *> goals;
+        foreach (const Command &cmd, target->m_commands) {
+            QString commandLine = cmd.m_commandLine;
+            commandLine.replace(QLatin1String("%%"), QLatin1String("%"));
+            QString directory;
+            QStringList arguments;
+            if (cmd.m_maxExitCode != 0 || !cmd.m_inlineFiles.isEmpty()
+                || !SubMake::parseCommandLine(commandLine, makeProgram, &directory, &arguments)
+                || !loadSubMakefile(makefile,
+                                    QDir(makefile->workingDirectory()).absoluteFilePath(directory),
+                                    arguments, subMakefiles, &goals))
+            {
+                mergeable = false;
+                break;
+            }
+        }
+
+        if (mergeable) {
+            target->m_commands.clear();
+            target->m_subMakeDependents += goals;
+        }
+    }
+}
+
+/**
+ * Reads the makefile of a sub-make invocation and appends its goal targets to goals.
+ * Returns 0 if the invocation cannot be merged.
+ */
+Makefile *MakefileFactory::loadSubMakefile(Makefile *makefile, const QString &directory,
+                                           const QStringList &arguments,
+                                           QHash<QString, Makefile *> &subMakefiles,
+                                           QList<DescriptionBlock *> *goals)
+{
+    const ProcessEnvironment &environment = makefile->macroTable()->environment();
+    QStringList commandLineArguments = arguments;
+    QString makeFlags = environment.value(QLatin1String("JOMFLAGS"));
+    if (makeFlags.isEmpty())
+        makeFlags = environment.value(QLatin1String("MAKEFLAGS"));
+    if (!makeFlags.isEmpty())
+        commandLineArguments.prepend(QLatin1Char('/') + makeFlags);
+
+    CurrentDirectoryScope directoryScope(directory);
+
+    // A job count that differs from ours needs a job server of its own.
+    GlobalOptions globalOptions = *m_globalOptions;
+    globalOptions.isMaxNumberOfJobsSet = false;
+    Options options;
+    MacroTable macroTable;
+    QString fileName;
+    QStringList goalNames;
+    const bool argumentsValid = options.readCommandLineArguments(commandLineArguments, fileName,
+                                                                 goalNames, macroTable,
+                                                                 &globalOptions);
+    const bool jobCountChanged = globalOptions.isMaxNumberOfJobsSet
+            && globalOptions.maxNumberOfJobs != m_globalOptions->maxNumberOfJobs;
+    if (!argumentsValid || jobCountChanged || options.showUsageAndExit
+        || options.showVersionAndExit || options.displayMakeInformation
+        || options.dumpDependencyGraph || options.printWorkingDir || options.watchMode
+        || !options.stderrFile.isEmpty())
+    {
+        return 0;
+    }
+
+    // Invocations that only differ in the goal targets share the makefile.
+    static QStringList makefilesBeingRead;
+    const QString filePath = QDir(directory).absoluteFilePath(fileName);
+    QStringList keyArguments = commandLineArguments;
+    foreach (const QString &goalName, goalNames)
+        keyArguments.removeAll(goalName);
+    const QString key = filePath + QLatin1Char('|') + keyArguments.join(QLatin1String("|"));
+    Makefile *subMakefile = subMakefiles.value(key);
+    if (!subMakefile) {
+        if (makefilesBeingRead.contains(filePath, Qt::CaseInsensitive))
+            return 0;
+        makefilesBeingRead.append(filePath);
+        MakefileFactory factory;
+        factory.setEnvironment(environment);
+        factory.setGlobalOptions(&globalOptions);
+        const bool makefileRead = factory.apply(commandLineArguments);
+        makefilesBeingRead.removeLast();
+        subMakefile = factory.makefile();
+        if (!makefileRead) {
+            delete subMakefile;
+            throw Exception(factory.errorString());
+        }
+        if (subMakefile->isParallelExecutionDisabled()) {
+            delete subMakefile;
+            return 0;
+        }
+        subMakefile->setWorkingDirectory(QDir::currentPath());
+        makefile->addSubMakefile(subMakefile);
+        subMakefiles.insert(key, subMakefile);
+    }
+
+    if (goalNames.isEmpty()) {
+        if (subMakefile->firstTarget())
+            goals->append(subMakefile->firstTarget());
+        return subMakefile;
+    }
+    foreach (const QString &goalName, goalNames) {
+        DescriptionBlock *goal = subMakefile->target(goalName);
+        if (!goal)
+            return 0;
+        goals->append(goal);
+    }
+    return subMakefile;
+}
+
 } //namespace NMakeFile
@@ -27,10 +27,13 @@
 #define MAKEFILEFACTORY_H
 
 #include "processenvironment.h"
+#include <QtCore/QHash>
 #include <QtCore/QStringList>
 
 namespace NMakeFile {
 
+class DescriptionBlock;
+class GlobalOptions;
 class Makefile;
 class Options;
 
@@ -39,6 +42,8 @@ class MakefileFactory
 public:
     MakefileFactory();
     void setEnvironment(const QStringList& env);
+    void setEnvironment(const ProcessEnvironment &env) { m_environment = env; }
+    void setGlobalOptions(GlobalOptions *globalOptions) { m_globalOptions = globalOptions; }
     bool apply(const QStringList& commandLineArguments, Options **outopt = 0);
 
     enum ErrorType {
@@ -55,10 +60,16 @@ public:
 
 private:
     void clear();
+    void mergeSubMakefiles(Makefile *makefile, QHash<QString, Makefile *> &subMakefiles);
+    Makefile *loadSubMakefile(Makefile *makefile, const QString &directory,
+                              const QStringList &arguments,
+                              QHash<QString, Makefile *> &subMakefiles,
+                              QList<DescriptionBlock *> *goals);
 
 private:
     Makefile*   m_makefile;
     ProcessEnvironment m_environment;
+    GlobalOptions *m_globalOptions;
     QStringList m_activeTargets;
     QString     m_errorString;
     ErrorType   m_errorType;
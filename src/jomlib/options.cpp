@@ -24,6 +24,7 @@
 ****************************************************************************/
 
 #include "options.h"
+#include "consolewriter.h"
 #include "macrotable.h"
 #include "exception.h"
 #include "helperfunctions.h"
@@ -67,7 +68,17 @@ Options::Options()
     showUsageAndExit(false),
     displayBuildInfo(false),
     debugMode(false),
-    showVersionAndExit(false)
+    showVersionAndExit(false),
+    useCommandScripts(false),
+    useShellWorkers(false),
+    failFast(false),
+    runSubMakesInProcess(false),
+    watchMode(false),
+    useResultCache(false),
+    showProgress(false),
+    runStatusServer(false),
+    shareStatCache(false),
+    outputSync(OutputSyncForeground)
 {
 }
 
@@ -79,9 +90,12 @@ Options::Options()
  * - fill the MAKEFLAGS variable (and translate long option names to short option names)
  * - set macro values
  * - generate list of targets
+ *
+ * The job count of /J goes into globalOptions.
  */
 bool Options::readCommandLineArguments(QStringList arguments, QString& makefile,
-                                       QStringList& targets, MacroTable& macroTable)
+                                       QStringList& targets, MacroTable& macroTable,
+                                       GlobalOptions *globalOptions)
 {
     QString makeflags;
     if (!expandCommandFiles(arguments))
@@ -97,13 +111,15 @@ bool Options::readCommandLineArguments(QStringList arguments, QString& makefile,
             // handle option
             arg.remove(0, 1);
             arg = arg.trimmed();
-            if (!handleCommandLineOption(originalArguments, arg, arguments, makefile, makeflags))
+            if (!handleCommandLineOption(originalArguments, arg, arguments, makefile, makeflags,
+                                         globalOptions))
                 return false;
         } else if (arg.contains(QLatin1Char('='))) {
             // handle macro definition
             int idx = arg.indexOf(QLatin1Char('='));
             QString name = arg.left(idx).trimmed();
             if (!macroTable.isMacroNameValid(name)) {
+                ConsoleWriter::flush();
                 fprintf(stderr, "Error: The macro name %s is invalid.", qPrintable(name));
                 exit(128);
             }
@@ -186,7 +202,8 @@ bool Options::expandCommandFiles(QStringList& arguments)
     return true;
 }
 
-bool Options::handleCommandLineOption(const QStringList &originalArguments, QString arg, QStringList& arguments, QString& makefile, QString& makeflags)
+bool Options::handleCommandLineOption(const QStringList &originalArguments, QString arg, QStringList& arguments, QString& makefile, QString& makeflags,
+                                      GlobalOptions *globalOptions)
 {
     while (!arg.isEmpty()) {
         QString upperArg = arg.toUpper();
@@ -207,6 +224,54 @@ bool Options::handleCommandLineOption(const QStringList &originalArguments, QStr
             } else if (upperArg.startsWith(QLatin1String("DEBUG"))) {
                 arg.remove(0, 5);
                 debugMode = true;
+            } else if (upperArg.startsWith(QLatin1String("ONESHELL"))) {
+                arg.remove(0, 8);
+                useCommandScripts = true;
+            } else if (upperArg.startsWith(QLatin1String("SHELLWORKERS"))) {
+                arg.remove(0, 12);
+                useShellWorkers = true;
+            } else if (upperArg.startsWith(QLatin1String("FAILFAST"))) {
+                arg.remove(0, 8);
+                failFast = true;
+            } else if (upperArg.startsWith(QLatin1String("INPROCESS"))) {
+                arg.remove(0, 9);
+                runSubMakesInProcess = true;
+            } else if (upperArg.startsWith(QLatin1String("WATCH"))) {
+                arg.remove(0, 5);
+                watchMode = true;
+            } else if (upperArg.startsWith(QLatin1String("CACHE"))) {
+                arg.remove(0, 5);
+                useResultCache = true;
+            } else if (upperArg.startsWith(QLatin1String("REMOTE"))) {
+                arg.remove(0, 6);
+                if (arguments.isEmpty()) {
+                    fprintf(stderr, "Error: no worker addresses specified for option -remote\n");
+                    return false;
+                }
+                remoteWorkers += arguments.takeFirst().split(QLatin1Char(','),
+                                                             QString::SkipEmptyParts);
+            } else if (upperArg.startsWith(QLatin1String("TRACE"))) {
+                arg.remove(0, 5);
+                if (arguments.isEmpty()) {
+                    fprintf(stderr, "Error: no filename specified for option -trace\n");
+                    return false;
+                }
+                traceFile = arguments.takeFirst();
+            } else if (upperArg.startsWith(QLatin1String("STATUSSERVER"))) {
+                arg.remove(0, 12);
+                runStatusServer = true;
+            } else if (upperArg.startsWith(QLatin1String("SHAREDSTATCACHE"))) {
+                arg.remove(0, 15);
+                shareStatCache = true;
+            } else if (upperArg.startsWith(QLatin1String("PROGRESS"))) {
+                arg.remove(0, 8);
+                showProgress = true;
+            } else if (upperArg.startsWith(QLatin1String("PROFILE"))) {
+                arg.remove(0, 7);
+                // handled in main() before the makefile is read
+            } else if (upperArg.startsWith(QLatin1String("USESERVER"))) {
+                arg.remove(0, 9);
+                // handled in main() before the makefile is read
             } else if (upperArg.startsWith(QLatin1String("ERRORREPORT"))) {
                 arg.remove(0, 11);
                 // ignore - we don't send stuff to Microsoft :)
@@ -294,16 +359,16 @@ bool Options::handleCommandLineOption(const QStringList &originalArguments, QStr
                         arg.remove(0, nJobsStr.length());
                     }
                     bool ok;
-                    g_options.maxNumberOfJobs = nJobsStr.toUInt(&ok);
+                    globalOptions->maxNumberOfJobs = nJobsStr.toUInt(&ok);
                     if (!ok) {
                         fprintf(stderr, "Error: option -j expects a numerical argument\n");
                         return false;
                     }
-                    if (g_options.maxNumberOfJobs < 1) {
+                    if (globalOptions->maxNumberOfJobs < 1) {
                         fputs("Error: the argument for -j must not be less than 1.\n", stderr);
                         return false;
                     }
-                    g_options.isMaxNumberOfJobsSet = true;
+                    globalOptions->isMaxNumberOfJobsSet = true;
                     if (makeflags.at(makeflags.count() - 1).toUpper() == QLatin1Char('J'))
                         makeflags += nJobsStr;
                     break;
@@ -317,6 +382,32 @@ bool Options::handleCommandLineOption(const QStringList &originalArguments, QStr
             case 'N':
                 dryRun = true;
                 break;
+            case 'O':
+                {
+                    static const struct {
+                        const char *name;
+                        OutputSync mode;
+                    } modes[] = {
+                        { "NONE", OutputSyncNone },
+                        { "LINE", OutputSyncLine },
+                        { "TARGET", OutputSyncTarget },
+                        { "RECURSE", OutputSyncRecurse }
+                    };
+                    // A plain /O synchronizes the output per target.
+                    outputSync = OutputSyncTarget;
+                    const QString upperMode = arg.toUpper();
+                    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+                        const QLatin1String name(modes[i].name);
+                        if (upperMode.startsWith(name)) {
+                            outputSync = modes[i].mode;
+                            if (makeflags.at(makeflags.count() - 1).toUpper() == QLatin1Char('O'))
+                                makeflags += arg.left(name.size());
+                            arg.remove(0, name.size());
+                            break;
+                        }
+                    }
+                    break;
+                }
             case 'P':
                 displayMakeInformation = true;
                 break;
@@ -33,13 +33,33 @@ namespace NMakeFile {
 
 class MacroTable;
 
+class GlobalOptions
+{
+public:
+    GlobalOptions();
+    int maxNumberOfJobs;
+    bool isMaxNumberOfJobsSet;
+};
+
+extern GlobalOptions g_options;
+
 class Options
 {
 public:
     Options();
 
+    enum OutputSync
+    {
+        OutputSyncForeground,   // one job writes directly, the others are buffered
+        OutputSyncNone,
+        OutputSyncLine,
+        OutputSyncTarget,
+        OutputSyncRecurse
+    };
+
     bool readCommandLineArguments(QStringList arguments, QString& makefile,
-                                  QStringList& targets, MacroTable& macroTable);
+                                  QStringList& targets, MacroTable& macroTable,
+                                  GlobalOptions *globalOptions = &g_options);
 
     bool buildAllTargets;
     bool buildIfTimeStampsAreEqual;
@@ -64,24 +84,27 @@ public:
     bool displayBuildInfo;
     bool debugMode;
     bool showVersionAndExit;
+    bool useCommandScripts;
+    bool useShellWorkers;
+    bool failFast;
+    bool runSubMakesInProcess;
+    bool watchMode;
+    bool useResultCache;
+    bool showProgress;
+    bool runStatusServer;
+    bool shareStatCache;
+    OutputSync outputSync;
+    QStringList remoteWorkers;
+    QString traceFile;
     QString fullAppPath;
     QString stderrFile;
 
 private:
     bool expandCommandFiles(QStringList& arguments);
-    bool handleCommandLineOption(const QStringList &originalArguments, QString arg, QStringList& arguments, QString& makefile, QString& makeflags);
+    bool handleCommandLineOption(const QStringList &originalArguments, QString arg, QStringList& arguments, QString& makefile, QString& makeflags,
+                                 GlobalOptions *globalOptions);
 };
 
-class GlobalOptions
-{
-public:
-    GlobalOptions();
-    int maxNumberOfJobs;
-    bool isMaxNumberOfJobsSet;
-};
-
-extern GlobalOptions g_options;
-
 } // namespace NMakeFile
 
 #endif // OPTIONS_H
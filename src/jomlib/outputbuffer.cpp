@@ -0,0 +1,304 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "outputbuffer.h"
+#include "counters.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QVarLengthArray>
+
+#include <cstring>
+
+namespace NMakeFile {
+
+static const int arenaBlockSize = 64 * 1024;
+
+/**
+ * The producer holds one reference to the block it fills, and every queued chunk
+ * holds one. The last one to let go deletes the block.
+ */
+struct OutputBuffer::ArenaBlock
+{
+    QAtomicInt references;
+    char data[arenaBlockSize];
+};
+
+static QAtomicInt bufferLimit(8 * 1024 * 1024);
+static QAtomicInt totalLimit(128 * 1024 * 1024);
+static QAtomicInt totalQueuedBytes;
+static QMutex spilledBytesMutex;
+static qint64 totalSpilledBytes = 0;
+
+OutputBuffer::OutputBuffer()
+    : m_takenBlock(0)
+    , m_spillFile(0)
+    , m_spilledChunks(0)
+{
+    for (int i = 0; i < NumberOfQueues; ++i) {
+        m_arenaBlocks[i] = 0;
+        m_arenaBlockUsage[i] = 0;
+    }
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    Chunk chunk;
+    for (int i = 0; i < NumberOfQueues; ++i) {
+        while (m_queues[i].dequeue(&chunk))
+            release(chunk.block);
+        release(m_arenaBlocks[i]);
+    }
+    release(m_takenBlock);
+    totalQueuedBytes.fetchAndAddRelaxed(-m_queuedBytes.load());
+    delete m_spillFile;
+}
+
+void OutputBuffer::release(ArenaBlock *block)
+{
+    if (block && !block->references.deref())
+        delete block;
+}
+
+/**
+ * Sets the number of bytes one buffer and all buffers together may hold in memory.
+ */
+void OutputBuffer::setLimits(int newBufferLimit, int newTotalLimit)
+{
+    bufferLimit.store(newBufferLimit);
+    totalLimit.store(newTotalLimit);
+}
+
+/**
+ * Returns the number of bytes that went to temporary files so far.
+ */
+qint64 OutputBuffer::spilledBytes()
+{
+    QMutexLocker locker(&spilledBytesMutex);
+    return totalSpilledBytes;
+}
+
+/**
+ * Returns true if there is nothing to replay. Must be called by the main thread.
+ */
+bool OutputBuffer::isEmpty() const
+{
+    for (int i = 0; i < NumberOfQueues; ++i)
+        if (m_queues[i].front())
+            return false;
+    return true;
+}
+
+/**
+ * Appends output of the process. Must be called by one thread only, usually
+ * the thread that reads the pipes of the process.
+ */
+void OutputBuffer::append(Channel channel, const char *data, int count)
+{
+    enqueue(channel, channel, data, count);
+}
+
+/**
+ * Appends output that jom itself writes for the job. Must be called by the main thread.
+ */
+void OutputBuffer::appendMessage(Channel channel, const QByteArray &data)
+{
+    enqueue(NumberOfQueues - 1, channel, data.constData(), data.size());
+}
+
+/**
+ * Copies the data into the arena block of the queue and queues chunks that point to it.
+ * Data that doesn't fit into the current block is split.
+ * Spilled data is split into chunks of the same size, so that replaying never
+ * reads more than one block at a time.
+ */
+void OutputBuffer::enqueue(int queueIndex, Channel channel, const char *data, int count)
+{
+    if (count <= 0)
+        return;
+
+    Counters::increment(Counters::OutputBytesBuffered, count);
+    if (m_queuedBytes.load() + count > bufferLimit.load()
+        || totalQueuedBytes.load() + count > totalLimit.load())
+    {
+        QVarLengthArray<Chunk, 4> chunks;
+        for (int offset = 0; offset < count; offset += arenaBlockSize) {
+            Chunk chunk;
+            chunk.channel = channel;
+            chunk.size = qMin(count - offset, arenaBlockSize);
+            if (!spill(&chunk, data + offset, chunk.size))
+                break;
+            chunks.append(chunk);
+        }
+        if (chunks.count() > 0)
+            publish(queueIndex, chunks.data(), chunks.count());
+        const int spilledCount = chunks.count() * arenaBlockSize;
+        if (spilledCount >= count)
+            return;
+        // We couldn't write the file. Keep the rest of the output in memory.
+        data += spilledCount;
+        count -= spilledCount;
+    }
+
+    m_queuedBytes.fetchAndAddRelaxed(count);
+    totalQueuedBytes.fetchAndAddRelaxed(count);
+    QVarLengthArray<Chunk, 4> chunks;
+    ArenaBlock *&block = m_arenaBlocks[queueIndex];
+    int &usage = m_arenaBlockUsage[queueIndex];
+    while (count > 0) {
+        if (!block || usage == arenaBlockSize) {
+            release(block);
+            block = new ArenaBlock;
+            block->references.store(1);
+            usage = 0;
+        }
+        Chunk chunk;
+        chunk.channel = channel;
+        chunk.block = block;
+        chunk.data = block->data + usage;
+        chunk.size = qMin(count, arenaBlockSize - usage);
+        memcpy(block->data + usage, data, chunk.size);
+        block->references.ref();
+        chunks.append(chunk);
+        usage += chunk.size;
+        data += chunk.size;
+        count -= chunk.size;
+    }
+    publish(queueIndex, chunks.data(), chunks.count());
+}
+
+/**
+ * Numbers and queues the chunks. The pieces of one append share their number.
+ */
+void OutputBuffer::publish(int queueIndex, Chunk *chunks, int count)
+{
+    QMutexLocker locker(&m_publishMutex);
+    const uint sequenceNumber = uint(m_sequenceNumber.load());
+    for (int i = 0; i < count; ++i) {
+        chunks[i].sequenceNumber = sequenceNumber;
+        m_queues[queueIndex].enqueue(chunks[i]);
+    }
+    m_sequenceNumber.storeRelease(int(sequenceNumber + 1));
+}
+
+/**
+ * Writes the data to the temporary file of this buffer.
+ * This is the slow path and may take a lock.
+ */
+bool OutputBuffer::spill(Chunk *chunk, const char *data, int count)
+{
+    QMutexLocker locker(&m_spillMutex);
+    if (!m_spillFile) {
+        m_spillFile = new QTemporaryFile(QDir::tempPath() + QLatin1String("/jomoutput.XXXXXX"));
+        if (!m_spillFile->open()) {
+            delete m_spillFile;
+            m_spillFile = 0;
+            return false;
+        }
+    }
+
+    const qint64 offset = m_spillFile->size();
+    if (!m_spillFile->seek(offset) || m_spillFile->write(data, count) != count
+        || !m_spillFile->flush())
+    {
+        return false;
+    }
+    chunk->spillOffset = offset;
+    m_spilledChunks++;
+
+    QMutexLocker spilledBytesLocker(&spilledBytesMutex);
+    totalSpilledBytes += count;
+    return true;
+}
+
+QByteArray OutputBuffer::readSpilledData(const Chunk &chunk)
+{
+    QMutexLocker locker(&m_spillMutex);
+    QByteArray data;
+    if (m_spillFile->seek(chunk.spillOffset))
+        data = m_spillFile->read(chunk.size);
+
+    // Start over with an empty file once everything has been read back.
+    if (--m_spilledChunks == 0)
+        m_spillFile->resize(0);
+    return data;
+}
+
+/**
+ * Takes the chunk that was appended first and returns its data.
+ * The data is only valid until the next call.
+ * Returns false if the buffer is empty. Must be called by the main thread.
+ */
+bool OutputBuffer::takeNext(Channel *channel, QByteArray *data)
+{
+    release(m_takenBlock);
+    m_takenBlock = 0;
+
+    // Pick the chunk with the lowest sequence number. Chunks with higher numbers
+    // than the published one were queued after we started looking.
+    const uint end = uint(m_sequenceNumber.loadAcquire());
+    int queueIndex = -1;
+    uint sequenceNumber = 0;
+    for (int i = 0; i < NumberOfQueues; ++i) {
+        const Chunk *chunk = m_queues[i].front();
+        if (!chunk || int(chunk->sequenceNumber - end) >= 0)
+            continue;
+        if (queueIndex < 0 || int(chunk->sequenceNumber - sequenceNumber) < 0) {
+            queueIndex = i;
+            sequenceNumber = chunk->sequenceNumber;
+        }
+    }
+    if (queueIndex < 0)
+        return false;
+
+    Chunk chunk;
+    m_queues[queueIndex].dequeue(&chunk);
+    *channel = chunk.channel;
+    if (chunk.block) {
+        m_queuedBytes.fetchAndAddRelaxed(-chunk.size);
+        totalQueuedBytes.fetchAndAddRelaxed(-chunk.size);
+        m_takenBlock = chunk.block;
+        *data = QByteArray::fromRawData(chunk.data, chunk.size);
+    } else {
+        *data = readSpilledData(chunk);
+    }
+    return true;
+}
+
+/**
+ * Writes the buffered output to the streams in the order it was appended.
+ * Each write passes at most one arena block, which keeps the memory use low
+ * if the write function blocks while the console is busy.
+ * Must be called by the main thread.
+ */
+void OutputBuffer::replay(FILE *standardOutput, FILE *standardError, WriteFunction write)
+{
+    Channel channel;
+    QByteArray data;
+    while (takeNext(&channel, &data))
+        write(channel == StandardOutput ? standardOutput : standardError, data.constData(), data.size());
+}
+
+} // namespace NMakeFile
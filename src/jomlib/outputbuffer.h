@@ -0,0 +1,125 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H
+
+#include "spscqueue.h"
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+
+#include <cstdio>
+
+QT_BEGIN_NAMESPACE
+class QTemporaryFile;
+QT_END_NAMESPACE
+
+namespace NMakeFile {
+
+/**
+ * Holds the output of a job until it may be printed.
+ *
+ * The output of the process arrives in the reader thread and is put into one
+ * lock-free queue per channel. The messages jom writes on behalf of the job
+ * come from the main thread and have their own queue. The data is copied into
+ * 64 KiB arena blocks that the queued chunks point into.
+ * Every chunk gets a sequence number, and replaying merges the queues in that
+ * order. Numbering and enqueueing a chunk happen under a short lock. Replaying
+ * only looks at chunks below the last published number, so no chunk can
+ * overtake one with a lower number that is still on its way into its queue.
+ *
+ * If the queued chunks of a buffer grow beyond its own limit or all buffers
+ * together beyond the global limit, further chunks are written to a temporary
+ * file and the queue only holds their position.
+ */
+class OutputBuffer
+{
+public:
+    enum Channel
+    {
+        StandardOutput,
+        StandardError
+    };
+
+    typedef void (*WriteFunction)(FILE *stream, const char *data, size_t count);
+
+    OutputBuffer();
+    ~OutputBuffer();
+
+    void append(Channel channel, const char *data, int count);
+    void appendMessage(Channel channel, const QByteArray &data);
+    void replay(FILE *standardOutput, FILE *standardError, WriteFunction write);
+    bool takeNext(Channel *channel, QByteArray *data);
+    bool isEmpty() const;
+
+    static void setLimits(int bufferLimit, int totalLimit);
+    static qint64 spilledBytes();
+
+private:
+    struct ArenaBlock;
+
+    struct Chunk
+    {
+        Chunk()
+            : sequenceNumber(0), channel(StandardOutput), block(0), data(0), spillOffset(-1), size(0)
+        {}
+        uint sequenceNumber;
+        Channel channel;
+        ArenaBlock *block;      // 0 if the data was spilled
+        const char *data;
+        qint64 spillOffset;     // -1 if the data is in memory
+        int size;
+    };
+
+    void enqueue(int queueIndex, Channel channel, const char *data, int count);
+    void publish(int queueIndex, Chunk *chunks, int count);
+    bool spill(Chunk *chunk, const char *data, int count);
+    QByteArray readSpilledData(const Chunk &chunk);
+    static void release(ArenaBlock *block);
+
+private:
+    enum { NumberOfQueues = 3 };
+    SpscQueue<Chunk> m_queues[NumberOfQueues];   // stdout, stderr, messages
+    QMutex m_publishMutex;
+    QAtomicInt m_sequenceNumber;                // all chunks below this number are queued
+    QAtomicInt m_queuedBytes;
+
+    // Written by the producer of the respective queue.
+    ArenaBlock *m_arenaBlocks[NumberOfQueues];
+    int m_arenaBlockUsage[NumberOfQueues];
+
+    // Keeps the data that takeNext returned alive until the next call.
+    ArenaBlock *m_takenBlock;
+
+    QMutex m_spillMutex;
+    QTemporaryFile *m_spillFile;
+    int m_spilledChunks;
+};
+
+} // namespace NMakeFile
+
+#endif // OUTPUTBUFFER_H
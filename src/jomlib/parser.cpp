@@ -28,6 +28,7 @@
 #include "options.h"
 #include "exception.h"
 #include "helperfunctions.h"
+#include "profiler.h"
 
 #include <QDebug>
 #include <QDir>
@@ -144,6 +145,7 @@ void Parser::apply(Preprocessor* pp,
     }
 
     // check for cycles in active targets
+    ProfileScope profileScope("preselect inference rules");
     foreach (const QString& targetName, m_activeTargets) {
         DescriptionBlock *target = m_makefile->target(targetName);
         checkForCycles(target);
@@ -437,6 +439,10 @@ void Parser::parseDescriptionBlock(int separatorPos, int separatorLength, int co
             m_makefile->setParallelExecutionDisabled(true);
             continue;
         }
+        if (t == QStringLiteral(".NONRECURSIVE")) {
+            m_makefile->setNonRecursive(true);
+            continue;
+        }
 
         DescriptionBlock* descblock = m_makefile->target(t);
         DescriptionBlock::AddCommandsState canAddCommands = separatorLength > 1 ? DescriptionBlock::ACSEnabled : DescriptionBlock::ACSDisabled;
@@ -457,10 +463,13 @@ void Parser::parseDescriptionBlock(int separatorPos, int separatorLength, int co
         descblock->expandFileNameMacrosForDependents();
 
         if (!commands.isEmpty()) {
-            if (canAddCommands == DescriptionBlock::ACSEnabled || descblock->m_commands.isEmpty())
+            if (canAddCommands == DescriptionBlock::ACSEnabled || descblock->m_commands.isEmpty()) {
                 descblock->m_commands.append(commands);
-            else
+                if (targets.count() > 1)
+                    descblock->m_hasSiblingTargets = true;
+            } else {
                 qWarning("Cannot add commands to previously defined target %s.", qPrintable(t));
+            }
         }
 
         //qDebug() << "parseDescriptionBlock" << descblock->m_targetName << descblock->m_dependents;
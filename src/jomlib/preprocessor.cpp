@@ -29,6 +29,7 @@
 #include "exception.h"
 #include "helperfunctions.h"
 #include "fastfileinfo.h"
+#include "profiler.h"
 
 #include <QDir>
 #include <QDebug>
@@ -60,6 +61,7 @@ bool Preprocessor::openFile(const QString& fileName)
     m_conditionalStack.clear();
     if (!m_fileStack.isEmpty())
         m_fileStack.clear();
+    m_openedFiles.clear();
 
     return internalOpenFile(fileName);
 }
@@ -74,6 +76,7 @@ bool Preprocessor::internalOpenFile(QString fileName)
         error(msg.arg(origFileName));
     }
     fileName = fileInfo.absoluteFilePath();
+    m_openedFiles.append(fileName);
 
     // detect include cycles
     foreach (const TextFile& tf, m_fileStack)
@@ -95,6 +98,7 @@ bool Preprocessor::internalOpenFile(QString fileName)
 
 QString Preprocessor::readLine()
 {
+    ProfileScope profileScope("read line");
     MakefileLine line;
     for (;;) {
         MakefileLine next = basicReadLine();
@@ -258,6 +262,7 @@ bool Preprocessor::parsePreprocessingDirective(const QString& line)
     } else if (directive == QLatin1String("MESSAGE")) {
         puts(qPrintable(value));
     } else if (directive == QLatin1String("INCLUDE")) {
+        ProfileScope profileScope("include file");
         internalOpenFile(findIncludeFile(value));
     } else if (directive == QLatin1String("IF")) {
         bool followElseBranch = evaluateExpression(value) == 0;
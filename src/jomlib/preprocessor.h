@@ -48,6 +48,7 @@ public:
     void setMacroTable(MacroTable* macroTable);
     MacroTable* macroTable() { return m_macroTable; }
     bool openFile(const QString& filename);
+    const QStringList& openedFiles() const { return m_openedFiles; }
     QString readLine();
     uint lineNumber() const;
     QString currentFileName() const;
@@ -99,6 +100,7 @@ private:
     };
 
     QStack<TextFile>    m_fileStack;
+    QStringList         m_openedFiles;
     MacroTable*         m_macroTable;
     QRegExp             m_rexPreprocessingDirective;
     QStack<bool>        m_conditionalStack;
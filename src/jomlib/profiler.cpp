@@ -0,0 +1,203 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "profiler.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+#include <algorithm>
+#include <cstring>
+
+namespace NMakeFile {
+
+/**
+ * Durations are counted in buckets whose width grows with the duration.
+ * Each power of two is split into four buckets, which makes the
+ * percentiles accurate to about 20 per cent.
+ */
+static const int subBucketBits = 2;
+static const int bucketCount = 64 << subBucketBits;
+
+static int bucketIndex(quint64 nsecs)
+{
+    if (nsecs < quint64(1 << subBucketBits))
+        return int(nsecs);
+    int msb = 0;
+    for (int shift = 32; shift > 0; shift /= 2) {
+        if (nsecs >> (msb + shift))
+            msb += shift;
+    }
+    const int subBucket = int(nsecs >> (msb - subBucketBits)) & ((1 << subBucketBits) - 1);
+    return ((msb - subBucketBits + 1) << subBucketBits) + subBucket;
+}
+
+static qint64 bucketUpperBound(int index)
+{
+    if (index < (1 << subBucketBits))
+        return index;
+    const int msb = (index >> subBucketBits) + subBucketBits - 1;
+    const int subBucket = index & ((1 << subBucketBits) - 1);
+    return ((qint64(1 << subBucketBits) + subBucket + 1) << (msb - subBucketBits)) - 1;
+}
+
+class ProfileNode
+{
+public:
+    ProfileNode(const char *name, ProfileNode *parent)
+        : name(name), parent(parent), count(0), total(0), max(0)
+    {
+        std::fill(histogram, histogram + bucketCount, 0);
+    }
+
+    ~ProfileNode()
+    {
+        qDeleteAll(children);
+    }
+
+    ProfileNode *child(const char *childName)
+    {
+        foreach (ProfileNode *node, children)
+            if (node->name == childName || strcmp(node->name, childName) == 0)
+                return node;
+        ProfileNode *node = new ProfileNode(childName, this);
+        children.append(node);
+        return node;
+    }
+
+    void addSample(qint64 nsecs)
+    {
+        count++;
+        total += nsecs;
+        max = qMax(max, nsecs);
+        histogram[bucketIndex(quint64(qMax(nsecs, qint64(0))))]++;
+    }
+
+    qint64 percentile(int percent) const
+    {
+        const qint64 rank = (qint64(count) * percent + 99) / 100;
+        qint64 seen = 0;
+        for (int i = 0; i < bucketCount; ++i) {
+            seen += histogram[i];
+            if (seen >= rank)
+                return qMin(bucketUpperBound(i), max);
+        }
+        return max;
+    }
+
+    const char *name;
+    ProfileNode *parent;
+    QVector<ProfileNode *> children;
+    int count;
+    qint64 total;
+    qint64 max;
+    quint32 histogram[bucketCount];
+};
+
+bool Profiler::m_enabled = false;
+static QElapsedTimer timer;
+static QThread *profiledThread = 0;
+static ProfileNode *rootNode = 0;
+static ProfileNode *currentNode = 0;
+
+void Profiler::setEnabled(bool enabled)
+{
+    if (enabled && !rootNode) {
+        rootNode = new ProfileNode("jom", 0);
+        currentNode = rootNode;
+        profiledThread = QThread::currentThread();
+        timer.start();
+    }
+    m_enabled = enabled;
+}
+
+ProfileNode *Profiler::enter(const char *name, qint64 *startTime)
+{
+    if (QThread::currentThread() != profiledThread)
+        return 0;
+    currentNode = currentNode->child(name);
+    *startTime = timer.nsecsElapsed();
+    return currentNode;
+}
+
+void Profiler::leave(ProfileNode *node, qint64 startTime)
+{
+    node->addSample(timer.nsecsElapsed() - startTime);
+    currentNode = node->parent;
+}
+
+/**
+ * Records a duration that wasn't measured with a scope, e.g. an asynchronous wait.
+ * It's counted as a child of the active scope.
+ */
+void Profiler::addSample(const char *name, qint64 nsecs)
+{
+    if (!m_enabled || QThread::currentThread() != profiledThread)
+        return;
+    currentNode->child(name)->addSample(nsecs);
+}
+
+static bool hasLargerTotal(const ProfileNode *lhs, const ProfileNode *rhs)
+{
+    return lhs->total > rhs->total;
+}
+
+static void printNode(FILE *stream, const ProfileNode *node, int depth, qint64 wallTime)
+{
+    const QByteArray label = QByteArray(2 * depth, ' ') + node->name;
+    fprintf(stream, "%-40s %9d %11.3f %6.1f%% %10.1f %10.1f %10.1f %10.1f\n",
+            label.constData(), node->count, node->total / 1e6,
+            wallTime > 0 ? 100.0 * node->total / wallTime : 0.0,
+            node->percentile(50) / 1e3, node->percentile(90) / 1e3,
+            node->percentile(99) / 1e3, node->max / 1e3);
+
+    QVector<ProfileNode *> children = node->children;
+    std::sort(children.begin(), children.end(), hasLargerTotal);
+    foreach (const ProfileNode *child, children)
+        printNode(stream, child, depth + 1, wallTime);
+}
+
+/**
+ * Prints the measured scopes as a tree. Times are in milliseconds for the
+ * totals and in microseconds for the percentiles.
+ */
+void Profiler::printSummary(FILE *stream)
+{
+    if (!rootNode)
+        return;
+
+    rootNode->count = 1;
+    rootNode->total = rootNode->max = timer.nsecsElapsed();
+    std::fill(rootNode->histogram, rootNode->histogram + bucketCount, 0);
+    rootNode->histogram[bucketIndex(rootNode->total)] = 1;
+
+    fprintf(stream, "%-40s %9s %11s %7s %10s %10s %10s %10s\n",
+            "jom profile", "count", "total ms", "wall", "p50 us", "p90 us", "p99 us", "max us");
+    printNode(stream, rootNode, 0, rootNode->total);
+}
+
+} // namespace NMakeFile
@@ -0,0 +1,82 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QtCore/QtGlobal>
+#include <cstdio>
+
+namespace NMakeFile {
+
+class ProfileNode;
+
+/**
+ * Measures where jom spends its time if /PROFILE is given.
+ *
+ * Instrumented code creates a ProfileScope on the stack. Scopes that are entered
+ * while another scope is active are counted as its children. Only the main thread
+ * is profiled. When profiling is disabled, a scope costs one test of a flag.
+ */
+class Profiler
+{
+public:
+    static void setEnabled(bool enabled);
+    static bool isEnabled() { return m_enabled; }
+    static void addSample(const char *name, qint64 nsecs);
+    static void printSummary(FILE *stream);
+
+private:
+    static ProfileNode *enter(const char *name, qint64 *startTime);
+    static void leave(ProfileNode *node, qint64 startTime);
+
+    static bool m_enabled;
+
+    friend class ProfileScope;
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name)
+        : m_node(Profiler::isEnabled() ? Profiler::enter(name, &m_startTime) : 0)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (m_node)
+            Profiler::leave(m_node, m_startTime);
+    }
+
+private:
+    Q_DISABLE_COPY(ProfileScope)
+    ProfileNode *m_node;
+    qint64 m_startTime;
+};
+
+} // namespace NMakeFile
+
+#endif // PROFILER_H
@@ -0,0 +1,273 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "remoteworker.h"
+#include "helperfunctions.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QMessageAuthenticationCode>
+#include <QtCore/QtEndian>
+#include <QtNetwork/QTcpSocket>
+
+#include <cstdio>
+
+namespace NMakeFile {
+
+static const int connectTimeout = 3000;
+
+/**
+ * A message is its size as big endian quint32, the message type and the payload.
+ */
+void RemoteWorkerProtocol::writeMessage(QIODevice *device, MessageType type,
+                                        const QByteArray &payload)
+{
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream << quint32(payload.size() + 1) << quint8(type);
+    message.append(payload);
+    device->write(message);
+}
+
+/**
+ * Reads the next complete message. A message without a type or one that is bigger
+ * than maxMessageSize closes the device.
+ */
+bool RemoteWorkerProtocol::readMessage(QIODevice *device, quint8 *type, QByteArray *payload)
+{
+    quint32 size;
+    if (device->peek(reinterpret_cast<char *>(&size), sizeof(size)) < qint64(sizeof(size)))
+        return false;
+    size = qFromBigEndian(size);
+    if (size == 0 || size > maxMessageSize) {
+        device->close();
+        return false;
+    }
+    if (device->bytesAvailable() < qint64(sizeof(size) + size))
+        return false;
+    device->read(sizeof(size));
+    const QByteArray message = device->read(size);
+    *type = quint8(message.at(0));
+    *payload = message.mid(1);
+    return true;
+}
+
+/**
+ * Splits "host:port" into its parts. The port is optional.
+ */
+bool RemoteWorkerProtocol::parseAddress(const QString &address, QString *host, quint16 *port)
+{
+    const int idx = address.lastIndexOf(QLatin1Char(':'));
+    *port = defaultPort;
+    if (idx < 0) {
+        *host = address;
+    } else {
+        *host = address.left(idx);
+        bool ok;
+        *port = address.mid(idx + 1).toUShort(&ok);
+        if (!ok || *port == 0)
+            return false;
+    }
+    return !host->isEmpty();
+}
+
+QByteArray RemoteWorkerProtocol::sharedSecret()
+{
+    return qGetEnvironmentVariable(L"JOMWORKERSECRET").toUtf8();
+}
+
+QByteArray RemoteWorkerProtocol::authenticationCode(const QByteArray &challenge,
+                                                    const QByteArray &secret)
+{
+    return QMessageAuthenticationCode::hash(challenge, secret, QCryptographicHash::Sha256);
+}
+
+RemoteSlot::RemoteSlot(QTcpSocket *socket, const QString &workerName, QObject *parent)
+    : QObject(parent)
+    , m_socket(socket)
+    , m_workerName(workerName)
+    , m_busy(false)
+{
+    m_socket->setParent(this);
+    connect(m_socket, &QTcpSocket::readyRead, this, &RemoteSlot::onReadyRead);
+    connect(m_socket, &QTcpSocket::disconnected, this, &RemoteSlot::onDisconnected);
+}
+
+bool RemoteSlot::isConnected() const
+{
+    return m_socket->state() == QAbstractSocket::ConnectedState;
+}
+
+/**
+ * Sends a command line to the worker. The worker writes the inline files to its own
+ * temporary directory and replaces their names in the command line.
+ */
+void RemoteSlot::start(const QString &commandLine, const QString &workingDirectory,
+                       const ProcessEnvironment &environment,
+                       const QList<RemoteInlineFile> &inlineFiles)
+{
+    QStringList environmentStrings;
+    for (ProcessEnvironment::const_iterator it = environment.constBegin();
+         it != environment.constEnd(); ++it)
+    {
+        environmentStrings.append(it.key().toQString() + QLatin1Char('=') + it.value());
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << commandLine << workingDirectory << environmentStrings << inlineFiles;
+    m_busy = true;
+    RemoteWorkerProtocol::writeMessage(m_socket, RemoteWorkerProtocol::RunCommand, payload);
+}
+
+/**
+ * Asks the worker to kill the running command.
+ * The finished signal is emitted when the worker reports the command's end.
+ */
+void RemoteSlot::kill()
+{
+    if (m_busy)
+        RemoteWorkerProtocol::writeMessage(m_socket, RemoteWorkerProtocol::CancelCommand,
+                                           QByteArray());
+}
+
+void RemoteSlot::waitForFinished()
+{
+    while (m_busy) {
+        if (!m_socket->waitForReadyRead(-1)) {
+            onDisconnected();
+            break;
+        }
+    }
+}
+
+void RemoteSlot::onReadyRead()
+{
+    quint8 type;
+    QByteArray payload;
+    while (RemoteWorkerProtocol::readMessage(m_socket, &type, &payload)) {
+        switch (type) {
+        case RemoteWorkerProtocol::StandardOutput:
+            emit outputReceived(payload, false);
+            break;
+        case RemoteWorkerProtocol::StandardError:
+            emit outputReceived(payload, true);
+            break;
+        case RemoteWorkerProtocol::CommandFinished:
+            {
+                QDataStream stream(payload);
+                stream.setVersion(QDataStream::Qt_5_2);
+                qint32 exitCode;
+                bool crashed;
+                stream >> exitCode >> crashed;
+                m_busy = false;
+                emit finished(exitCode, crashed);
+            }
+            break;
+        }
+    }
+}
+
+void RemoteSlot::onDisconnected()
+{
+    if (!m_busy)
+        return;
+    m_busy = false;
+    emit outputReceived("jom: lost the connection to worker " + m_workerName.toLocal8Bit() + "\n",
+                        true);
+    emit finished(2, true);
+}
+
+RemoteWorkerPool::RemoteWorkerPool(QObject *parent)
+    : QObject(parent)
+{
+}
+
+/**
+ * Opens one connection per slot to each worker.
+ * Workers that cannot be reached are reported and skipped.
+ */
+void RemoteWorkerPool::connectToWorkers(const QStringList &addresses)
+{
+    foreach (const QString &address, addresses) {
+        QString host;
+        quint16 port;
+        if (!RemoteWorkerProtocol::parseAddress(address, &host, &port)) {
+            fprintf(stderr, "jom: Invalid worker address %s\n", qPrintable(address));
+            continue;
+        }
+
+        int slotCount = 0;
+        QTcpSocket *socket = connectToWorker(host, port, &slotCount);
+        if (!socket)
+            continue;
+        m_remoteSlots.append(new RemoteSlot(socket, address, this));
+        for (int i = 1; i < slotCount; ++i) {
+            socket = connectToWorker(host, port, &slotCount);
+            if (!socket)
+                break;
+            m_remoteSlots.append(new RemoteSlot(socket, address, this));
+        }
+    }
+}
+
+QTcpSocket *RemoteWorkerPool::connectToWorker(const QString &host, quint16 port, int *slotCount)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    socket->connectToHost(host, port);
+    if (socket->waitForConnected(connectTimeout)) {
+        quint8 type = 0;
+        QByteArray payload;
+        while (!RemoteWorkerProtocol::readMessage(socket, &type, &payload)) {
+            if (!socket->waitForReadyRead(connectTimeout))
+                break;
+        }
+        if (type == RemoteWorkerProtocol::Hello && !payload.isEmpty()) {
+            QDataStream stream(payload);
+            stream.setVersion(QDataStream::Qt_5_2);
+            quint32 version, count;
+            QByteArray challenge;
+            stream >> version >> count >> challenge;
+            if (version == RemoteWorkerProtocol::version && count > 0) {
+                RemoteWorkerProtocol::writeMessage(
+                            socket, RemoteWorkerProtocol::Authenticate,
+                            RemoteWorkerProtocol::authenticationCode(
+                                challenge, RemoteWorkerProtocol::sharedSecret()));
+                *slotCount = count;
+                return socket;
+            }
+            fprintf(stderr, "jom: Worker %s:%d speaks an incompatible protocol.\n",
+                    qPrintable(host), port);
+            delete socket;
+            return 0;
+        }
+    }
+    fprintf(stderr, "jom: Cannot connect to worker %s:%d: %s\n",
+            qPrintable(host), port, qPrintable(socket->errorString()));
+    delete socket;
+    return 0;
+}
+
+} // namespace NMakeFile
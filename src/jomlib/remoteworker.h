@@ -0,0 +1,129 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef REMOTEWORKER_H
+#define REMOTEWORKER_H
+
+#include "processenvironment.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QPair>
+#include <QtCore/QStringList>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+class QTcpSocket;
+QT_END_NAMESPACE
+
+namespace NMakeFile {
+
+/**
+ * The messages that are exchanged between jom and a worker daemon.
+ * Each connection runs one command at a time.
+ * The client answers the challenge of the hello message with an HMAC of the shared
+ * secret from JOMWORKERSECRET. Workers that have a secret run commands only
+ * for clients that know it.
+ */
+namespace RemoteWorkerProtocol
+{
+    enum MessageType
+    {
+        Hello = 1,          // worker: protocol version, number of slots, challenge
+        RunCommand,         // jom: command line, working directory, environment, inline files
+        StandardOutput,     // worker: output data
+        StandardError,      // worker: output data
+        CommandFinished,    // worker: exit code, crashed flag
+        CancelCommand,      // jom: no payload
+        Authenticate        // jom: authentication code of the challenge
+    };
+
+    const quint32 version = 2;
+    const quint16 defaultPort = 9199;
+    const quint32 maxMessageSize = 64 * 1024 * 1024;
+
+    void writeMessage(QIODevice *device, MessageType type, const QByteArray &payload);
+    bool readMessage(QIODevice *device, quint8 *type, QByteArray *payload);
+    bool parseAddress(const QString &address, QString *host, quint16 *port);
+    QByteArray sharedSecret();
+    QByteArray authenticationCode(const QByteArray &challenge, const QByteArray &secret);
+}
+
+typedef QPair<QString, QByteArray> RemoteInlineFile;
+
+/**
+ * One connection to a worker daemon that can run one command at a time.
+ */
+class RemoteSlot : public QObject
+{
+    Q_OBJECT
+public:
+    RemoteSlot(QTcpSocket *socket, const QString &workerName, QObject *parent);
+
+    QString workerName() const { return m_workerName; }
+    bool isConnected() const;
+    bool isBusy() const { return m_busy; }
+    void start(const QString &commandLine, const QString &workingDirectory,
+               const ProcessEnvironment &environment, const QList<RemoteInlineFile> &inlineFiles);
+    void kill();
+    void waitForFinished();
+
+signals:
+    void outputReceived(const QByteArray &data, bool isStandardError);
+    void finished(int exitCode, bool crashed);
+
+private slots:
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    QTcpSocket *m_socket;
+    QString m_workerName;
+    bool m_busy;
+};
+
+/**
+ * The connections to all worker daemons given with /REMOTE.
+ */
+class RemoteWorkerPool : public QObject
+{
+    Q_OBJECT
+public:
+    RemoteWorkerPool(QObject *parent = 0);
+
+    void connectToWorkers(const QStringList &addresses);
+    QList<RemoteSlot *> remoteSlots() const { return m_remoteSlots; }
+
+private:
+    QTcpSocket *connectToWorker(const QString &host, quint16 port, int *slotCount);
+
+private:
+    QList<RemoteSlot *> m_remoteSlots;
+};
+
+} // namespace NMakeFile
+
+#endif // REMOTEWORKER_H
@@ -0,0 +1,329 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "resultcache.h"
+#include "fastfileinfo.h"
+#include "helperfunctions.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QVector>
+
+#include <algorithm>
+#include <windows.h>
+
+namespace NMakeFile {
+
+static const qint64 defaultMaxSizeInMiB = 2048;
+
+ResultCache::ResultCache(const QString &directory, qint64 maxSize)
+    : m_directory(directory)
+    , m_maxSize(maxSize)
+    , m_size(-1)
+{
+}
+
+ResultCache *ResultCache::instance()
+{
+    static ResultCache *cache = 0;
+    if (!cache) {
+        QString directory = qGetEnvironmentVariable(L"JOMCACHEDIR");
+        if (directory.isEmpty()) {
+            directory = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                    + QLatin1String("/jom");
+        }
+        bool ok;
+        qint64 maxSizeInMiB = qGetEnvironmentVariable(L"JOMCACHESIZE").toLongLong(&ok);
+        if (!ok || maxSizeInMiB <= 0)
+            maxSizeInMiB = defaultMaxSizeInMiB;
+        cache = new ResultCache(QDir::cleanPath(directory), maxSizeInMiB * 1024 * 1024);
+    }
+    return cache;
+}
+
+/**
+ * Sets the last write time of a file to now.
+ * A restored output must be newer than its dependents, and the eviction
+ * uses the time stamps of the entries.
+ */
+static void touchFile(const QString &filePath)
+{
+    HANDLE hFile = CreateFileW(reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(filePath).utf16()),
+                               FILE_WRITE_ATTRIBUTES,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                               NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return;
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    SetFileTime(hFile, NULL, NULL, &now);
+    CloseHandle(hFile);
+}
+
+/**
+ * Returns the SHA-1 of the file's content or an empty array if the file cannot be read.
+ * The hashes are kept as long as the file's time stamp doesn't change.
+ */
+QByteArray ResultCache::contentHash(const QString &filePath)
+{
+    const QString absoluteFilePath = QFileInfo(filePath).absoluteFilePath();
+    const FileTime timeStamp = FastFileInfo(absoluteFilePath).lastModified();
+    if (!timeStamp.isValid())
+        return QByteArray();
+
+    const QPair<FileTime, QByteArray> cached = m_contentHashes.value(absoluteFilePath);
+    if (!cached.second.isEmpty() && cached.first == timeStamp)
+        return cached.second;
+
+    QFile file(absoluteFilePath);
+    if (!file.open(QFile::ReadOnly))
+        return QByteArray();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    while (!file.atEnd())
+        hash.addData(file.read(65536));
+    const QByteArray result = hash.result();
+    m_contentHashes.insert(absoluteFilePath, qMakePair(timeStamp, result));
+    return result;
+}
+
+/**
+ * Returns the #include directives of a file. They are kept as long as the
+ * file's time stamp doesn't change.
+ */
+QList<ResultCache::Include> ResultCache::includes(const QString &absoluteFilePath)
+{
+    const FileTime timeStamp = FastFileInfo(absoluteFilePath).lastModified();
+    const QPair<FileTime, QList<Include> > cached = m_includes.value(absoluteFilePath);
+    if (cached.first.isValid() && cached.first == timeStamp)
+        return cached.second;
+
+    QList<Include> result;
+    QFile file(absoluteFilePath);
+    if (!file.open(QFile::ReadOnly)) {
+        result.append(Include());
+        return result;
+    }
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (!line.startsWith('#'))
+            continue;
+        line = line.mid(1).trimmed();
+        if (!line.startsWith("include"))
+            continue;
+        line = line.mid(7).trimmed();
+        Include include;
+        include.isQuoted = line.startsWith('"');
+        const char closingChar = include.isQuoted ? '"' : '>';
+        const int idx = line.indexOf(closingChar, 1);
+        // #include MACRO cannot be evaluated here.
+        if ((include.isQuoted || line.startsWith('<')) && idx > 1)
+            include.fileName = QString::fromLocal8Bit(line.mid(1, idx - 1));
+        result.append(include);
+    }
+    m_includes.insert(absoluteFilePath, qMakePair(timeStamp, result));
+    return result;
+}
+
+static bool isSubDirectoryOf(const QString &filePath, const QStringList &directories)
+{
+    foreach (const QString &directory, directories) {
+        if (filePath.startsWith(directory, Qt::CaseInsensitive)
+            && filePath.length() > directory.length()
+            && filePath.at(directory.length()) == QLatin1Char('/'))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Adds the contents of the files that a C, C++ or resource file includes to the hash.
+ * Files in the system include directories are not scanned; the INCLUDE variable
+ * is part of the key. The directories must be absolute and clean.
+ * Returns false if an included file cannot be found. Such targets must not be cached.
+ */
+bool ResultCache::addIncludedFiles(QCryptographicHash *hash, const QString &sourceFilePath,
+                                   const QStringList &includeDirectories,
+                                   const QStringList &systemIncludeDirectories)
+{
+    static const QStringList sourceFileSuffixes = QStringList()
+            << QLatin1String("c") << QLatin1String("cc") << QLatin1String("cpp")
+            << QLatin1String("cxx") << QLatin1String("h") << QLatin1String("hh")
+            << QLatin1String("hpp") << QLatin1String("hxx") << QLatin1String("inl")
+            << QLatin1String("rc");
+    const QFileInfo fileInfo(sourceFilePath);
+    if (!sourceFileSuffixes.contains(fileInfo.suffix().toLower()))
+        return true;
+    QSet<QString> visited;
+    return addIncludedFiles(hash, QDir::cleanPath(fileInfo.absoluteFilePath()),
+                            includeDirectories, systemIncludeDirectories, &visited);
+}
+
+bool ResultCache::addIncludedFiles(QCryptographicHash *hash, const QString &absoluteFilePath,
+                                   const QStringList &includeDirectories,
+                                   const QStringList &systemIncludeDirectories,
+                                   QSet<QString> *visited)
+{
+    const QString includingDirectory = QFileInfo(absoluteFilePath).absolutePath();
+    foreach (const Include &include, includes(absoluteFilePath)) {
+        if (include.fileName.isEmpty())
+            return false;
+
+        QStringList searchPath;
+        if (include.isQuoted)
+            searchPath.append(includingDirectory);
+        searchPath += includeDirectories;
+        searchPath += systemIncludeDirectories;
+        QString includedFilePath;
+        foreach (const QString &directory, searchPath) {
+            const QString candidate = QDir::cleanPath(QDir(directory).absoluteFilePath(include.fileName));
+            if (FastFileInfo(candidate).exists()) {
+                includedFilePath = candidate;
+                break;
+            }
+        }
+        if (includedFilePath.isEmpty())
+            return false;
+        if (isSubDirectoryOf(includedFilePath, systemIncludeDirectories))
+            continue;
+
+        const QString visitedKey = includedFilePath.toLower();
+        if (visited->contains(visitedKey))
+            continue;
+        visited->insert(visitedKey);
+        const QByteArray includedContentHash = contentHash(includedFilePath);
+        if (includedContentHash.isEmpty())
+            return false;
+        hash->addData(include.fileName.toUtf8());
+        hash->addData("\n");
+        hash->addData(includedContentHash);
+        if (!addIncludedFiles(hash, includedFilePath, includeDirectories,
+                              systemIncludeDirectories, visited))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+QString ResultCache::entryFilePath(const QByteArray &key) const
+{
+    return m_directory + QLatin1Char('/') + QString::fromLatin1(key.left(2))
+            + QLatin1Char('/') + QString::fromLatin1(key);
+}
+
+/**
+ * Copies the output that was stored under key to outputFilePath.
+ */
+bool ResultCache::restore(const QByteArray &key, const QString &outputFilePath)
+{
+    const QString entry = entryFilePath(key);
+    if (!QFile::exists(entry))
+        return false;
+    QFile::remove(outputFilePath);
+    if (!QFile::copy(entry, outputFilePath))
+        return false;
+    touchFile(outputFilePath);
+    touchFile(entry);
+    return true;
+}
+
+void ResultCache::store(const QByteArray &key, const QString &outputFilePath)
+{
+    const QFileInfo outputFileInfo(outputFilePath);
+    if (!outputFileInfo.isFile())
+        return;
+
+    // Copy and rename, so that other jom processes never see half an entry.
+    const QString entry = entryFilePath(key);
+    QDir().mkpath(QFileInfo(entry).absolutePath());
+    const QString tempFilePath = entry + QLatin1Char('.')
+            + QString::number(QCoreApplication::applicationPid()) + QLatin1String(".tmp");
+    QFile::remove(tempFilePath);
+    if (!QFile::copy(outputFilePath, tempFilePath))
+        return;
+    QFile::remove(entry);
+    if (!QFile::rename(tempFilePath, entry)) {
+        QFile::remove(tempFilePath);
+        return;
+    }
+    touchFile(entry);
+
+    if (m_size >= 0)
+        m_size += outputFileInfo.size();
+    if (m_size < 0 || m_size > m_maxSize)
+        evict();
+}
+
+struct ResultCacheEntry
+{
+    QDateTime lastModified;
+    qint64 size;
+    QString filePath;
+
+    bool operator < (const ResultCacheEntry &rhs) const
+    {
+        return lastModified < rhs.lastModified;
+    }
+};
+
+/**
+ * Measures the size of the cache and removes the oldest entries until
+ * the cache is at 90% of its maximum size.
+ */
+void ResultCache::evict()
+{
+    QVector<ResultCacheEntry> entries;
+    qint64 size = 0;
+    QDirIterator it(m_directory, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo fileInfo = it.fileInfo();
+        ResultCacheEntry entry;
+        entry.lastModified = fileInfo.lastModified();
+        entry.size = fileInfo.size();
+        entry.filePath = fileInfo.filePath();
+        entries.append(entry);
+        size += entry.size;
+    }
+
+    if (size > m_maxSize) {
+        std::sort(entries.begin(), entries.end());
+        const qint64 targetSize = m_maxSize / 10 * 9;
+        for (int i = 0; i < entries.count() && size > targetSize; ++i) {
+            if (QFile::remove(entries.at(i).filePath))
+                size -= entries.at(i).size;
+        }
+    }
+    m_size = size;
+}
+
+} // namespace NMakeFile
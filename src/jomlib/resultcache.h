@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include "filetime.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+QT_BEGIN_NAMESPACE
+class QCryptographicHash;
+QT_END_NAMESPACE
+
+namespace NMakeFile {
+
+/**
+ * A directory that stores the outputs of targets under a hash of everything
+ * that went into building them.
+ *
+ * The directory is taken from JOMCACHEDIR and defaults to the jom folder in the
+ * user's cache location. The size limit in MiB is taken from JOMCACHESIZE.
+ * Entries that were least recently stored or restored are evicted first.
+ *
+ * Only the target file itself is stored. Targets with side outputs must not be cached.
+ */
+class ResultCache
+{
+public:
+    static ResultCache *instance();
+
+    QByteArray contentHash(const QString &filePath);
+    bool addIncludedFiles(QCryptographicHash *hash, const QString &sourceFilePath,
+                          const QStringList &includeDirectories,
+                          const QStringList &systemIncludeDirectories);
+    bool restore(const QByteArray &key, const QString &outputFilePath);
+    void store(const QByteArray &key, const QString &outputFilePath);
+
+private:
+    struct Include
+    {
+        QString fileName;   // empty if the directive cannot be evaluated
+        bool isQuoted;
+    };
+
+    ResultCache(const QString &directory, qint64 maxSize);
+    QString entryFilePath(const QByteArray &key) const;
+    void evict();
+    QList<Include> includes(const QString &absoluteFilePath);
+    bool addIncludedFiles(QCryptographicHash *hash, const QString &absoluteFilePath,
+                          const QStringList &includeDirectories,
+                          const QStringList &systemIncludeDirectories, QSet<QString> *visited);
+
+private:
+    QString m_directory;
+    qint64 m_maxSize;
+    qint64 m_size;
+    QHash<QString, QPair<FileTime, QByteArray> > m_contentHashes;
+    QHash<QString, QPair<FileTime, QList<Include> > > m_includes;
+};
+
+} // namespace NMakeFile
+
+#endif // RESULTCACHE_H
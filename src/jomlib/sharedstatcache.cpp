@@ -0,0 +1,380 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "sharedstatcache.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <windows.h>
+
+namespace NMakeFile {
+
+static const quint32 sharedStatCacheMagic = 0x4a53430b;
+static const quint32 sharedStatCacheCapacity = 16384;   // must be a power of two
+static const quint32 maxProbeCount = 64;
+static const quint32 invalidationLogSize = 256;         // must be a power of two
+
+enum SlotState
+{
+    EmptySlot = 0,
+    WritingSlot,
+    ValidSlot,
+    InvalidatedSlot
+};
+
+/**
+ * Records which path was invalidated in a generation. The all flag stands for invalidateAll().
+ */
+struct SharedStatCacheInvalidation
+{
+    volatile LONG generation;
+    quint32 pathHash;
+    quint32 all;
+};
+
+struct SharedStatCacheHeader
+{
+    quint32 magic;
+    quint32 capacity;
+    volatile LONG generation;
+    SharedStatCacheInvalidation invalidations[invalidationLogSize];
+};
+
+struct SharedStatCacheEntry
+{
+    volatile LONG state;
+    volatile LONG version;      // incremented whenever the slot is claimed
+    quint32 hash;
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    quint32 pathLength;
+    wchar_t path[MAX_PATH];
+};
+
+static_assert(sizeof(FastFileInfo::InternalType) == sizeof(WIN32_FILE_ATTRIBUTE_DATA),
+              "FastFileInfo::InternalType has wrong size");
+
+SharedStatCache *SharedStatCache::m_instance = 0;
+
+static inline LONG loadAcquire(volatile LONG *value)
+{
+    const LONG result = *value;
+    MemoryBarrier();
+    return result;
+}
+
+/**
+ * FNV-1a. The hash must be the same in all processes, which rules out qHash.
+ */
+static quint32 hashPath(const QString &path)
+{
+    quint32 hash = 2166136261u;
+    const ushort *p = path.utf16();
+    for (int i = path.length(); --i >= 0; ++p) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline QString normalizedPath(const QString &filePath)
+{
+    return filePath.toLower();
+}
+
+quint32 SharedStatCache::pathHash(const QString &filePath)
+{
+    return hashPath(normalizedPath(filePath));
+}
+
+static inline bool entryMatches(const SharedStatCacheEntry *entry, quint32 hash,
+                                const QString &path)
+{
+    return entry->hash == hash
+        && entry->pathLength == quint32(path.length())
+        && memcmp(entry->path, path.utf16(), path.length() * sizeof(wchar_t)) == 0;
+}
+
+static size_t mappingSize()
+{
+    return sizeof(SharedStatCacheHeader) + sharedStatCacheCapacity * sizeof(SharedStatCacheEntry);
+}
+
+SharedStatCache::SharedStatCache(const QString &name, Qt::HANDLE hMapping, void *view)
+    : m_name(name)
+    , m_hMapping(hMapping)
+    , m_header(static_cast<SharedStatCacheHeader *>(view))
+{
+}
+
+SharedStatCache::~SharedStatCache()
+{
+    if (m_instance == this)
+        m_instance = 0;
+    UnmapViewOfFile(m_header);
+    CloseHandle(m_hMapping);
+}
+
+/**
+ * Creates the shared cache of this process. Returns false if that fails.
+ */
+bool SharedStatCache::create()
+{
+    if (m_instance)
+        return true;
+
+    const QString name = QLatin1String("jomstatcache-")
+            + QString::number(QCoreApplication::applicationPid());
+    const quint64 size = mappingSize();
+    HANDLE hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                         DWORD(size >> 32), DWORD(size),
+                                         reinterpret_cast<const wchar_t *>(name.utf16()));
+    if (!hMapping)
+        return false;
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(hMapping);
+        return false;
+    }
+    void *view = MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!view) {
+        CloseHandle(hMapping);
+        return false;
+    }
+
+    // The pages of a new mapping are zero. All slots are empty.
+    SharedStatCacheHeader *header = static_cast<SharedStatCacheHeader *>(view);
+    header->capacity = sharedStatCacheCapacity;
+    header->magic = sharedStatCacheMagic;
+    m_instance = new SharedStatCache(name, hMapping, view);
+    return true;
+}
+
+/**
+ * Attaches to the shared cache of the top-level jom process.
+ */
+bool SharedStatCache::attach(const QString &name)
+{
+    if (m_instance)
+        return m_instance->m_name == name;
+
+    HANDLE hMapping = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE,
+                                       reinterpret_cast<const wchar_t *>(name.utf16()));
+    if (!hMapping)
+        return false;
+    void *view = MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!view) {
+        CloseHandle(hMapping);
+        return false;
+    }
+    SharedStatCacheHeader *header = static_cast<SharedStatCacheHeader *>(view);
+    if (header->magic != sharedStatCacheMagic || header->capacity != sharedStatCacheCapacity) {
+        UnmapViewOfFile(view);
+        CloseHandle(hMapping);
+        return false;
+    }
+    m_instance = new SharedStatCache(name, hMapping, view);
+    return true;
+}
+
+/**
+ * Tells the child processes which shared cache to attach to.
+ */
+void SharedStatCache::advertise(ProcessEnvironment *environment) const
+{
+    environment->insert(environmentVariableName(), m_name);
+}
+
+SharedStatCacheEntry *SharedStatCache::entryAt(quint32 index) const
+{
+    SharedStatCacheEntry *entries = reinterpret_cast<SharedStatCacheEntry *>(m_header + 1);
+    return &entries[index & (sharedStatCacheCapacity - 1)];
+}
+
+quint32 SharedStatCache::generation() const
+{
+    return quint32(loadAcquire(&m_header->generation));
+}
+
+bool SharedStatCache::find(const QString &filePath, FastFileInfo::InternalType *attributes) const
+{
+    const QString path = normalizedPath(filePath);
+    const quint32 hash = hashPath(path);
+    for (quint32 i = 0; i < maxProbeCount; ++i) {
+        SharedStatCacheEntry *entry = entryAt(hash + i);
+        const LONG version = loadAcquire(&entry->version);
+        const LONG state = loadAcquire(&entry->state);
+        if (state == EmptySlot)
+            return false;
+        if (state != ValidSlot || !entryMatches(entry, hash, path))
+            continue;
+        memcpy(attributes, &entry->attributes, sizeof(WIN32_FILE_ATTRIBUTE_DATA));
+        // The entry might have been invalidated or reused while we were reading it.
+        MemoryBarrier();
+        if (loadAcquire(&entry->state) == ValidSlot && entry->version == version)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Claims an empty or invalidated slot for writing.
+ */
+static bool claimSlot(SharedStatCacheEntry *entry, LONG state)
+{
+    if (InterlockedCompareExchange(&entry->state, WritingSlot, state) != state)
+        return false;
+    InterlockedIncrement(&entry->version);
+    return true;
+}
+
+/**
+ * Adds the attributes of a file. The generation must be read before the attributes.
+ * If an invalidation happened in between, the new entry is invalidated right away.
+ * The first invalidated slot of the probe sequence is reused, unless the file
+ * has a valid entry further on.
+ */
+void SharedStatCache::insert(const QString &filePath, const FastFileInfo::InternalType &attributes,
+                             quint32 generation)
+{
+    const QString path = normalizedPath(filePath);
+    if (path.length() > MAX_PATH)
+        return;
+
+    const quint32 hash = hashPath(path);
+    SharedStatCacheEntry *entry = 0;
+    LONG entryState = EmptySlot;
+    for (quint32 i = 0; i < maxProbeCount; ++i) {
+        SharedStatCacheEntry *candidate = entryAt(hash + i);
+        const LONG state = loadAcquire(&candidate->state);
+        if (state == ValidSlot && entryMatches(candidate, hash, path))
+            return;
+        if (state != EmptySlot && state != InvalidatedSlot)
+            continue;
+        if (!entry) {
+            entry = candidate;
+            entryState = state;
+        }
+        // There are no entries after an empty slot.
+        if (state == EmptySlot)
+            break;
+    }
+    if (!entry || !claimSlot(entry, entryState))
+        return;
+
+    entry->hash = hash;
+    entry->pathLength = path.length();
+    memcpy(entry->path, path.utf16(), path.length() * sizeof(wchar_t));
+    memcpy(&entry->attributes, &attributes, sizeof(WIN32_FILE_ATTRIBUTE_DATA));
+    InterlockedExchange(&entry->state, ValidSlot);
+    if (this->generation() != generation)
+        InterlockedCompareExchange(&entry->state, InvalidatedSlot, ValidSlot);
+}
+
+void SharedStatCache::logInvalidation(quint32 pathHash, bool all)
+{
+    const LONG generation = InterlockedIncrement(&m_header->generation);
+    SharedStatCacheInvalidation &invalidation
+            = m_header->invalidations[quint32(generation) & (invalidationLogSize - 1)];
+    InterlockedExchange(&invalidation.generation, 0);
+    invalidation.pathHash = pathHash;
+    invalidation.all = all;
+    InterlockedExchange(&invalidation.generation, generation);
+}
+
+/**
+ * Collects the hashes of the paths that were invalidated after fromGeneration
+ * up to and including toGeneration.
+ * Returns false if that is not known anymore or if everything was invalidated.
+ * Then the whole private cache must be dropped.
+ */
+bool SharedStatCache::invalidatedPathHashes(quint32 fromGeneration, quint32 toGeneration,
+                                            QSet<quint32> *pathHashes) const
+{
+    if (toGeneration - fromGeneration > invalidationLogSize)
+        return false;
+    for (quint32 g = fromGeneration + 1; g != toGeneration + 1; ++g) {
+        SharedStatCacheInvalidation &invalidation
+                = m_header->invalidations[g & (invalidationLogSize - 1)];
+        if (quint32(loadAcquire(&invalidation.generation)) != g)
+            return false;
+        const quint32 pathHash = invalidation.pathHash;
+        const bool all = invalidation.all;
+        MemoryBarrier();
+        if (all || quint32(invalidation.generation) != g)
+            return false;
+        pathHashes->insert(pathHash);
+    }
+    return true;
+}
+
+void SharedStatCache::invalidate(const QString &filePath)
+{
+    const QString path = normalizedPath(filePath);
+    const quint32 hash = hashPath(path);
+
+    // Incrementing the generation first makes concurrent inserts of this file
+    // either visible to the loop below or invalidate themselves.
+    logInvalidation(hash, false);
+
+    for (quint32 i = 0; i < maxProbeCount; ++i) {
+        SharedStatCacheEntry *entry = entryAt(hash + i);
+        const LONG state = loadAcquire(&entry->state);
+        if (state == EmptySlot)
+            return;
+        if (state == ValidSlot && entryMatches(entry, hash, path))
+            InterlockedCompareExchange(&entry->state, InvalidatedSlot, ValidSlot);
+    }
+}
+
+void SharedStatCache::invalidateAll()
+{
+    logInvalidation(0, true);
+    for (quint32 i = 0; i < sharedStatCacheCapacity; ++i)
+        InterlockedCompareExchange(&entryAt(i)->state, InvalidatedSlot, ValidSlot);
+}
+
+/**
+ * Invalidates the entries of all files that are not below the directory.
+ * Every path is logged on its own. The private caches keep their other entries.
+ */
+void SharedStatCache::invalidateOutside(const QString &directory)
+{
+    QString prefix = normalizedPath(directory);
+    if (!prefix.endsWith(QLatin1Char('\\')))
+        prefix.append(QLatin1Char('\\'));
+
+    QStringList filePaths;
+    for (quint32 i = 0; i < sharedStatCacheCapacity; ++i) {
+        SharedStatCacheEntry *entry = entryAt(i);
+        if (loadAcquire(&entry->state) != ValidSlot)
+            continue;
+        const QString path = QString::fromWCharArray(entry->path, int(entry->pathLength));
+        if (!path.startsWith(prefix))
+            filePaths.append(path);
+    }
+    foreach (const QString &filePath, filePaths)
+        invalidate(filePath);
+}
+
+} // namespace NMakeFile
@@ -0,0 +1,88 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef SHAREDSTATCACHE_H
+#define SHAREDSTATCACHE_H
+
+#include "fastfileinfo.h"
+#include "processenvironment.h"
+#include <QtCore/QSet>
+#include <QtCore/QString>
+
+namespace NMakeFile {
+
+struct SharedStatCacheHeader;
+struct SharedStatCacheEntry;
+
+/**
+ * A file attribute cache in shared memory that the top-level jom creates with /SHAREDSTATCACHE
+ * and the sub-jom processes attach to.
+ *
+ * The cache is a hash table with open addressing. Entries are never moved.
+ * A slot is claimed with an atomic compare-and-swap, filled, and then marked valid.
+ * Readers take no locks. Invalidated slots are reused by later inserts.
+ * Every invalidation increments a generation counter and is recorded in a
+ * small log. The processes compare the counter with the one they last saw and
+ * drop the invalidated paths from their private caches.
+ */
+class SharedStatCache
+{
+public:
+    ~SharedStatCache();
+
+    static SharedStatCache *instance() { return m_instance; }
+    static bool create();
+    static bool attach(const QString &name);
+    static QLatin1String environmentVariableName() { return QLatin1String("_JOMSTATCACHE_"); }
+    static quint32 pathHash(const QString &filePath);
+    void advertise(ProcessEnvironment *environment) const;
+
+    const QString &name() const { return m_name; }
+    quint32 generation() const;
+    bool find(const QString &filePath, FastFileInfo::InternalType *attributes) const;
+    void insert(const QString &filePath, const FastFileInfo::InternalType &attributes,
+                quint32 generation);
+    void invalidate(const QString &filePath);
+    void invalidateAll();
+    void invalidateOutside(const QString &directory);
+    bool invalidatedPathHashes(quint32 fromGeneration, quint32 toGeneration,
+                               QSet<quint32> *pathHashes) const;
+
+private:
+    SharedStatCache(const QString &name, Qt::HANDLE hMapping, void *view);
+
+    void logInvalidation(quint32 pathHash, bool all);
+    SharedStatCacheEntry *entryAt(quint32 index) const;
+
+private:
+    static SharedStatCache *m_instance;
+    QString m_name;
+    Qt::HANDLE m_hMapping;
+    SharedStatCacheHeader *m_header;
+};
+
+} // namespace NMakeFile
+
+#endif // SHAREDSTATCACHE_H
@@ -0,0 +1,130 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QtCore/QAtomicPointer>
+
+namespace NMakeFile {
+
+/**
+ * An unbounded queue for exactly one producer thread and one consumer thread
+ * that doesn't need locks.
+ *
+ * The consumer leaves dequeued nodes in the list. The producer reuses them
+ * once it sees that the consumer has moved past them, so that a steady
+ * stream of items doesn't allocate.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+    SpscQueue()
+    {
+        Node *node = new Node;
+        m_tail.store(node);
+        m_head = m_first = m_tailCopy = node;
+    }
+
+    ~SpscQueue()
+    {
+        while (m_first) {
+            Node *next = m_first->next.load();
+            delete m_first;
+            m_first = next;
+        }
+    }
+
+    /**
+     * Appends an item. Must only be called by the producer thread.
+     */
+    void enqueue(const T &value)
+    {
+        Node *node = allocateNode();
+        node->value = value;
+        node->next.store(0);
+        m_head->next.storeRelease(node);
+        m_head = node;
+    }
+
+    /**
+     * Returns the first item or 0 if the queue is empty.
+     * Must only be called by the consumer thread.
+     */
+    T *front() const
+    {
+        Node *next = m_tail.load()->next.loadAcquire();
+        return next ? &next->value : 0;
+    }
+
+    /**
+     * Removes the first item. Must only be called by the consumer thread.
+     */
+    bool dequeue(T *value)
+    {
+        Node *tail = m_tail.load();
+        Node *next = tail->next.loadAcquire();
+        if (!next)
+            return false;
+        *value = next->value;
+        next->value = T();
+        m_tail.storeRelease(next);
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        QAtomicPointer<Node> next;
+        T value;
+    };
+
+    Node *allocateNode()
+    {
+        if (m_first == m_tailCopy) {
+            m_tailCopy = m_tail.loadAcquire();
+            if (m_first == m_tailCopy)
+                return new Node;
+        }
+        Node *node = m_first;
+        m_first = m_first->next.load();
+        return node;
+    }
+
+    Q_DISABLE_COPY(SpscQueue)
+
+    // Written by the consumer.
+    QAtomicPointer<Node> m_tail;    // the last node that has been dequeued
+
+    // Written by the producer.
+    Node *m_head;                   // the last node that has been enqueued
+    Node *m_first;                  // the oldest node that can be reused
+    Node *m_tailCopy;
+};
+
+} // namespace NMakeFile
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,211 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "submake.h"
+#include "commandexecutor.h"
+#include "exception.h"
+#include "fastfileinfo.h"
+#include "helperfunctions.h"
+#include "macrotable.h"
+#include "makefile.h"
+#include "makefilefactory.h"
+#include "options.h"
+#include "targetexecutor.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QRegExp>
+
+namespace NMakeFile {
+
+SubMake::SubMake(const ProcessEnvironment &environment, CommandExecutor *parent)
+    : QObject(parent)
+    , m_parentExecutor(parent)
+    , m_environment(environment)
+    , m_makefile(0)
+    , m_executor(0)
+{
+}
+
+SubMake::~SubMake()
+{
+    delete m_executor;
+    delete m_makefile;
+}
+
+/**
+ * Checks whether the command line is a plain invocation of makeProgram,
+ * optionally preceded by "cd <directory> &&".
+ * Command lines that need the shell for anything else are rejected.
+ */
+bool SubMake::parseCommandLine(const QString &commandLine, const QString &makeProgram,
+                               QString *workingDirectory, QStringList *arguments)
+{
+    QString makeCommandLine = commandLine.trimmed();
+    workingDirectory->clear();
+
+    static QRegExp rexChangeDirectory(QLatin1String(
+        "^cd\\s+(/d\\s+)?(\"[^\"]*\"|[^\\s&|<>\"]+)\\s*&&\\s*"),
+        Qt::CaseInsensitive, QRegExp::RegExp2);
+    if (rexChangeDirectory.indexIn(makeCommandLine) == 0) {
+        *workingDirectory = rexChangeDirectory.cap(2);
+        removeDoubleQuotes(*workingDirectory);
+        makeCommandLine.remove(0, rexChangeDirectory.matchedLength());
+    }
+
+    static QRegExp rexShellSyntax(QLatin1String("[|&<>^%()]"));
+    if (rexShellSyntax.indexIn(makeCommandLine) >= 0)
+        return false;
+
+    QStringList args = splitCommandLine(makeCommandLine);
+    if (args.isEmpty())
+        return false;
+
+    QString expectedProgram = makeProgram;
+    removeDoubleQuotes(expectedProgram);
+    const QString program = args.takeFirst();
+    if (QDir::fromNativeSeparators(program).compare(QDir::fromNativeSeparators(expectedProgram),
+                                                    Qt::CaseInsensitive) != 0)
+    {
+        return false;
+    }
+
+    *arguments = args;
+    return true;
+}
+
+/**
+ * Returns false for arguments that make a sub-jom behave differently from a plain build,
+ * e.g. printing the usage or creating its own job server.
+ */
+bool SubMake::canRunInProcess(const QStringList &arguments) const
+{
+    int inheritedMaxNumberOfJobs = g_options.maxNumberOfJobs;
+    bool ok;
+    const int n = m_environment.value(QLatin1String("_JOMJOBCOUNT_")).toInt(&ok);
+    if (ok && n > 0)
+        inheritedMaxNumberOfJobs = n;
+
+    GlobalOptions globalOptions;
+    Options options;
+    MacroTable macroTable;
+    QString makefile;
+    QStringList targets;
+    const bool argumentsValid = options.readCommandLineArguments(arguments, makefile, targets,
+                                                                 macroTable, &globalOptions);
+    const bool jobCountChanged = globalOptions.isMaxNumberOfJobsSet
+            && globalOptions.maxNumberOfJobs != inheritedMaxNumberOfJobs;
+
+    return argumentsValid
+            && !jobCountChanged
+            && !options.showUsageAndExit
+            && !options.showVersionAndExit
+            && !options.displayMakeInformation
+            && !options.dumpDependencyGraph
+            && !options.printWorkingDir
+            && !options.watchMode
+            && options.stderrFile.isEmpty();
+}
+
+/**
+ * Reads the makefile in the given directory and starts building.
+ * Returns false if the invocation cannot run in-process. Nothing has been
+ * output then, and the caller must start a separate jom process.
+ */
+bool SubMake::start(const QString &workingDirectory, const QStringList &arguments)
+{
+    QString directory = QDir::currentPath();
+    if (!workingDirectory.isEmpty()) {
+        QFileInfo fi(workingDirectory);
+        if (!fi.isDir())
+            return false;
+        directory = fi.absoluteFilePath();
+    }
+    CurrentDirectoryScope directoryScope(directory);
+
+    QStringList commandLineArguments = arguments;
+    QString makeFlags = m_environment.value(QLatin1String("JOMFLAGS"));
+    if (makeFlags.isEmpty())
+        makeFlags = m_environment.value(QLatin1String("MAKEFLAGS"));
+    if (!makeFlags.isEmpty())
+        commandLineArguments.prepend(QLatin1Char('/') + makeFlags);
+    if (!canRunInProcess(commandLineArguments))
+        return false;
+
+    GlobalOptions globalOptions = g_options;
+    MakefileFactory factory;
+    factory.setEnvironment(m_environment);
+    factory.setGlobalOptions(&globalOptions);
+    Options *options = 0;
+    const bool makefileRead = factory.apply(commandLineArguments, &options);
+    m_makefile = factory.makefile();
+    if (!makefileRead) {
+        fail("Error: " + factory.errorString().toLocal8Bit() + '\n');
+        return true;
+    }
+
+    options->runSubMakesInProcess = true;
+    m_executor = new TargetExecutor(m_makefile->macroTable()->environment());
+    m_executor->setOutputTarget(m_parentExecutor);
+    if (m_makefile->isParallelExecutionDisabled()) {
+        m_parentExecutor->writeToStandardOutput("jom: parallel job execution disabled for "
+                                                + m_makefile->fileName().toLocal8Bit() + '\n');
+        m_executor->setMaxNumberOfJobs(1);
+    }
+    connect(m_executor, &TargetExecutor::finished, this, &SubMake::onExecutorFinished,
+            Qt::QueuedConnection);
+
+    try {
+        m_executor->apply(m_makefile, factory.activeTargets());
+    } catch (const Exception &e) {
+        fail("jom: " + e.message().toLocal8Bit() + '\n');
+    }
+    return true;
+}
+
+/**
+ * Writes the error message and lets the sub-make finish with exit code 2.
+ */
+void SubMake::fail(const QByteArray &message)
+{
+    m_parentExecutor->writeToStandardError(message);
+    QMetaObject::invokeMethod(this, "onExecutorFinished", Qt::QueuedConnection, Q_ARG(int, 2));
+}
+
+/**
+ * Kills the running commands of the sub-make. The finished signal is not emitted.
+ */
+void SubMake::abort()
+{
+    if (m_executor)
+        m_executor->abort();
+}
+
+void SubMake::onExecutorFinished(int exitCode)
+{
+    emit finished(exitCode);
+}
+
+} // namespace NMakeFile
@@ -0,0 +1,76 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef SUBMAKE_H
+#define SUBMAKE_H
+
+#include "processenvironment.h"
+#include <QObject>
+#include <QStringList>
+
+namespace NMakeFile {
+
+class CommandExecutor;
+class Makefile;
+class TargetExecutor;
+
+/**
+ * Runs a recursive $(MAKE) invocation inside the current jom process.
+ * The sub-make has its own makefile, macro table and dependency graph,
+ * and shares the job server and the file info cache with its parent.
+ * All of its output goes through the executor that runs the $(MAKE) command.
+ */
+class SubMake : public QObject
+{
+    Q_OBJECT
+public:
+    SubMake(const ProcessEnvironment &environment, CommandExecutor *parent);
+    ~SubMake();
+
+    static bool parseCommandLine(const QString &commandLine, const QString &makeProgram,
+                                 QString *workingDirectory, QStringList *arguments);
+
+    bool start(const QString &workingDirectory, const QStringList &arguments);
+    void abort();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void onExecutorFinished(int exitCode);
+
+private:
+    bool canRunInProcess(const QStringList &arguments) const;
+    void fail(const QByteArray &message);
+
+    CommandExecutor *m_parentExecutor;
+    ProcessEnvironment m_environment;
+    Makefile *m_makefile;
+    TargetExecutor *m_executor;
+};
+
+} // namespace NMakeFile
+
+#endif // SUBMAKE_H
@@ -24,42 +24,135 @@
 ****************************************************************************/
 
 #include "targetexecutor.h"
+#include "buildhistory.h"
+#include "buildtrace.h"
 #include "commandexecutor.h"
+#include "consolewriter.h"
+#include "counters.h"
 #include "dependencygraph.h"
 #include "jobclient.h"
 #include "options.h"
+#include "outputbuffer.h"
 #include "exception.h"
+#include "fastfileinfo.h"
+#include "helperfunctions.h"
+#include "remoteworker.h"
 
 #include <QDebug>
+#include <QDir>
+#include <QFile>
 #include <QTextStream>
 #include <QCoreApplication>
 
+#include <stdarg.h>
+
 namespace NMakeFile {
 
 TargetExecutor::TargetExecutor(const ProcessEnvironment &environment)
     : m_environment(environment)
     , m_jobClient(0)
+    , m_outputTarget(0)
+    , m_maxNumberOfJobs(g_options.maxNumberOfJobs)
     , m_bAborted(false)
     , m_allCommandsSuccessfullyExecuted(true)
+    , m_remoteSlotCount(0)
+    , m_remoteJobCount(0)
+    , m_remoteJobsStarted(0)
+    , m_progressOnConsole(false)
 {
     m_makefile = 0;
     m_depgraph = new DependencyGraph();
+    connect(&m_progressTimer, &QTimer::timeout, this, &TargetExecutor::updateProgress);
 
-    for (int i = 0; i < g_options.maxNumberOfJobs; ++i) {
-        CommandExecutor* executor = new CommandExecutor(this, environment);
-        connect(executor, SIGNAL(finished(CommandExecutor*, bool)),
-                this, SLOT(onChildFinished(CommandExecutor*, bool)));
+    // Further executors are created when there are targets for them.
+    m_availableProcesses.append(createCommandExecutor());
+    m_availableProcesses.first()->setBufferedOutput(false);
+}
 
-        foreach (CommandExecutor *other, m_processes) {
-            connect(executor, SIGNAL(environmentChanged(const ProcessEnvironment &)),
-                    other, SLOT(setEnvironment(const ProcessEnvironment &)));
-            connect(other, SIGNAL(environmentChanged(const ProcessEnvironment &)),
-                    executor, SLOT(setEnvironment(const ProcessEnvironment &)));
-        }
-        m_processes.append(executor);
+CommandExecutor *TargetExecutor::createCommandExecutor()
+{
+    CommandExecutor* executor = new CommandExecutor(this, m_environment);
+    executor->setSlot(m_processes.count() + 1);
+    executor->setOutputTarget(m_outputTarget);
+    BuildTrace::setSlotName(executor->slot(),
+                            QLatin1String("job slot ") + QString::number(executor->slot()));
+    connect(executor, SIGNAL(finished(CommandExecutor*, bool)),
+            this, SLOT(onChildFinished(CommandExecutor*, bool)));
+    connect(executor, SIGNAL(environmentChanged(const ProcessEnvironment &)),
+            this, SLOT(onEnvironmentChanged(const ProcessEnvironment &)));
+
+    foreach (CommandExecutor *other, m_processes) {
+        connect(executor, SIGNAL(environmentChanged(const ProcessEnvironment &)),
+                other, SLOT(setEnvironment(const ProcessEnvironment &)));
+        connect(other, SIGNAL(environmentChanged(const ProcessEnvironment &)),
+                executor, SLOT(setEnvironment(const ProcessEnvironment &)));
+    }
+    m_processes.append(executor);
+    return executor;
+}
+
+/**
+ * Executors that are created later start with the environment that the
+ * commands of the other executors have set up.
+ */
+void TargetExecutor::onEnvironmentChanged(const ProcessEnvironment &environment)
+{
+    m_environment = environment;
+}
+
+/**
+ * Sends the output of all commands and the messages of this executor to the
+ * given command executor. Used for in-process sub-makes.
+ */
+void TargetExecutor::setOutputTarget(CommandExecutor *target)
+{
+    m_outputTarget = target;
+    foreach (CommandExecutor *executor, m_processes)
+        executor->setOutputTarget(target);
+}
+
+/**
+ * Sets targets that are known to be up to date, e.g. from the previous build of /WATCH.
+ * The dependency graph is not built below them.
+ */
+void TargetExecutor::setUpToDateTargets(const QSet<DescriptionBlock *> &targets)
+{
+    m_depgraph->setUpToDateTargets(targets);
+}
+
+void TargetExecutor::writeMessage(const QByteArray &message)
+{
+    if (m_outputTarget)
+        m_outputTarget->writeToStandardError(message);
+    else
+        ConsoleWriter::writeText(stderr, message);
+}
+
+void TargetExecutor::printMessage(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    if (m_outputTarget) {
+        char message[1024];
+        qvsnprintf(message, sizeof(message), format, args);
+        m_outputTarget->writeToStandardError(message);
+    } else {
+        vfprintf(stderr, format, args);
+    }
+    va_end(args);
+}
+
+/**
+ * Adds the slots of the worker daemons as extra capacity on top of the job tokens.
+ * Targets whose commands can run remotely are sent to a free slot when no
+ * job token is available.
+ */
+void TargetExecutor::setRemoteWorkerPool(RemoteWorkerPool *pool)
+{
+    foreach (RemoteSlot *remoteSlot, pool->remoteSlots()) {
+        m_availableRemoteSlots.append(remoteSlot);
+        m_remoteSlotCount++;
     }
-    m_availableProcesses = m_processes;
-    m_availableProcesses.first()->setBufferedOutput(false);
 }
 
 TargetExecutor::~TargetExecutor()
@@ -73,7 +166,18 @@ void TargetExecutor::apply(Makefile* mkfile, const QStringList& targets)
     m_allCommandsSuccessfullyExecuted = true;
     m_makefile = mkfile;
     m_jobAcquisitionCount = 0;
-    m_nextTarget = 0;
+    m_lastJobFinishedTime = -1;
+    m_dispatchGapSum = 0;
+    m_dispatchGapMax = 0;
+    m_dispatchGapCount = 0;
+    m_fullOccupancyTime = -1;
+    m_remoteJobsStarted = 0;
+    m_dispatchTimer.start();
+
+    // With in-process sub-makes the current directory is switched between the makefiles.
+    m_workingDirectory = mkfile->options()->runSubMakesInProcess
+            ? QDir::currentPath() : QString();
+    CurrentDirectoryScope directoryScope(m_workingDirectory);
 
     if (!m_jobClient) {
         m_jobClient = new JobClient(&m_environment, this);
@@ -103,6 +207,13 @@ void TargetExecutor::apply(Makefile* mkfile, const QStringList& targets)
         }
     }
 
+    if (m_makefile->options()->showProgress) {
+        // On a console the line is redrawn in place, otherwise it's printed now and then.
+        m_depgraph->setBuildHistory(BuildHistory::instance());
+        m_progressOnConsole = ConsoleWriter::isConsole(stderr);
+        m_progressTimer.start(m_progressOnConsole ? 250 : 2000);
+    }
+
     m_depgraph->build(descblock);
     if (m_makefile->options()->dumpDependencyGraph) {
         if (m_makefile->options()->dumpDependencyGraphDot)
@@ -118,23 +229,18 @@ void TargetExecutor::apply(Makefile* mkfile, const QStringList& targets)
 
 void TargetExecutor::startProcesses()
 {
-    if (m_bAborted || m_jobClient->isAcquiring() || m_availableProcesses.isEmpty())
+    if (m_bAborted)
         return;
 
+    CurrentDirectoryScope directoryScope(m_workingDirectory);
+
     try {
-        if (!m_nextTarget)
-            findNextTarget();
+        prepareNextTargets();
 
-        if (m_nextTarget) {
-            if (numberOfRunningProcesses() == 0) {
-                // Use up the internal job token.
-                buildNextTarget();
-            } else {
-                // Acquire a job token from the server. Will call buildNextTarget() when done.
-                m_jobAcquisitionCount++;
-                m_jobClient->asyncAcquire();
-            }
-        } else {
+        if (m_preparedProcesses.isEmpty()) {
+            // Free job slots that wait for dependencies don't count as dispatch gap.
+            m_lastJobFinishedTime = -1;
+            m_jobClient->setDemand(0);
             if (numberOfRunningProcesses() == 0) {
                 if (m_pendingTargets.isEmpty()) {
                     finishBuild(0);
@@ -145,39 +251,186 @@ void TargetExecutor::startProcesses()
                     QMetaObject::invokeMethod(this, "startProcesses", Qt::QueuedConnection);
                 }
             }
+            return;
+        }
+
+        if (m_jobClient->isAcquiring())
+            return;
+
+        // Start as many targets as there are job tokens available right now.
+        while (!m_bAborted && !m_preparedProcesses.isEmpty()) {
+            RemoteSlot *remoteSlot = 0;
+            if (numberOfRunningProcesses() == m_remoteJobCount) {
+                // Use up the internal job token.
+            } else if (m_jobClient->tryAcquire()) {
+                m_jobAcquisitionCount++;
+            } else if (!(remoteSlot = takeRemoteSlot(m_preparedProcesses.first()))) {
+                break;
+            }
+            startPreparedTarget(remoteSlot);
+            prepareNextTargets();
+        }
+
+        // Keep job tokens for the prepared targets in the client's reserve.
+        m_jobClient->setDemand(m_preparedProcesses.count());
+
+        if (!m_bAborted && !m_preparedProcesses.isEmpty()) {
+            // Acquire job tokens from the server. Will call buildNextTarget() when done.
+            m_jobAcquisitionCount++;
+            m_jobClient->asyncAcquire(m_preparedProcesses.count());
         }
     } catch (Exception &e) {
         m_bAborted = true;
-        fprintf(stderr, "Error: %s\n", qPrintable(e.message()));
+        writeMessage("Error: " + e.message().toLocal8Bit() + '\n');
         finishBuild(1);
     }
 }
 
 void TargetExecutor::buildNextTarget()
 {
-    Q_ASSERT(m_nextTarget);
-
     if (m_bAborted)
         return;
 
+    Q_ASSERT(!m_preparedProcesses.isEmpty());
+
+    CurrentDirectoryScope directoryScope(m_workingDirectory);
     try {
-        CommandExecutor *executor = m_availableProcesses.takeFirst();
-        executor->start(m_nextTarget);
-        m_nextTarget = 0;
+        startPreparedTarget();
         QMetaObject::invokeMethod(this, "startProcesses", Qt::QueuedConnection);
     } catch (const Exception &e) {
         m_bAborted = true;
-        fprintf(stderr, "Error: %s\n", qPrintable(e.message()));
+        writeMessage("Error: " + e.message().toLocal8Bit() + '\n');
         finishBuild(1);
     }
 }
 
+void TargetExecutor::startPreparedTarget(RemoteSlot *remoteSlot)
+{
+    const qint64 now = m_dispatchTimer.nsecsElapsed();
+    if (m_lastJobFinishedTime >= 0) {
+        const qint64 gap = now - m_lastJobFinishedTime;
+        m_dispatchGapSum += gap;
+        m_dispatchGapMax = qMax(m_dispatchGapMax, gap);
+        m_dispatchGapCount++;
+        m_lastJobFinishedTime = -1;
+    }
+
+    CommandExecutor *executor = m_preparedProcesses.takeFirst();
+    executor->setRemoteSlot(remoteSlot);
+    if (remoteSlot) {
+        m_remoteJobCount++;
+        m_remoteJobsStarted++;
+    }
+    applyOutputSync(executor);
+    CurrentDirectoryScope directoryScope(executor->target()->makefile()->workingDirectory());
+    executor->start(executor->target());
+
+    if (m_fullOccupancyTime < 0 && maxNumberOfProcesses() > 1
+        && numberOfRunningProcesses() == maxNumberOfProcesses())
+    {
+        m_fullOccupancyTime = m_dispatchTimer.nsecsElapsed();
+    }
+}
+
+/**
+ * Sets up how the output of the executor's next target is written if an output
+ * synchronization mode has been selected with /O.
+ */
+void TargetExecutor::applyOutputSync(CommandExecutor *executor)
+{
+    bool buffered = true;
+    bool lineBuffered = false;
+    switch (m_makefile->options()->outputSync) {
+    case Options::OutputSyncForeground:
+        return;
+    case Options::OutputSyncNone:
+        buffered = false;
+        break;
+    case Options::OutputSyncLine:
+        buffered = false;
+        lineBuffered = true;
+        break;
+    case Options::OutputSyncTarget:
+        // Sub-makes synchronize the output of their targets themselves.
+        buffered = !executor->runsSubMake();
+        lineBuffered = !buffered;
+        break;
+    case Options::OutputSyncRecurse:
+        break;
+    }
+    executor->setBufferedOutput(buffered);
+    executor->setLineBufferedOutput(lineBuffered);
+}
+
 void TargetExecutor::waitForProcesses()
 {
     foreach (CommandExecutor* process, m_processes)
         process->waitForFinished();
 }
 
+/**
+ * Kills all running commands, removes their incomplete targets and temporary files
+ * and gives back the job tokens.
+ */
+void TargetExecutor::abortProcesses()
+{
+    QList<CommandExecutor *> abortedExecutors;
+    foreach (CommandExecutor *executor, m_processes) {
+        if (executor->isActive()) {
+            executor->abort();
+            abortedExecutors.append(executor);
+        }
+    }
+    foreach (CommandExecutor *executor, abortedExecutors) {
+        executor->waitForFinished();
+        deleteIncompleteTarget(executor->target());
+        returnRemoteSlot(executor);
+        m_availableProcesses.append(executor);
+    }
+    while (m_jobAcquisitionCount > 0) {
+        m_jobClient->release();
+        m_jobAcquisitionCount--;
+    }
+    removeTempFiles();
+}
+
+/**
+ * Deletes the target file of an aborted command if it has been touched by the command.
+ * Targets that are marked as .PRECIOUS are kept.
+ */
+void TargetExecutor::deleteIncompleteTarget(DescriptionBlock *target)
+{
+    if (target->makefile()->preciousTargets().contains(target->targetName()))
+        return;
+
+    CurrentDirectoryScope directoryScope(target->makefile()->workingDirectory());
+    FastFileInfo::clearCacheForFile(target->targetName());
+    FastFileInfo fi(target->targetName());
+    if (!fi.exists() || (target->m_bFileExists && fi.lastModified() == target->m_timeStamp))
+        return;
+
+    QString fileName = target->targetName();
+    removeDoubleQuotes(fileName);
+    writeMessage("jom: Deleting incomplete target '" + fileName.toLocal8Bit() + "'.\n");
+    QFile::remove(fileName);
+}
+
+/**
+ * Stops the build without emitting finished().
+ * Running commands are killed like with /FAILFAST.
+ */
+void TargetExecutor::abort()
+{
+    CurrentDirectoryScope directoryScope(m_workingDirectory);
+    m_bAborted = true;
+    discardPreparedTargets();
+    m_depgraph->clear();
+    m_pendingTargets.clear();
+    abortProcesses();
+    if (m_jobClient)
+        waitForJobClient();
+}
+
 void TargetExecutor::waitForJobClient()
 {
     if (!m_jobClient->isAcquiring())
@@ -190,6 +443,51 @@ void TargetExecutor::waitForJobClient()
 
 void TargetExecutor::finishBuild(int exitCode)
 {
+    if (m_progressTimer.isActive()) {
+        m_progressTimer.stop();
+        ConsoleWriter::setStatusLine(QByteArray());
+        BuildHistory::instance()->save();
+    }
+    ConsoleWriter::flush();
+    if (m_makefile && m_makefile->options()->debugMode && m_dispatchGapCount > 0) {
+        printMessage("jom: %d jobs started after a job finished, "
+                     "average gap %.3f ms, maximum gap %.3f ms\n",
+                     m_dispatchGapCount, m_dispatchGapSum / (m_dispatchGapCount * 1e6),
+                     m_dispatchGapMax / 1e6);
+    }
+    if (m_makefile && m_makefile->options()->debugMode && m_fullOccupancyTime >= 0) {
+        printMessage("jom: all %d job slots busy after %.3f ms\n",
+                     maxNumberOfProcesses(), m_fullOccupancyTime / 1e6);
+    }
+    const CommandExecutor::TempFileStatistics &tempFiles = CommandExecutor::tempFileStatistics();
+    if (m_makefile && m_makefile->options()->debugMode && tempFiles.count > 0) {
+        printMessage("jom: %d temporary files with %lld bytes written and removed in %.3f ms\n",
+                     tempFiles.count, tempFiles.bytes, tempFiles.nsecs / 1e6);
+    }
+    const qint64 spilledBytes = OutputBuffer::spilledBytes();
+    if (m_makefile && m_makefile->options()->debugMode && spilledBytes > 0)
+        printMessage("jom: %lld bytes of job output spilled to temporary files\n", spilledBytes);
+    if (m_makefile && m_makefile->options()->debugMode && m_remoteJobsStarted > 0)
+        printMessage("jom: %d targets built on remote workers\n", m_remoteJobsStarted);
+    const ConsoleWriter::Statistics consoleOutput = ConsoleWriter::statistics();
+    if (m_makefile && m_makefile->options()->debugMode && consoleOutput.batches > 0) {
+        printMessage("jom: %lld bytes of console output written in %d batches\n",
+                     consoleOutput.bytes, consoleOutput.batches);
+    }
+    if (m_makefile && m_makefile->options()->debugMode) {
+        for (int i = 0; i < Counters::NumberOfCounters; ++i) {
+            const Counters::Counter counter = static_cast<Counters::Counter>(i);
+            printMessage("jom: %s: %lld\n", Counters::name(counter), Counters::value(counter));
+        }
+    }
+    if (m_jobClient) {
+        m_jobClient->setDemand(0);
+        if (m_makefile && m_makefile->options()->debugMode) {
+            printMessage("jom: waited %.3f ms for job tokens, tokens idle for %.3f ms\n",
+                         m_jobClient->waitingTime() / 1e6, m_jobClient->idleTokenTime() / 1e6);
+        }
+    }
+
     if (exitCode == 0
         && !m_allCommandsSuccessfullyExecuted
         && m_makefile->options()->buildUnrelatedTargetsOnError)
@@ -200,47 +498,95 @@ void TargetExecutor::finishBuild(int exitCode)
     emit finished(exitCode);
 }
 
-void TargetExecutor::findNextTarget()
+DescriptionBlock *TargetExecutor::findNextTarget()
 {
     forever {
-        m_nextTarget = m_depgraph->findAvailableTarget(m_makefile->options()->buildAllTargets);
-        if (m_nextTarget) {
-            if (m_nextTarget->m_commands.isEmpty()) {
+        DescriptionBlock *target
+                = m_depgraph->findAvailableTarget(m_makefile->options()->buildAllTargets);
+        if (target) {
+            if (target->m_commands.isEmpty()) {
                 // Short cut for targets without commands.
-                m_depgraph->removeLeaf(m_nextTarget);
+                m_depgraph->removeLeaf(target);
                 continue;
             } else if (m_makefile->options()->buildUnrelatedTargetsOnError
-                       && m_depgraph->isUnbuildable(m_nextTarget)) {
-                fprintf(stderr, "jom: Target '%s' cannot be built due to failed dependencies.\n",
-                        qPrintable(m_nextTarget->targetName()));
-                m_depgraph->removeLeaf(m_nextTarget);
+                       && m_depgraph->isUnbuildable(target)) {
+                writeMessage("jom: Target '" + target->targetName().toLocal8Bit()
+                             + "' cannot be built due to failed dependencies.\n");
+                m_depgraph->removeLeaf(target);
                 continue;
             }
         }
-        return;
+        return target;
+    }
+}
+
+/**
+ * Prepares the next ready targets in idle executors.
+ * This is done while the running jobs are busy and we're waiting for job tokens,
+ * so that starting a prepared target merely has to spawn its first command.
+ */
+void TargetExecutor::prepareNextTargets()
+{
+    const int maxPreparedTargets = 4;
+    while (m_preparedProcesses.count() < maxPreparedTargets
+           && (!m_availableProcesses.isEmpty() || m_processes.count() < maxNumberOfProcesses()))
+    {
+        DescriptionBlock *target = findNextTarget();
+        if (!target)
+            break;
+        if (m_availableProcesses.isEmpty())
+            m_availableProcesses.append(createCommandExecutor());
+        CommandExecutor *executor = m_availableProcesses.takeFirst();
+        m_preparedProcesses.append(executor);
+        CurrentDirectoryScope directoryScope(target->makefile()->workingDirectory());
+        executor->prepare(target);
+    }
+}
+
+void TargetExecutor::discardPreparedTargets()
+{
+    foreach (CommandExecutor *executor, m_preparedProcesses) {
+        executor->cleanupTempFiles();
+        m_availableProcesses.append(executor);
     }
+    m_preparedProcesses.clear();
 }
 
 void TargetExecutor::onChildFinished(CommandExecutor* executor, bool commandFailed)
 {
     Q_CHECK_PTR(executor->target());
+    CurrentDirectoryScope directoryScope(m_workingDirectory);
     if (commandFailed) {
         m_allCommandsSuccessfullyExecuted = false;
         if (m_makefile->options()->buildUnrelatedTargetsOnError) {
             // Recursively mark all parents of this node as unbuildable due to unsatisfied
             // dependencies. This must happen before removing the node from the build graph.
             m_depgraph->markParentsRecursivlyUnbuildable(executor->target());
-            fputs("jom: Option /K specified. Continuing.\n", stderr);
+            writeMessage("jom: Option /K specified. Continuing.\n");
         }
     }
-    FastFileInfo::clearCacheForFile(executor->target()->targetName());
+    if (m_lastJobFinishedTime < 0)
+        m_lastJobFinishedTime = m_dispatchTimer.nsecsElapsed();
+    if (m_progressTimer.isActive() && !commandFailed && !m_makefile->options()->dryRun) {
+        BuildHistory::instance()->addDuration(BuildHistory::key(executor->target()),
+                                              executor->targetTime() / 1000000);
+    }
+    {
+        CurrentDirectoryScope targetDirectoryScope(
+                    executor->target()->makefile()->workingDirectory());
+        FastFileInfo::clearCacheForFile(executor->target()->targetName());
+    }
     m_depgraph->removeLeaf(executor->target());
-    if (m_jobAcquisitionCount > 0) {
+    if (executor->remoteSlot()) {
+        returnRemoteSlot(executor);
+    } else if (m_jobAcquisitionCount > 0) {
         m_jobClient->release();
         m_jobAcquisitionCount--;
     }
     m_availableProcesses.append(executor);
-    if (!executor->isBufferedOutputSet()) {
+    if (m_makefile->options()->outputSync == Options::OutputSyncForeground
+        && !executor->isBufferedOutputSet())
+    {
         executor->setBufferedOutput(true);
         bool found = false;
         foreach (CommandExecutor *cmdex, m_processes) {
@@ -249,16 +595,24 @@ void TargetExecutor::onChildFinished(CommandExecutor* executor, bool commandFail
                 found = true;
             }
         }
-        if (!found)
-            m_availableProcesses.first()->setBufferedOutput(false);
+        if (!found) {
+            // The next executor to be started gets the unbuffered output.
+            CommandExecutor *next = m_preparedProcesses.isEmpty()
+                    ? m_availableProcesses.first() : m_preparedProcesses.first();
+            next->setBufferedOutput(false);
+        }
     }
 
     bool abortMakeProcess = commandFailed && !m_makefile->options()->buildUnrelatedTargetsOnError;
     if (abortMakeProcess) {
         m_bAborted = true;
+        discardPreparedTargets();
         m_depgraph->clear();
         m_pendingTargets.clear();
-        waitForProcesses();
+        if (m_makefile->options()->failFast)
+            abortProcesses();
+        else
+            waitForProcesses();
         waitForJobClient();
         finishBuild(2);
     }
@@ -268,7 +622,103 @@ void TargetExecutor::onChildFinished(CommandExecutor* executor, bool commandFail
 
 int TargetExecutor::numberOfRunningProcesses() const
 {
-    return m_processes.count() - m_availableProcesses.count();
+    return m_processes.count() - m_availableProcesses.count() - m_preparedProcesses.count();
+}
+
+static QByteArray formatDuration(qint64 msecs)
+{
+    const qint64 secs = (msecs + 999) / 1000;
+    QByteArray result = QByteArray::number(secs / 60 % 60);
+    if (secs >= 3600)
+        result = QByteArray::number(secs / 3600) + ':' + result.rightJustified(2, '0');
+    return result + ':' + QByteArray::number(secs % 60).rightJustified(2, '0');
+}
+
+/**
+ * Estimates the time in milliseconds until the build is done from the build
+ * times of the remaining targets in previous runs. Targets that were never built
+ * before are assumed to take the average time. Returns -1 if nothing is known.
+ */
+qint64 TargetExecutor::estimatedRemainingTime() const
+{
+    const int remainingTargets = m_depgraph->remainingTargetCount();
+    const int knownTargets = remainingTargets - m_depgraph->remainingUnknownDurationCount();
+    if (knownTargets <= 0)
+        return -1;
+
+    const qint64 knownDuration = m_depgraph->remainingKnownDuration();
+    qint64 work = knownDuration
+            + m_depgraph->remainingUnknownDurationCount() * (knownDuration / knownTargets);
+    foreach (CommandExecutor *executor, m_processes) {
+        if (!executor->isActive())
+            continue;
+        const qint64 expected = m_depgraph->expectedDuration(executor->target());
+        const qint64 elapsed = executor->targetTime() / 1000000;
+        work -= expected >= 0 ? qMin(elapsed, expected) : qMin(elapsed, knownDuration / knownTargets);
+    }
+    const int parallelism = qMax(1, qMin(m_maxNumberOfJobs, remainingTargets));
+    return qMax(qint64(0), work) / parallelism;
+}
+
+void TargetExecutor::updateProgress()
+{
+    const int targetCount = m_depgraph->targetCount();
+    QByteArray line = "jom: "
+            + QByteArray::number(targetCount - m_depgraph->remainingTargetCount()) + '/'
+            + QByteArray::number(targetCount) + " targets done, "
+            + QByteArray::number(numberOfRunningProcesses()) + " running";
+    const qint64 remainingTime = estimatedRemainingTime();
+    if (remainingTime >= 0)
+        line += ", about " + formatDuration(remainingTime) + " left";
+    if (m_progressOnConsole)
+        ConsoleWriter::setStatusLine(line);
+    else
+        writeMessage(line + '\n');
+}
+
+/**
+ * Describes what the build is doing right now: the running targets with their
+ * current command lines, followed by the hot-path counters.
+ */
+QByteArray TargetExecutor::statusReport() const
+{
+    QByteArray result = "running jobs: " + QByteArray::number(numberOfRunningProcesses()) + '\n';
+    foreach (CommandExecutor *executor, m_processes) {
+        if (!executor->isActive() || !executor->target())
+            continue;
+        result += "  [" + QByteArray::number(executor->slot()) + "] "
+                + executor->target()->targetName().toLocal8Bit() + " ("
+                + QByteArray::number(executor->currentCommandTime() / 1000000) + " ms): "
+                + executor->currentCommandLine().toLocal8Bit() + '\n';
+    }
+    result += Counters::dump();
+    return result;
+}
+
+/**
+ * Returns a free remote slot for the prepared target or 0 if it must run locally.
+ * Slots whose worker went away are dropped.
+ */
+RemoteSlot *TargetExecutor::takeRemoteSlot(CommandExecutor *executor)
+{
+    if (!executor->canRunRemotely())
+        return 0;
+    while (!m_availableRemoteSlots.isEmpty()) {
+        RemoteSlot *remoteSlot = m_availableRemoteSlots.takeFirst();
+        if (remoteSlot->isConnected())
+            return remoteSlot;
+    }
+    return 0;
+}
+
+void TargetExecutor::returnRemoteSlot(CommandExecutor *executor)
+{
+    RemoteSlot *remoteSlot = executor->remoteSlot();
+    if (!remoteSlot)
+        return;
+    executor->setRemoteSlot(0);
+    m_availableRemoteSlots.append(remoteSlot);
+    m_remoteJobCount--;
 }
 
 void TargetExecutor::removeTempFiles()
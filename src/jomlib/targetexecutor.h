@@ -29,7 +29,10 @@
 #include "makefile.h"
 #include <QObject>
 #include <QEvent>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QMap>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
 
 QT_BEGIN_NAMESPACE
 class QFile;
@@ -40,6 +43,8 @@ namespace NMakeFile {
 class CommandExecutor;
 class DependencyGraph;
 class JobClient;
+class RemoteSlot;
+class RemoteWorkerPool;
 
 class TargetExecutor : public QObject {
     Q_OBJECT
@@ -48,7 +53,13 @@ public:
     ~TargetExecutor();
 
     void apply(Makefile* mkfile, const QStringList& targets);
+    void setMaxNumberOfJobs(int maxNumberOfJobs) { m_maxNumberOfJobs = maxNumberOfJobs; }
+    void setOutputTarget(CommandExecutor *target);
+    void setUpToDateTargets(const QSet<DescriptionBlock *> &targets);
+    void setRemoteWorkerPool(RemoteWorkerPool *pool);
+    void abort();
     void removeTempFiles();
+    QByteArray statusReport() const;
 
 signals:
     void finished(int exitCode);
@@ -57,26 +68,60 @@ private slots:
     void startProcesses();
     void buildNextTarget();
     void onChildFinished(CommandExecutor*, bool commandFailed);
+    void onEnvironmentChanged(const ProcessEnvironment &environment);
+    void updateProgress();
 
 private:
+    CommandExecutor *createCommandExecutor();
+    int maxNumberOfProcesses() const { return m_maxNumberOfJobs + m_remoteSlotCount; }
     int numberOfRunningProcesses() const;
+    void writeMessage(const QByteArray &message);
+    void printMessage(const char *format, ...);
+    RemoteSlot *takeRemoteSlot(CommandExecutor *executor);
+    void returnRemoteSlot(CommandExecutor *executor);
     void waitForProcesses();
+    void abortProcesses();
+    void deleteIncompleteTarget(DescriptionBlock *target);
     void waitForJobClient();
     void finishBuild(int exitCode);
-    void findNextTarget();
+    void applyOutputSync(CommandExecutor *executor);
+    void startPreparedTarget(RemoteSlot *remoteSlot = 0);
+    DescriptionBlock *findNextTarget();
+    void prepareNextTargets();
+    void discardPreparedTargets();
+    qint64 estimatedRemainingTime() const;
 
 private:
     ProcessEnvironment m_environment;
     Makefile* m_makefile;
     DependencyGraph* m_depgraph;
     QList<DescriptionBlock*> m_pendingTargets;
+    QString m_workingDirectory;
     JobClient *m_jobClient;
+    CommandExecutor *m_outputTarget;
+    int m_maxNumberOfJobs;
     bool m_bAborted;
     int m_jobAcquisitionCount;
     QList<CommandExecutor*> m_availableProcesses;
     QList<CommandExecutor*> m_processes;
-    DescriptionBlock *m_nextTarget;
+    QList<CommandExecutor*> m_preparedProcesses;
     bool m_allCommandsSuccessfullyExecuted;
+    QList<RemoteSlot*> m_availableRemoteSlots;
+    int m_remoteSlotCount;
+    int m_remoteJobCount;
+    int m_remoteJobsStarted;
+
+    // Statistics about the time between a job finishing and the next job starting.
+    QElapsedTimer m_dispatchTimer;
+    qint64 m_lastJobFinishedTime;
+    qint64 m_dispatchGapSum;
+    qint64 m_dispatchGapMax;
+    int m_dispatchGapCount;
+    qint64 m_fullOccupancyTime;
+
+    // The progress line for /PROGRESS.
+    QTimer m_progressTimer;
+    bool m_progressOnConsole;
 };
 
 } //namespace NMakeFile
@@ -15,6 +15,7 @@ build_pass:CONFIG(release, debug|release) {
     JOMLIB = $$PROJECT_BUILD_ROOT/lib/$${JOMLIB_PREFIX}jomlib.$$JOMLIB_SUFFIX
 }
 
+QT += network
 LIBS += $$JOMLIB
 POST_TARGETDEPS += $$JOMLIB
 unset(JOMLIB)
@@ -0,0 +1,285 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "benchmarks.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QStringList>
+#include <QtTest/QTest>
+
+#include <dependencygraph.h>
+#include <fastfileinfo.h>
+#include <macrotable.h>
+#include <makefile.h>
+#include <makefilefactory.h>
+#include <makefilelinereader.h>
+#include <options.h>
+#include <parser.h>
+#include <preprocessor.h>
+
+using namespace NMakeFile;
+
+static const int largeMakefileTargetCount = 20000;
+static const int fileCount = 1000;
+
+static QString largeMakefileName()
+{
+    return QLatin1String("large.mk");
+}
+
+static QString graphMakefileName(int targetCount)
+{
+    return QLatin1String("graph") + QString::number(targetCount) + QLatin1String(".mk");
+}
+
+static QString graphTargetName(int targetCount, int i)
+{
+    return QLatin1String("g") + QString::number(targetCount) + QLatin1String("_t") + QString::number(i);
+}
+
+void Benchmarks::initTestCase()
+{
+    QVERIFY(m_tempDir.isValid());
+    m_oldCurrentPath = QDir::currentPath();
+    QDir::setCurrent(m_tempDir.path());
+    generateLargeMakefile(largeMakefileName(), largeMakefileTargetCount);
+    generateGraphMakefile(graphMakefileName(1000), 1000);
+    generateGraphMakefile(graphMakefileName(5000), 5000);
+}
+
+void Benchmarks::cleanupTestCase()
+{
+    QDir::setCurrent(m_oldCurrentPath);
+}
+
+void Benchmarks::writeFile(const QString &fileName, const QByteArray &content)
+{
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::WriteOnly));
+    QCOMPARE(file.write(content), qint64(content.size()));
+}
+
+/**
+ * Writes a makefile of a few megabytes with comments, conditionals,
+ * continued macro definitions, an inference rule and many description blocks.
+ */
+void Benchmarks::generateLargeMakefile(const QString &fileName, int targetCount)
+{
+    QByteArray content = "CFLAGS = /nologo /O2 /W3 /DNDEBUG\n"
+                         "OBJDIR = obj\n\n"
+                         ".SUFFIXES: .cpp .obj\n\n"
+                         ".cpp.obj:\n"
+                         "\tcl $(CFLAGS) /c $< /Fo$@\n\n";
+    for (int i = 0; i < targetCount; ++i) {
+        const QByteArray n = QByteArray::number(i);
+        content += "# target " + n + "\n";
+        if (i % 100 == 0) {
+            content += "!IF " + n + " >= 0\n"
+                       "PART" + n + " = part " + n + " \\\n"
+                       "    continued\n"
+                       "!ENDIF\n";
+        }
+        content += "$(OBJDIR)\\file" + n + ".obj: src\\file" + n + ".cpp inc\\header"
+                + QByteArray::number(i % 50) + ".h\n"
+                "\tcl $(CFLAGS) /c src\\file" + n + ".cpp /Fo$(OBJDIR)\\file" + n + ".obj\n"
+                "\t@echo built $@\n\n";
+    }
+    writeFile(fileName, content);
+}
+
+/**
+ * Writes a makefile whose targets form a binary tree and creates the target files,
+ * so that the time stamp checks hit the file attribute cache.
+ */
+void Benchmarks::generateGraphMakefile(const QString &fileName, int targetCount)
+{
+    QByteArray content = "all: " + graphTargetName(targetCount, 0).toLatin1() + "\n\n";
+    for (int i = 0; i < targetCount; ++i) {
+        const QString targetName = graphTargetName(targetCount, i);
+        content += targetName.toLatin1() + ':';
+        for (int child = 2 * i + 1; child <= 2 * i + 2 && child < targetCount; ++child)
+            content += ' ' + graphTargetName(targetCount, child).toLatin1();
+        content += "\n\t@rem\n\n";
+        writeFile(targetName, QByteArray());
+    }
+    writeFile(fileName, content);
+}
+
+void Benchmarks::expandMacros_data()
+{
+    QTest::addColumn<QString>("expression");
+    QTest::newRow("deep nesting") << QString::fromLatin1("$(NESTED200)");
+    QTest::newRow("huge value") << QString::fromLatin1("$(HUGE)");
+    QTest::newRow("substitution") << QString::fromLatin1("$(SOURCES:.cpp=.obj)");
+    QString manyInvocations;
+    for (int i = 0; i < 1000; ++i)
+        manyInvocations += QLatin1String("$(CFLAGS) ");
+    QTest::newRow("many invocations") << manyInvocations;
+}
+
+void Benchmarks::expandMacros()
+{
+    QFETCH(QString, expression);
+
+    MacroTable macroTable;
+    macroTable.setMacroValue("CFLAGS", "/nologo /O2 /W3");
+    macroTable.setMacroValue("NESTED0", "x");
+    for (int i = 1; i <= 200; ++i) {
+        macroTable.setMacroValue(QLatin1String("NESTED") + QString::number(i),
+                                 QLatin1String("$(NESTED") + QString::number(i - 1)
+                                 + QLatin1String(")x"));
+    }
+    macroTable.setMacroValue("HUGE", QString(1024 * 1024, QLatin1Char('h')));
+    QString sources;
+    for (int i = 0; i < 10000; ++i)
+        sources += QLatin1String("src\\file") + QString::number(i) + QLatin1String(".cpp ");
+    macroTable.setMacroValue("SOURCES", sources);
+
+    QString result;
+    QBENCHMARK {
+        result = macroTable.expandMacros(expression);
+    }
+    QVERIFY(!result.isEmpty());
+}
+
+void Benchmarks::makefileLineReader()
+{
+    int lineCount = 0;
+    QBENCHMARK {
+        MakefileLineReader reader(largeMakefileName());
+        QVERIFY(reader.open());
+        lineCount = 0;
+        while (!reader.readLine(false).content.isNull())
+            ++lineCount;
+    }
+    QVERIFY(lineCount > largeMakefileTargetCount);
+}
+
+void Benchmarks::preprocessorReadLine()
+{
+    int lineCount = 0;
+    QBENCHMARK {
+        MacroTable macroTable;
+        Preprocessor pp;
+        pp.setMacroTable(&macroTable);
+        QVERIFY(pp.openFile(largeMakefileName()));
+        lineCount = 0;
+        while (!pp.readLine().isNull())
+            ++lineCount;
+    }
+    QVERIFY(lineCount > largeMakefileTargetCount);
+}
+
+void Benchmarks::parser()
+{
+    int targetCount = 0;
+    QBENCHMARK {
+        MacroTable *macroTable = new MacroTable;
+        Makefile mkfile(largeMakefileName());
+        mkfile.setOptions(new Options);
+        mkfile.setMacroTable(macroTable);
+        Preprocessor pp;
+        pp.setMacroTable(macroTable);
+        QVERIFY(pp.openFile(largeMakefileName()));
+        Parser parser;
+        parser.apply(&pp, &mkfile);
+        targetCount = mkfile.targets().count();
+    }
+    QVERIFY(targetCount >= largeMakefileTargetCount);
+}
+
+void Benchmarks::dependencyGraph_data()
+{
+    QTest::addColumn<int>("targetCount");
+    QTest::newRow("1000 targets") << 1000;
+    QTest::newRow("5000 targets") << 5000;
+}
+
+/**
+ * Builds the graph and takes all targets out of it like a build would.
+ */
+void Benchmarks::dependencyGraph()
+{
+    QFETCH(int, targetCount);
+
+    MakefileFactory factory;
+    QVERIFY(factory.apply(QStringList() << QLatin1String("/F") << graphMakefileName(targetCount)));
+    QScopedPointer<Makefile> mkfile(factory.makefile());
+    DescriptionBlock *root = mkfile->target(QLatin1String("all"));
+    QVERIFY(root);
+
+    int builtTargets = 0;
+    QBENCHMARK {
+        DependencyGraph graph;
+        graph.build(root);
+        builtTargets = 0;
+        while (DescriptionBlock *target = graph.findAvailableTarget(true)) {
+            graph.removeLeaf(target);
+            ++builtTargets;
+        }
+    }
+    QCOMPARE(builtTargets, targetCount + 1);
+}
+
+void Benchmarks::fastFileInfo_data()
+{
+    QTest::addColumn<bool>("existingFiles");
+    QTest::addColumn<bool>("clearCache");
+    QTest::newRow("cache hit") << true << false;
+    QTest::newRow("cache miss") << true << true;
+    QTest::newRow("nonexistent file") << false << false;
+}
+
+void Benchmarks::fastFileInfo()
+{
+    QFETCH(bool, existingFiles);
+    QFETCH(bool, clearCache);
+
+    QStringList fileNames;
+    for (int i = 0; i < fileCount; ++i) {
+        fileNames += existingFiles
+                ? graphTargetName(1000, i)
+                : QLatin1String("missing") + QString::number(i);
+    }
+    FastFileInfo::clearCache();
+    foreach (const QString &fileName, fileNames)
+        FastFileInfo fileInfo(fileName);
+
+    int existing = 0;
+    QBENCHMARK {
+        if (clearCache)
+            FastFileInfo::clearCache();
+        existing = 0;
+        foreach (const QString &fileName, fileNames) {
+            if (FastFileInfo(fileName).exists())
+                ++existing;
+        }
+    }
+    QCOMPARE(existing, existingFiles ? fileCount : 0);
+}
+
+QTEST_MAIN(Benchmarks)
@@ -0,0 +1,64 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QTemporaryDir>
+
+/**
+ * Micro-benchmarks of jomlib's hot paths.
+ * The input makefiles and files are generated into a temporary directory.
+ */
+class Benchmarks : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void expandMacros_data();
+    void expandMacros();
+    void makefileLineReader();
+    void preprocessorReadLine();
+    void parser();
+    void dependencyGraph_data();
+    void dependencyGraph();
+    void fastFileInfo_data();
+    void fastFileInfo();
+
+private:
+    void writeFile(const QString &fileName, const QByteArray &content);
+    void generateLargeMakefile(const QString &fileName, int targetCount);
+    void generateGraphMakefile(const QString &fileName, int targetCount);
+
+private:
+    QTemporaryDir m_tempDir;
+    QString m_oldCurrentPath;
+};
+
+#endif // BENCHMARKS_H
@@ -0,0 +1,19 @@
+TEMPLATE = app
+QT += testlib
+INCLUDEPATH += ../../src/jomlib
+
+CONFIG(debug, debug|release) {
+    TARGET = jom-benchd
+} else {
+    TARGET = jom-bench
+}
+
+PROJECT_BUILD_ROOT=$$OUT_PWD/../..
+include(../../src/jomlib/use_jomlib.pri)
+
+contains(QMAKE_CXXFLAGS_RELEASE, -MT) {
+    QMAKE_LFLAGS_RELEASE += /NODEFAULTLIB:msvcrt
+}
+
+HEADERS += benchmarks.h
+SOURCES += benchmarks.cpp
@@ -0,0 +1,14 @@
+!INCLUDE message.mk
+
+all:
+	@echo $(MESSAGE)
+
+# The build server doesn't watch files outside of its directory.
+external: ..\external.out
+
+..\external.out: ..\external.txt
+	@copy /b ..\external.txt ..\external.out >NUL
+	@echo copied
+
+failing:
+	@exit 5
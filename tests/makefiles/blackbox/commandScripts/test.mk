@@ -0,0 +1,34 @@
+# test the /ONESHELL option
+
+all: echoAndSilence sharedShell ignoreExitCodes percentSigns batchFile
+    @echo ---SUCCESS---
+
+echoAndSilence:
+    echo first & rem
+    @echo second
+
+# Every command would be run by its own shell without /ONESHELL.
+sharedShell:
+    @set JOMTESTVAR=shared & rem
+    @set JOMTESTVAR & rem
+
+ignoreExitCodes:
+    -cmd /c exit 3
+    -4cmd /c exit 4
+    @echo ignoreExitCodes done
+
+# Lines with percent signs are run one by one, as without /ONESHELL.
+percentSigns:
+    @echo %%1 %%~dp0
+    @echo %%JOMUNDEFINEDVAR%%
+
+# Control would not come back from the batch file in a shared script.
+batchFile:
+    @helper
+    @echo after helper
+
+# target failingTarget is supposed to fail
+failingTarget:
+    @echo before failure
+    -2cmd /c exit 7
+    @echo We should not see this.
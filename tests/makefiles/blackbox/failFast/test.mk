@@ -0,0 +1,18 @@
+# test the /FAILFAST option
+# The slow targets must be killed as soon as failingTarget fails.
+
+all: incomplete.txt precious.txt failingTarget
+
+.PRECIOUS: precious.txt
+
+incomplete.txt:
+    @echo incomplete>incomplete.txt
+    @ping -n 60 127.0.0.1 >NUL
+
+precious.txt:
+    @echo precious>precious.txt
+    @ping -n 60 127.0.0.1 >NUL
+
+failingTarget:
+    @ping -n 3 127.0.0.1 >NUL
+    @cmd /c exit 7
@@ -0,0 +1,6 @@
+# Writes two lines with a pause in between.
+
+all:
+	@echo $(NAME)1
+	@ping -n 2 127.0.0.1 >NUL
+	@echo $(NAME)2
@@ -0,0 +1,17 @@
+all: sub1 sub2
+	@echo all done
+
+sub1:
+	@cd sub1 && $(MAKE) /nologo /f Makefile
+
+sub2:
+	@$(MAKE) /nologo /f sub2.mk
+
+failing:
+	@cd sub1 && $(MAKE) /nologo /f Makefile failing
+	@echo We should not see this.
+
+parallel: subA subB
+
+subA subB:
+	@$(MAKE) /nologo /f paused.mk NAME=$@
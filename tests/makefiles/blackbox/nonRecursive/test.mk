@@ -0,0 +1,10 @@
+.NONRECURSIVE:
+
+all: sub1 sub2
+	@echo all done
+
+sub1:
+	@cd sub1 && $(MAKE) /nologo /f Makefile
+
+sub2:
+	@cd sub2 && $(MAKE) /nologo /f Makefile
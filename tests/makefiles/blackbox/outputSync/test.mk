@@ -0,0 +1,10 @@
+# Two jobs that write their output with pauses in between.
+
+all: a b
+
+a b:
+    @echo $@1
+    @ping -n 2 127.0.0.1 >NUL
+    @echo $@2
+    @ping -n 2 127.0.0.1 >NUL
+    @echo $@3
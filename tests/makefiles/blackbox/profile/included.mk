@@ -0,0 +1 @@
+GREETING = hello
@@ -0,0 +1,8 @@
+# Exercises the code paths that /PROFILE measures.
+
+!include included.mk
+
+all: first second
+
+first second:
+    @echo $@
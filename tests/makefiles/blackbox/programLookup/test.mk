@@ -0,0 +1,10 @@
+# test that programs built during the build are started directly
+
+all: second
+
+first:
+    -@jomtesttool /c exit 0
+    @copy /y %%ComSpec%% jomtesttool.exe >NUL
+
+second: first
+    @jomtesttool /c echo second
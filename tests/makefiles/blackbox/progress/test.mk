@@ -0,0 +1,6 @@
+# One target that takes about three seconds.
+
+all: slow
+
+slow:
+    @ping -n 4 127.0.0.1 >NUL
@@ -0,0 +1,7 @@
+all: sub1 sub2
+
+sub1:
+	@$(MAKE) /nologo /f sub.mk ID=1
+
+sub2:
+	@$(MAKE) /nologo /f sub.mk ID=2
@@ -0,0 +1,9 @@
+all: a b c d
+
+a b c:
+	@echo built $@
+
+d:
+	@type <<
+built d
+<<
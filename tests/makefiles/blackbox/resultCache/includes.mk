@@ -0,0 +1,15 @@
+main.obj: main.c
+	@echo building main.obj
+	@type main.c header.h > main.obj
+
+unresolved.obj: unresolved.c
+	@echo building unresolved.obj
+	@type unresolved.c > unresolved.obj
+
+first.txt second.txt: in.txt
+	@echo building $@
+	@type in.txt > $@
+
+debug.obj: in.txt
+	@echo building debug.obj
+	@type in.txt > debug.obj & rem /Zi
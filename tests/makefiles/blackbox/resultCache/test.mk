@@ -0,0 +1,3 @@
+out.txt: in.txt
+	@echo building out.txt
+	@type in.txt > out.txt
@@ -0,0 +1 @@
+#include "doesnotexist.h"
@@ -0,0 +1 @@
+@set JOMLEAKVAR=leaked
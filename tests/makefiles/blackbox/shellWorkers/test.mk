@@ -0,0 +1,24 @@
+# test the /SHELLWORKERS option
+
+all: output exitCodes isolation
+    @echo ---SUCCESS---
+
+output:
+    @echo first & echo second
+    @echo to stderr 1>&2 & rem
+
+# The second command must not see the error level of the first one.
+exitCodes:
+    -@cmd /c exit 5 & rem
+    @echo after ignored error & rem
+
+# setvar runs setvar.bat, which must not change the shell of the following commands.
+isolation:
+    @setvar & rem
+    @echo JOMLEAKVAR=%%JOMLEAKVAR%% & rem
+
+# target failingTarget is supposed to fail
+failingTarget:
+    @echo before failure & rem
+    @cmd /c exit 7 & rem
+    @echo We should not see this.
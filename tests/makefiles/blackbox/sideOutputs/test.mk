@@ -0,0 +1,19 @@
+# The writer sub-make writes side.lib besides its target.
+# The last sub-make must see the new time stamp of side.lib.
+
+all:
+	@$(MAKE) /nologo /f test.mk reader.txt
+	@$(MAKE) /nologo /f test.mk reader.txt
+	@$(MAKE) /nologo /f test.mk writer
+	@$(MAKE) /nologo /f test.mk reader.txt
+
+reader.txt: side.lib
+	@echo building reader.txt
+	@type side.lib > reader.txt
+
+side.lib:
+	@echo old> side.lib
+
+writer:
+	@ping -n 2 127.0.0.1 >NUL
+	@echo new> side.lib
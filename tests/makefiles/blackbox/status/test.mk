@@ -0,0 +1,7 @@
+# One job that runs long enough to ask jom what it is doing.
+
+all: slow
+
+slow:
+    @echo started
+    @ping -n 5 127.0.0.1 >NUL
@@ -0,0 +1,11 @@
+# Batch mode rule with an inline response file.
+
+.SUFFIXES: .in .out
+
+all: a.out b.out c.out
+
+.in.out::
+	@type <<
+$<
+<<
+	@for %%f in ($<) do @copy %%f %%~nf.out >NUL
@@ -0,0 +1,7 @@
+# Two targets for the /TRACE timeline.
+
+all: first second
+
+first second:
+    @echo $@
+    @echo $@ done
@@ -0,0 +1,9 @@
+all: out.txt copy.txt
+
+out.txt: in.txt
+	@echo building out.txt
+	@type in.txt > out.txt
+
+copy.txt: source.txt
+	@echo building copy.txt
+	@type source.txt > copy.txt
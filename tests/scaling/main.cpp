@@ -0,0 +1,257 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "makefilegenerator.h"
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
+#include <QtCore/QProcess>
+#include <QtCore/QRegExp>
+#include <QtCore/QTemporaryDir>
+
+#include <cstdio>
+
+/**
+ * The numbers one jom run reports with /DEBUG.
+ */
+struct RunResult
+{
+    RunResult()
+        : wallTime(0), idleSlotTime(0), averageDispatchGap(0)
+        , peakWorkingSet(0), processesStarted(0)
+    {}
+
+    qint64 wallTime;            // ms
+    double idleSlotTime;        // ms
+    double averageDispatchGap;  // ms
+    qint64 peakWorkingSet;      // KiB
+    qint64 processesStarted;
+};
+
+static QList<int> parseNumbers(const QString &str, bool *ok)
+{
+    QList<int> result;
+    *ok = true;
+    foreach (const QString &s, str.split(QLatin1Char(','), QString::SkipEmptyParts)) {
+        const int n = s.toInt(ok);
+        if (!*ok || n <= 0) {
+            *ok = false;
+            break;
+        }
+        result += n;
+    }
+    return result;
+}
+
+static double captureDouble(const QString &text, const QString &pattern)
+{
+    QRegExp rx(pattern);
+    return rx.indexIn(text) >= 0 ? rx.cap(1).toDouble() : 0.0;
+}
+
+static bool runJom(const QString &jom, const QString &directory, int jobs,
+                   RunResult *result, QString *errorString)
+{
+    QProcess process;
+    process.setWorkingDirectory(directory);
+    process.setProcessChannelMode(QProcess::SeparateChannels);
+    const QStringList arguments = QStringList()
+            << QLatin1String("/nologo") << QLatin1String("/s") << QLatin1String("/debug")
+            << QLatin1String("/j") << QString::number(jobs)
+            << QLatin1String("/f") << QLatin1String("test.mk");
+
+    QElapsedTimer timer;
+    timer.start();
+    process.start(jom, arguments);
+    if (!process.waitForFinished(-1)) {
+        *errorString = QLatin1String("Cannot run ") + jom + QLatin1String(": ")
+                + process.errorString();
+        return false;
+    }
+    result->wallTime = timer.elapsed();
+
+    // The /DEBUG output goes to stderr. Read stdout anyway, so that a full pipe cannot block jom.
+    process.readAllStandardOutput();
+    const QString output = QString::fromLocal8Bit(process.readAllStandardError());
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+        *errorString = QLatin1String("jom failed in ") + directory + QLatin1String(":\n")
+                + output.right(2000);
+        return false;
+    }
+
+    result->idleSlotTime = captureDouble(output, QLatin1String("tokens idle for ([0-9.]+) ms"));
+    result->averageDispatchGap = captureDouble(output, QLatin1String("average gap ([0-9.]+) ms"));
+    result->peakWorkingSet = qint64(captureDouble(output,
+                                                  QLatin1String("peak working set ([0-9]+) KiB")));
+    result->processesStarted = qint64(captureDouble(output,
+                                                    QLatin1String("processes started: ([0-9]+)")));
+    return true;
+}
+
+static int generate(const QCommandLineParser &parser, MakefileGenerator *generator)
+{
+    const QStringList positionalArguments = parser.positionalArguments();
+    if (positionalArguments.count() != 2) {
+        fprintf(stderr, "jom-scaling: generate needs an output directory.\n");
+        return 128;
+    }
+    bool ok;
+    const QList<int> targetCounts = parseNumbers(parser.value(QLatin1String("targets")), &ok);
+    MakefileGenerator::Shape shape;
+    if (!ok || targetCounts.count() != 1
+        || !MakefileGenerator::shapeFromName(parser.value(QLatin1String("shape")), &shape))
+    {
+        fprintf(stderr, "jom-scaling: generate needs one shape and one target count.\n");
+        return 128;
+    }
+    generator->setShape(shape);
+    generator->setTargetCount(targetCounts.first());
+    QString errorString;
+    if (!generator->generate(positionalArguments.at(1), &errorString)) {
+        fprintf(stderr, "jom-scaling: %s\n", qPrintable(errorString));
+        return 2;
+    }
+    return 0;
+}
+
+static int run(const QCommandLineParser &parser, MakefileGenerator *generator)
+{
+    bool targetCountsOk, jobCountsOk, runCountOk;
+    const QList<int> targetCounts = parseNumbers(parser.value(QLatin1String("targets")),
+                                                 &targetCountsOk);
+    const QList<int> jobCounts = parseNumbers(parser.value(QLatin1String("jobs")), &jobCountsOk);
+    const int runCount = parser.value(QLatin1String("runs")).toInt(&runCountOk);
+    if (!targetCountsOk || !jobCountsOk || !runCountOk || runCount <= 0) {
+        fprintf(stderr, "jom-scaling: invalid number in the options.\n");
+        return 128;
+    }
+
+    const QStringList shapeNames = parser.value(QLatin1String("shape")).split(QLatin1Char(','));
+    QList<MakefileGenerator::Shape> shapes;
+    foreach (const QString &name, shapeNames) {
+        MakefileGenerator::Shape shape;
+        if (!MakefileGenerator::shapeFromName(name, &shape)) {
+            fprintf(stderr, "jom-scaling: unknown shape %s.\n", qPrintable(name));
+            return 128;
+        }
+        shapes += shape;
+    }
+
+    QString jom = parser.value(QLatin1String("jom"));
+    if (jom.isEmpty())
+        jom = QCoreApplication::applicationDirPath() + QLatin1String("/jom.exe");
+    if (!QFileInfo(jom).exists()) {
+        fprintf(stderr, "jom-scaling: %s does not exist. Pass --jom.\n", qPrintable(jom));
+        return 2;
+    }
+
+    printf("shape,targets,jobs,wall_ms,overhead_us_per_target,idle_slot_ms,"
+           "avg_dispatch_gap_ms,peak_rss_kib,processes_started\n");
+    fflush(stdout);
+    for (int s = 0; s < shapes.count(); ++s) {
+        foreach (int targetCount, targetCounts) {
+            QTemporaryDir directory;
+            QString errorString;
+            generator->setShape(shapes.at(s));
+            generator->setTargetCount(targetCount);
+            if (!directory.isValid() || !generator->generate(directory.path(), &errorString)) {
+                fprintf(stderr, "jom-scaling: %s\n", qPrintable(errorString));
+                return 2;
+            }
+            foreach (int jobs, jobCounts) {
+                // The fastest run is the least disturbed by the rest of the system.
+                RunResult best;
+                for (int i = 0; i < runCount; ++i) {
+                    RunResult result;
+                    if (!runJom(jom, directory.path(), jobs, &result, &errorString)) {
+                        fprintf(stderr, "jom-scaling: %s\n", qPrintable(errorString));
+                        return 2;
+                    }
+                    if (i == 0 || result.wallTime < best.wallTime)
+                        best = result;
+                }
+                printf("%s,%d,%d,%lld,%.1f,%.3f,%.3f,%lld,%lld\n",
+                       qPrintable(shapeNames.at(s)), targetCount, jobs, best.wallTime,
+                       best.wallTime * 1000.0 / targetCount, best.idleSlotTime,
+                       best.averageDispatchGap, best.peakWorkingSet, best.processesStarted);
+                fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String(
+            "Generates synthetic makefiles and measures how jom scales with them.\n"
+            "The run mode prints one CSV line per shape, target count and /J value."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QLatin1String("mode"),
+                                 QLatin1String("generate <directory> or run"));
+    parser.addOption(QCommandLineOption(QLatin1String("shape"),
+            QLatin1String("Makefile shapes, separated by commas: ")
+                + MakefileGenerator::shapeNames().join(QLatin1String(", ")),
+            QLatin1String("shapes"), MakefileGenerator::shapeNames().join(QLatin1String(","))));
+    parser.addOption(QCommandLineOption(QLatin1String("targets"),
+            QLatin1String("Numbers of targets, separated by commas."),
+            QLatin1String("counts"), QLatin1String("1000,10000")));
+    parser.addOption(QCommandLineOption(QLatin1String("depth"),
+            QLatin1String("Number of layers of the wide, deep and diamond shapes."),
+            QLatin1String("n"), QLatin1String("0")));
+    parser.addOption(QCommandLineOption(QLatin1String("fan-in"),
+            QLatin1String("Number of dependencies per target of the layered shapes."),
+            QLatin1String("n"), QLatin1String("0")));
+    parser.addOption(QCommandLineOption(QLatin1String("spawn"),
+            QLatin1String("Start a process for every command.")));
+    parser.addOption(QCommandLineOption(QLatin1String("jobs"),
+            QLatin1String("Values of /J, separated by commas."),
+            QLatin1String("counts"), QLatin1String("1,2,4,8")));
+    parser.addOption(QCommandLineOption(QLatin1String("runs"),
+            QLatin1String("Runs per measurement. The fastest run is reported."),
+            QLatin1String("n"), QLatin1String("3")));
+    parser.addOption(QCommandLineOption(QLatin1String("jom"),
+            QLatin1String("The jom to measure. Defaults to jom.exe next to jom-scaling."),
+            QLatin1String("path")));
+    parser.process(app);
+
+    MakefileGenerator generator;
+    generator.setDepth(parser.value(QLatin1String("depth")).toInt());
+    generator.setFanIn(parser.value(QLatin1String("fan-in")).toInt());
+    generator.setSpawnProcesses(parser.isSet(QLatin1String("spawn")));
+
+    const QString mode = parser.positionalArguments().value(0);
+    if (mode == QLatin1String("generate"))
+        return generate(parser, &generator);
+    if (mode == QLatin1String("run"))
+        return run(parser, &generator);
+    parser.showHelp(128);
+    return 128;
+}
@@ -0,0 +1,194 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "makefilegenerator.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+
+#include <cmath>
+
+// The dependency graph is built recursively. Much deeper chains overflow the stack.
+static const int maxDefaultDepth = 500;
+
+MakefileGenerator::MakefileGenerator()
+    : m_shape(Wide)
+    , m_targetCount(1000)
+    , m_depth(0)
+    , m_fanIn(0)
+    , m_spawnProcesses(false)
+{
+}
+
+QStringList MakefileGenerator::shapeNames()
+{
+    return QStringList() << QLatin1String("wide") << QLatin1String("deep")
+                         << QLatin1String("diamond") << QLatin1String("batch")
+                         << QLatin1String("inline");
+}
+
+bool MakefileGenerator::shapeFromName(const QString &name, Shape *shape)
+{
+    const int idx = shapeNames().indexOf(name.toLower());
+    if (idx < 0)
+        return false;
+    *shape = static_cast<Shape>(idx);
+    return true;
+}
+
+static bool writeFile(const QString &fileName, const QByteArray &content, QString *errorString)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly) || file.write(content) != content.size()) {
+        *errorString = QLatin1String("Cannot write ") + fileName;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Writes test.mk and the files it needs into directory.
+ */
+bool MakefileGenerator::generate(const QString &directory, QString *errorString) const
+{
+    if (!QDir().mkpath(directory)) {
+        *errorString = QLatin1String("Cannot create ") + directory;
+        return false;
+    }
+
+    const int defaultDepth = qMin(m_targetCount, maxDefaultDepth);
+    QByteArray content;
+    switch (m_shape) {
+    case Wide:
+        content = layeredMakefile(m_depth > 0 ? m_depth : 1, m_fanIn > 0 ? m_fanIn : 1);
+        break;
+    case Deep:
+        content = layeredMakefile(m_depth > 0 ? m_depth : defaultDepth, m_fanIn > 0 ? m_fanIn : 1);
+        break;
+    case Diamond:
+        content = layeredMakefile(m_depth > 0 ? m_depth : qMax(2, int(std::sqrt(double(m_targetCount)))),
+                                  m_fanIn > 0 ? m_fanIn : 4);
+        break;
+    case BatchMode:
+        {
+            const QDir dir(directory);
+            if (!dir.mkpath(QLatin1String("src")) || !dir.mkpath(QLatin1String("obj"))) {
+                *errorString = QLatin1String("Cannot create the source directories in ") + directory;
+                return false;
+            }
+            for (int i = 0; i < m_targetCount; ++i) {
+                const QString fileName = QLatin1String("src/f") + QString::number(i) + QLatin1String(".c");
+                if (!writeFile(dir.filePath(fileName), QByteArray(), errorString))
+                    return false;
+            }
+            content = batchModeMakefile();
+        }
+        break;
+    case InlineFiles:
+        content = inlineFilesMakefile();
+        break;
+    }
+    return writeFile(QDir(directory).filePath(QLatin1String("test.mk")), content, errorString);
+}
+
+static QByteArray macroDefinition(const QByteArray &name, const QList<QByteArray> &values)
+{
+    QByteArray result = name + " =";
+    for (int i = 0; i < values.count(); ++i) {
+        if (i % 10 == 0)
+            result += " \\\n   ";
+        result += ' ' + values.at(i);
+    }
+    return result + "\n\n";
+}
+
+static QByteArray layeredTargetName(int layer, int i)
+{
+    return 't' + QByteArray::number(layer) + '_' + QByteArray::number(i);
+}
+
+QByteArray MakefileGenerator::command(const QByteArray &arguments) const
+{
+    return (m_spawnProcesses ? "\t@cmd /c rem " : "\t@rem ") + arguments + '\n';
+}
+
+/**
+ * The layers get the same number of targets. Target i of a layer depends on the
+ * targets i * fanIn ... i * fanIn + fanIn - 1 of the next layer, modulo its size.
+ */
+QByteArray MakefileGenerator::layeredMakefile(int depth, int fanIn) const
+{
+    depth = qBound(1, depth, m_targetCount);
+    QVector<int> layerSizes(depth);
+    for (int k = 0; k < depth; ++k)
+        layerSizes[k] = m_targetCount / depth + (k < m_targetCount % depth ? 1 : 0);
+
+    QList<QByteArray> goals;
+    for (int i = 0; i < layerSizes.first(); ++i)
+        goals += layeredTargetName(0, i);
+    QByteArray content = macroDefinition("GOALS", goals);
+    content += "all: $(GOALS)\n\n";
+
+    for (int k = 0; k < depth; ++k) {
+        for (int i = 0; i < layerSizes.at(k); ++i) {
+            content += layeredTargetName(k, i) + ':';
+            if (k + 1 < depth) {
+                const int nextLayerSize = layerSizes.at(k + 1);
+                for (int j = 0; j < qMin(fanIn, nextLayerSize); ++j)
+                    content += ' ' + layeredTargetName(k + 1, (i * fanIn + j) % nextLayerSize);
+            }
+            content += '\n' + command("$@") + '\n';
+        }
+    }
+    return content;
+}
+
+QByteArray MakefileGenerator::batchModeMakefile() const
+{
+    QList<QByteArray> objects;
+    for (int i = 0; i < m_targetCount; ++i)
+        objects += "obj\\f" + QByteArray::number(i) + ".obj";
+    QByteArray content = macroDefinition("OBJECTS", objects);
+    content += "all: $(OBJECTS)\n\n";
+    content += "{src}.c{obj}.obj::\n" + command("$<") + '\n';
+    return content;
+}
+
+QByteArray MakefileGenerator::inlineFilesMakefile() const
+{
+    QList<QByteArray> goals;
+    for (int i = 0; i < m_targetCount; ++i)
+        goals += 't' + QByteArray::number(i);
+    QByteArray content = macroDefinition("GOALS", goals);
+    content += "all: $(GOALS)\n\n";
+    foreach (const QByteArray &goal, goals) {
+        content += goal + ":\n" + command("<<")
+                + "inline file of $@\n"
+                  "<<\n\n";
+    }
+    return content;
+}
@@ -0,0 +1,81 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of jom.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef MAKEFILEGENERATOR_H
+#define MAKEFILEGENERATOR_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+/**
+ * Writes synthetic NMake makefiles whose commands are trivial.
+ *
+ * Wide, deep and diamond makefiles arrange the targets in layers. Every target
+ * depends on fanIn targets of the next layer. The other shapes build object
+ * files with a batch-mode inference rule or write an inline file per target.
+ * By default the commands are shell comments, which jom handles without
+ * starting a process.
+ */
+class MakefileGenerator
+{
+public:
+    enum Shape
+    {
+        Wide,
+        Deep,
+        Diamond,
+        BatchMode,
+        InlineFiles
+    };
+
+    MakefileGenerator();
+
+    static QStringList shapeNames();
+    static bool shapeFromName(const QString &name, Shape *shape);
+
+    void setShape(Shape shape) { m_shape = shape; }
+    void setTargetCount(int count) { m_targetCount = count; }
+    void setDepth(int depth) { m_depth = depth; }
+    void setFanIn(int fanIn) { m_fanIn = fanIn; }
+    void setSpawnProcesses(bool b) { m_spawnProcesses = b; }
+
+    bool generate(const QString &directory, QString *errorString) const;
+
+private:
+    QByteArray layeredMakefile(int depth, int fanIn) const;
+    QByteArray batchModeMakefile() const;
+    QByteArray inlineFilesMakefile() const;
+    QByteArray command(const QByteArray &arguments) const;
+
+private:
+    Shape m_shape;
+    int m_targetCount;
+    int m_depth;
+    int m_fanIn;
+    bool m_spawnProcesses;
+};
+
+#endif // MAKEFILEGENERATOR_H
@@ -0,0 +1,13 @@
+TEMPLATE = app
+QT = core
+CONFIG += console
+CONFIG -= app_bundle
+
+CONFIG(debug, debug|release) {
+    TARGET = jom-scalingd
+} else {
+    TARGET = jom-scaling
+}
+
+HEADERS += makefilegenerator.h
+SOURCES += main.cpp makefilegenerator.cpp
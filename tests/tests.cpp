@@ -27,17 +27,26 @@
 
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QScopedPointer>
 #include <QStringBuilder>
+#include <QTemporaryDir>
 #include <QTest>
 
 #include <ppexprparser.h>
 #include <makefilefactory.h>
 #include <preprocessor.h>
 #include <parser.h>
+#include <buildhistory.h>
 #include <options.h>
 #include <exception.h>
+#include <consolewriter.h>
+#include <outputbuffer.h>
+#include <sharedstatcache.h>
 
 #include <algorithm>
 #include <functional>
@@ -929,8 +938,7 @@ void Tests::windowsPathsInTargetName()
 /**
  * Note: this function clears the environment of m_jomProcess after every start.
  */
-bool Tests::runJom(const QStringList &args, const QString &workingDirectory,
-                   QProcess::ProcessChannelMode channelMode)
+static QString findJomBinary()
 {
 #ifdef _DEBUG
     const QLatin1String jomBinaryName("jomd.exe");
@@ -944,6 +952,28 @@ bool Tests::runJom(const QStringList &args, const QString &workingDirectory,
             qDebug("could not find jom");
         }
     }
+    return jomBinary;
+}
+
+/**
+ * Reads the output of process until it contains text.
+ */
+static bool waitForOutput(QProcess *process, const QByteArray &text, QByteArray *output)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!output->contains(text)) {
+        if (timer.elapsed() > 10000 || !process->waitForReadyRead(10000))
+            return false;
+        output->append(process->readAll());
+    }
+    return true;
+}
+
+bool Tests::runJom(const QStringList &args, const QString &workingDirectory,
+                   QProcess::ProcessChannelMode channelMode)
+{
+    const QString jomBinary = findJomBinary();
     QString oldWorkingDirectory;
     if (!workingDirectory.isNull()) {
         oldWorkingDirectory = QDir::currentPath();
@@ -1362,4 +1392,794 @@ void Tests::outOfDateCheck()
     QVERIFY(output.isEmpty());
 }
 
+void Tests::commandScripts()
+{
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j1" << "/oneshell" << "/f" << "test.mk",
+                   "blackbox/commandScripts"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QStringList output = readJomStdOutput();
+    QCOMPARE(output.takeFirst(), QLatin1String("echo first & rem"));
+    QCOMPARE(output.takeFirst(), QLatin1String("first"));
+    QCOMPARE(output.takeFirst(), QLatin1String("second"));
+    QCOMPARE(output.takeFirst(), QLatin1String("JOMTESTVAR=shared"));
+    QCOMPARE(output.takeFirst(), QLatin1String("cmd /c exit 3"));
+    QCOMPARE(output.takeFirst(), QLatin1String("cmd /c exit 4"));
+    QCOMPARE(output.takeFirst(), QLatin1String("ignoreExitCodes done"));
+    QCOMPARE(output.takeFirst(), QLatin1String("%1 %~dp0"));
+    QCOMPARE(output.takeFirst(), QLatin1String("%JOMUNDEFINEDVAR%"));
+    QCOMPARE(output.takeFirst(), QLatin1String("in helper"));
+    QCOMPARE(output.takeFirst(), QLatin1String("after helper"));
+    QCOMPARE(output.takeFirst(), QLatin1String("---SUCCESS---"));
+    QVERIFY(output.isEmpty());
+
+    QVERIFY(runJom(QStringList() << "/nologo" << "/oneshell" << "/f" << "test.mk"
+                   << "failingTarget", "blackbox/commandScripts", QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 2);
+    const QByteArray out = m_jomProcess->readAllStandardOutput();
+    QVERIFY(out.contains("before failure"));
+    QVERIFY(!out.contains("We should not see this."));
+    const QList<QByteArray> err = splitOutput(m_jomProcess->readAllStandardError());
+    QVERIFY(std::find_if(err.begin(), err.end(), [] (const QByteArray &line)
+                { return line.endsWith("[failingTarget] Error 7"); }) != err.end());
+}
+
+void Tests::shellWorkers()
+{
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j1" << "/shellworkers" << "/f" << "test.mk",
+                   "blackbox/shellWorkers", QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QStringList output = readJomStdOutput();
+    QCOMPARE(output.takeFirst(), QLatin1String("first"));
+    QCOMPARE(output.takeFirst(), QLatin1String("second"));
+    QCOMPARE(output.takeFirst(), QLatin1String("after ignored error"));
+    QCOMPARE(output.takeFirst(), QLatin1String("JOMLEAKVAR=%JOMLEAKVAR%"));
+    QCOMPARE(output.takeFirst(), QLatin1String("---SUCCESS---"));
+    QVERIFY(output.isEmpty());
+    const QList<QByteArray> err = splitOutput(m_jomProcess->readAllStandardError());
+    QVERIFY(err.contains("to stderr"));
+
+    QVERIFY(runJom(QStringList() << "/nologo" << "/shellworkers" << "/f" << "test.mk"
+                   << "failingTarget", "blackbox/shellWorkers", QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 2);
+    const QByteArray out = m_jomProcess->readAllStandardOutput();
+    QVERIFY(out.contains("before failure"));
+    QVERIFY(!out.contains("We should not see this."));
+}
+
+void Tests::programLookup()
+{
+    const QString tool = QLatin1String("blackbox/programLookup/jomtesttool.exe");
+    QFile::remove(tool);
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j1" << "/debug" << "/f" << "test.mk",
+                   "blackbox/programLookup", QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), QStringList() << "second");
+
+    // The first lookup of jomtesttool must not be used for the second target.
+    const QList<QByteArray> err = splitOutput(m_jomProcess->readAllStandardError());
+    QVERIFY(err.contains("jom: shells avoided: 1"));
+    QFile::remove(tool);
+}
+
+void Tests::failFast()
+{
+    const QString incompleteTarget = QLatin1String("blackbox/failFast/incomplete.txt");
+    const QString preciousTarget = QLatin1String("blackbox/failFast/precious.txt");
+    QFile::remove(incompleteTarget);
+    QFile::remove(preciousTarget);
+
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j3" << "/failfast" << "/f" << "test.mk",
+                   "blackbox/failFast", QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 2);
+    QVERIFY(timer.elapsed() < 30000);
+    const QList<QByteArray> err = splitOutput(m_jomProcess->readAllStandardError());
+    QVERIFY(std::find_if(err.begin(), err.end(), [] (const QByteArray &line)
+                { return line.endsWith("[failingTarget] Error 7"); }) != err.end());
+    QVERIFY(!QFile::exists(incompleteTarget));
+    QVERIFY(QFile::exists(preciousTarget));
+    QFile::remove(preciousTarget);
+}
+
+void Tests::dispatchRampUp()
+{
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j64" << "/debug" << "/f" << "test.mk",
+                   "blackbox/dispatchRampUp", QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    const QList<QByteArray> err = splitOutput(m_jomProcess->readAllStandardError());
+    QList<QByteArray>::const_iterator it = std::find_if(err.begin(), err.end(),
+                [] (const QByteArray &line)
+                { return line.startsWith("jom: all 64 job slots busy after"); });
+    QVERIFY(it != err.end());
+    it = std::find_if(err.begin(), err.end(),
+                      [] (const QByteArray &line)
+                      { return line.startsWith("jom: waited "); });
+    QVERIFY(it != err.end());
+}
+
+void Tests::recursiveJobServer()
+{
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j4" << "/f" << "test.mk",
+                   "blackbox/recursiveJobServer"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QStringList output = readJomStdOutput();
+    output.sort();
+    QCOMPARE(output, QStringList() << "1a" << "1b" << "1c" << "2a" << "2b" << "2c");
+}
+
+void Tests::inProcessSubMakes()
+{
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j1" << "/f" << "test.mk",
+                   "blackbox/inProcessSubMakes"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    const QStringList expectedOutput = readJomStdOutput();
+    QCOMPARE(expectedOutput.count(), 4);
+    QVERIFY(expectedOutput.at(1).endsWith(QLatin1String("sub1")));
+
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j1" << "/inprocess" << "/f" << "test.mk",
+                   "blackbox/inProcessSubMakes"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), expectedOutput);
+
+    QVERIFY(runJom(QStringList() << "/nologo" << "/inprocess" << "/f" << "test.mk" << "failing",
+                   "blackbox/inProcessSubMakes", QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 2);
+    QVERIFY(!m_jomProcess->readAllStandardOutput().contains("We should not see this."));
+    const QList<QByteArray> err = splitOutput(m_jomProcess->readAllStandardError());
+    QVERIFY(std::find_if(err.begin(), err.end(), [] (const QByteArray &line)
+                { return line.endsWith("[failing] Error 5"); }) != err.end());
+    QVERIFY(std::find_if(err.begin(), err.end(), [] (const QByteArray &line)
+                { return line.endsWith("[failing] Error 2"); }) != err.end());
+
+    // The output of each sub-make goes through the job that runs it.
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j2" << "/inprocess" << "/Orecurse"
+                                 << "/f" << "test.mk" << "parallel",
+                   "blackbox/inProcessSubMakes"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    const QStringList linesOfA = QStringList() << "subA1" << "subA2";
+    const QStringList linesOfB = QStringList() << "subB1" << "subB2";
+    const QStringList lines = readJomStdOutput();
+    QVERIFY(lines == linesOfA + linesOfB || lines == linesOfB + linesOfA);
+}
+
+void Tests::nonRecursive()
+{
+    QVERIFY(runJom(QStringList() << "/nologo" << "/dumpgraph" << "/f" << "test.mk",
+                   "blackbox/nonRecursive"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), QStringList() << "all" << " sub1" << "  all" << "   sub1.txt"
+                                                << " sub2" << "  all" << "   sub2.txt");
+
+    const QString sub1Target = QLatin1String("blackbox/nonRecursive/sub1/sub1.txt");
+    const QString sub2Target = QLatin1String("blackbox/nonRecursive/sub2/sub2.txt");
+    QFile::remove(sub1Target);
+    QFile::remove(sub2Target);
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j2" << "/f" << "test.mk",
+                   "blackbox/nonRecursive"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QStringList output = readJomStdOutput();
+    QCOMPARE(output.takeLast(), QLatin1String("all done"));
+    output.sort();
+    QCOMPARE(output.count(), 2);
+    QVERIFY(output.at(0).endsWith(QLatin1String("sub1")));
+    QVERIFY(output.at(1).endsWith(QLatin1String("sub2")));
+    QVERIFY(QFile::exists(sub1Target));
+    QVERIFY(QFile::exists(sub2Target));
+    QFile::remove(sub1Target);
+    QFile::remove(sub2Target);
+}
+
+void Tests::buildServer()
+{
+    const QString directory = QLatin1String("blackbox/buildServer/workspace");
+    const QString includeFileName = directory + QLatin1String("/message.mk");
+    const QString externalFileName = QLatin1String("blackbox/buildServer/external.txt");
+    const QString externalOutputFileName = QLatin1String("blackbox/buildServer/external.out");
+    QFile includeFile(includeFileName);
+    QVERIFY(includeFile.open(QFile::WriteOnly));
+    includeFile.write("MESSAGE=first\n");
+    includeFile.close();
+    QFile externalFile(externalFileName);
+    QVERIFY(externalFile.open(QFile::WriteOnly));
+    externalFile.write("external\n");
+    externalFile.close();
+    QFile::remove(externalOutputFileName);
+
+    QProcess server;
+    server.setWorkingDirectory(directory);
+    server.start(findJomBinary(), QStringList() << "/server");
+    QVERIFY(server.waitForStarted());
+    server.setReadChannel(QProcess::StandardError);
+    QByteArray serverOutput;
+    QVERIFY(waitForOutput(&server, "jom: build server running", &serverOutput));
+
+    const QStringList arguments = QStringList() << "/nologo" << "/useserver" << "/f" << "test.mk";
+    QVERIFY(runJom(arguments, directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), QStringList() << "first");
+
+    // Changing an included file invalidates the parsed makefile.
+    // The server handles the change before it starts the build.
+    QVERIFY(includeFile.open(QFile::WriteOnly));
+    includeFile.write("MESSAGE=second\n");
+    includeFile.close();
+    QVERIFY(runJom(arguments, directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), QStringList() << "second");
+
+    QVERIFY(runJom(QStringList(arguments) << "failing", directory));
+    QCOMPARE(m_jomProcess->exitCode(), 2);
+
+    // The time stamps of files outside of the server's directory are read for every build.
+    QVERIFY(runJom(QStringList(arguments) << "external", directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), QStringList() << "copied");
+    QVERIFY(runJom(QStringList(arguments) << "external", directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QVERIFY(readJomStdOutput().isEmpty());
+    touchFile(externalFileName);
+    QVERIFY(runJom(QStringList(arguments) << "external", directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), QStringList() << "copied");
+
+    // Without a server, jom builds by itself.
+    server.kill();
+    server.waitForFinished();
+    QVERIFY(runJom(arguments, directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), QStringList() << "second");
+    QFile::remove(includeFileName);
+    QFile::remove(externalFileName);
+    QFile::remove(externalOutputFileName);
+    QFile::remove(directory + QLatin1String("/.jomserver"));
+}
+
+void Tests::watchMode()
+{
+    const QString directory = QLatin1String("blackbox/watchMode");
+    const QString inputFileName = directory + QLatin1String("/in.txt");
+    const QString outputFileName = directory + QLatin1String("/out.txt");
+    const QString copyFileName = directory + QLatin1String("/copy.txt");
+    QFile inputFile(inputFileName);
+    QVERIFY(inputFile.open(QFile::WriteOnly));
+    inputFile.write("first\n");
+    inputFile.close();
+    QFile::remove(outputFileName);
+    QFile::remove(copyFileName);
+
+    QProcess jom;
+    jom.setWorkingDirectory(directory);
+    jom.setProcessChannelMode(QProcess::MergedChannels);
+    jom.start(findJomBinary(), QStringList() << "/nologo" << "/watch" << "/f" << "test.mk");
+    QVERIFY(jom.waitForStarted());
+    QByteArray output;
+    QVERIFY(waitForOutput(&jom, "watching", &output));
+    QVERIFY(output.contains("building out.txt"));
+    QVERIFY(output.contains("building copy.txt"));
+
+    // Only the targets that depend on the changed file are checked.
+    QVERIFY(inputFile.open(QFile::WriteOnly));
+    inputFile.write("second\n");
+    inputFile.close();
+    output.clear();
+    QVERIFY(waitForOutput(&jom, "watching", &output));
+    QVERIFY(output.contains("rebuilding"));
+    QVERIFY(output.contains("jom: 1 targets are not affected by the changes"));
+    QVERIFY(output.contains("building out.txt"));
+    QVERIFY(!output.contains("building copy.txt"));
+    jom.kill();
+    jom.waitForFinished();
+
+    QFile outputFile(outputFileName);
+    QVERIFY(outputFile.open(QFile::ReadOnly));
+    QCOMPARE(outputFile.readAll().trimmed(), QByteArray("second"));
+    outputFile.close();
+    QFile::remove(inputFileName);
+    QFile::remove(outputFileName);
+    QFile::remove(copyFileName);
+}
+
+void Tests::sharedStatCache()
+{
+    QVERIFY(SharedStatCache::create());
+    QScopedPointer<SharedStatCache> cache(SharedStatCache::instance());
+    QVERIFY(SharedStatCache::attach(cache->name()));
+
+    FastFileInfo::InternalType attributes;
+    memset(&attributes, 0x2a, sizeof(attributes));
+    const QString filePath = QLatin1String("C:\\Some\\Header.h");
+    const quint32 generation = cache->generation();
+    cache->insert(filePath, attributes, generation);
+
+    FastFileInfo::InternalType foundAttributes;
+    QVERIFY(cache->find(QLatin1String("c:\\some\\header.h"), &foundAttributes));
+    QVERIFY(memcmp(&attributes, &foundAttributes, sizeof(attributes)) == 0);
+    QVERIFY(!cache->find(QLatin1String("C:\\Some\\Other.h"), &foundAttributes));
+
+    cache->invalidate(filePath);
+    QVERIFY(cache->generation() != generation);
+    QVERIFY(!cache->find(filePath, &foundAttributes));
+
+    // Attributes that were read before an invalidation are not published.
+    cache->insert(filePath, attributes, generation);
+    QVERIFY(!cache->find(filePath, &foundAttributes));
+    cache->insert(filePath, attributes, cache->generation());
+    QVERIFY(cache->find(filePath, &foundAttributes));
+
+    // The invalidation log tells which paths to drop from the private caches.
+    const QString otherFilePath = QLatin1String("C:\\Some\\Other.h");
+    const quint32 generationBeforeInvalidation = cache->generation();
+    cache->invalidate(filePath);
+    cache->invalidate(otherFilePath);
+    QSet<quint32> pathHashes;
+    QVERIFY(cache->invalidatedPathHashes(generationBeforeInvalidation, cache->generation(),
+                                         &pathHashes));
+    QCOMPARE(pathHashes, QSet<quint32>() << SharedStatCache::pathHash(filePath)
+                                         << SharedStatCache::pathHash(otherFilePath));
+    pathHashes.clear();
+    QVERIFY(!cache->invalidatedPathHashes(0, cache->generation() + 1000, &pathHashes));
+    const quint32 generationBeforeInvalidateAll = cache->generation();
+    cache->invalidateAll();
+    QVERIFY(!cache->invalidatedPathHashes(generationBeforeInvalidateAll, cache->generation(),
+                                          &pathHashes));
+
+    // Invalidated slots are reused. Otherwise the table would fill up here.
+    for (int i = 0; i < 20000; ++i) {
+        cache->insert(filePath, attributes, cache->generation());
+        QVERIFY(cache->find(filePath, &foundAttributes));
+        cache->invalidate(filePath);
+    }
+    cache->insert(filePath, attributes, cache->generation());
+    QVERIFY(cache->find(filePath, &foundAttributes));
+}
+
+void Tests::sideOutputs()
+{
+    const QString directory = QLatin1String("blackbox/sideOutputs");
+    const QStringList outputFiles = QStringList() << "reader.txt" << "side.lib";
+    foreach (const QString &fileName, outputFiles)
+        QFile::remove(directory + QLatin1Char('/') + fileName);
+
+    // Without /SHAREDSTATCACHE every sub-jom reads the time stamps itself.
+    QVERIFY(runJom(QStringList() << "/nologo" << "/f" << "test.mk", directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), QStringList() << "building reader.txt" << "building reader.txt");
+
+    foreach (const QString &fileName, outputFiles)
+        QVERIFY(QFile::remove(directory + QLatin1Char('/') + fileName));
+}
+
+void Tests::resultCache()
+{
+    const QString directory = QLatin1String("blackbox/resultCache");
+    const QString cacheDirectory = QDir(directory).absoluteFilePath(QLatin1String("cache"));
+    const QString inputFileName = directory + QLatin1String("/in.txt");
+    const QString outputFileName = directory + QLatin1String("/out.txt");
+    QDir(cacheDirectory).removeRecursively();
+    QFile::remove(outputFileName);
+    QFile inputFile(inputFileName);
+    QVERIFY(inputFile.open(QFile::WriteOnly));
+    inputFile.write("cached\n");
+    inputFile.close();
+
+    QStringList environment = QProcessEnvironment::systemEnvironment().toStringList();
+    environment << QLatin1String("JOMCACHEDIR=") + cacheDirectory;
+    m_jomProcess->setEnvironment(environment);
+    QVERIFY(runJom(QStringList() << "/nologo" << "/cache" << "/f" << "test.mk", directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QByteArray output = m_jomProcess->readAllStandardOutput();
+    QVERIFY(output.contains("building out.txt"));
+
+    // The output is restored instead of being rebuilt.
+    QVERIFY(QFile::remove(outputFileName));
+    m_jomProcess->setEnvironment(environment);
+    QVERIFY(runJom(QStringList() << "/nologo" << "/cache" << "/f" << "test.mk", directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    output = m_jomProcess->readAllStandardOutput();
+    QVERIFY(!output.contains("building out.txt"));
+    QVERIFY(output.contains("restored out.txt from the result cache"));
+    QFile outputFile(outputFileName);
+    QVERIFY(outputFile.open(QFile::ReadOnly));
+    QCOMPARE(outputFile.readAll().trimmed(), QByteArray("cached"));
+    outputFile.close();
+
+    // A changed dependent leads to a different cache key.
+    QVERIFY(inputFile.open(QFile::WriteOnly));
+    inputFile.write("changed\n");
+    inputFile.close();
+    m_jomProcess->setEnvironment(environment);
+    QVERIFY(runJom(QStringList() << "/nologo" << "/cache" << "/f" << "test.mk", directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    output = m_jomProcess->readAllStandardOutput();
+    QVERIFY(output.contains("building out.txt"));
+
+    // Included files are part of the key. Targets with unresolved includes or
+    // with more outputs than the target file are never cached.
+    const QString headerFileName = directory + QLatin1String("/header.h");
+    QFile headerFile(headerFileName);
+    QVERIFY(headerFile.open(QFile::WriteOnly));
+    headerFile.write("// first\n");
+    headerFile.close();
+    const QStringList outputFileNames = QStringList() << "main.obj" << "unresolved.obj"
+                                                      << "first.txt" << "second.txt" << "debug.obj";
+    const QStringList arguments = QStringList() << "/nologo" << "/cache" << "/f" << "includes.mk"
+                                                << outputFileNames;
+    m_jomProcess->setEnvironment(environment);
+    QVERIFY(runJom(arguments, directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    output = m_jomProcess->readAllStandardOutput();
+    foreach (const QString &fileName, outputFileNames)
+        QVERIFY(output.contains("building " + fileName.toLatin1()));
+
+    foreach (const QString &fileName, outputFileNames)
+        QVERIFY(QFile::remove(directory + QLatin1Char('/') + fileName));
+    m_jomProcess->setEnvironment(environment);
+    QVERIFY(runJom(arguments, directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    output = m_jomProcess->readAllStandardOutput();
+    QVERIFY(output.contains("restored main.obj from the result cache"));
+    foreach (const QString &fileName, outputFileNames.mid(1))
+        QVERIFY(output.contains("building " + fileName.toLatin1()));
+
+    QVERIFY(headerFile.open(QFile::WriteOnly));
+    headerFile.write("// second\n");
+    headerFile.close();
+    QVERIFY(QFile::remove(directory + QLatin1String("/main.obj")));
+    m_jomProcess->setEnvironment(environment);
+    QVERIFY(runJom(QStringList() << "/nologo" << "/cache" << "/f" << "includes.mk" << "main.obj",
+                   directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    output = m_jomProcess->readAllStandardOutput();
+    QVERIFY(output.contains("building main.obj"));
+
+    QDir(cacheDirectory).removeRecursively();
+    QFile::remove(inputFileName);
+    QFile::remove(outputFileName);
+    QFile::remove(headerFileName);
+    foreach (const QString &fileName, outputFileNames)
+        QFile::remove(directory + QLatin1Char('/') + fileName);
+}
+
+void Tests::remoteWorkers()
+{
+    // Without a shared secret, the worker refuses to listen on other addresses than loopback.
+    QStringList environment = QProcessEnvironment::systemEnvironment().toStringList();
+    environment = environment.filter(QRegExp(QLatin1String("^(?!JOMWORKERSECRET=)"),
+                                             Qt::CaseInsensitive));
+    QProcess worker;
+    worker.setEnvironment(environment);
+    worker.start(findJomBinary(), QStringList() << "/worker" << "0.0.0.0:0");
+    QVERIFY(worker.waitForFinished());
+    QCOMPARE(worker.exitCode(), 2);
+    QVERIFY(worker.readAllStandardError().contains("requires a shared secret"));
+
+    worker.setEnvironment(environment + (QStringList() << "JOMWORKERSECRET=sesame"));
+    worker.start(findJomBinary(), QStringList() << "/worker" << "0");
+    QVERIFY(worker.waitForStarted());
+    QByteArray output;
+    QVERIFY(waitForOutput(&worker, "with", &output));
+    QRegExp rx(QLatin1String("worker listening on 127\\.0\\.0\\.1:(\\d+) "));
+    QVERIFY(rx.indexIn(QString::fromLocal8Bit(output)) >= 0);
+    const QString workerAddress = QLatin1String("127.0.0.1:") + rx.cap(1);
+    const QStringList arguments = QStringList() << "/nologo" << "/j1" << "/debug"
+                                                << "/remote" << workerAddress
+                                                << "/f" << "test.mk";
+
+    // With one job token the other targets can only run on the worker.
+    m_jomProcess->setEnvironment(environment + (QStringList() << "JOMWORKERSECRET=sesame"));
+    QVERIFY(runJom(arguments, "blackbox/remoteWorkers", QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QStringList lines = readJomStdOutput();
+    lines.sort();
+    QCOMPARE(lines, QStringList() << "built a" << "built b" << "built c" << "built d");
+    QVERIFY(m_jomProcess->readAllStandardError().contains("targets built on remote workers"));
+
+    // A client that doesn't know the secret cannot run commands on the worker.
+    m_jomProcess->setEnvironment(environment);
+    QVERIFY(runJom(arguments, "blackbox/remoteWorkers", QProcess::SeparateChannels));
+    QVERIFY(m_jomProcess->exitCode() != 0);
+    QVERIFY(m_jomProcess->readAllStandardError().contains("lost the connection to worker"));
+
+    worker.kill();
+    worker.waitForFinished();
+}
+
+void Tests::temporaryFiles()
+{
+    const QString directory = QLatin1String("blackbox/temporaryFiles");
+    const QStringList outputFiles = QStringList() << "a.out" << "b.out" << "c.out";
+    foreach (const QString &fileName, outputFiles)
+        QFile::remove(directory + QLatin1Char('/') + fileName);
+
+    QVERIFY(runJom(QStringList() << "/nologo" << "/debug" << "/f" << "test.mk", directory));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QCOMPARE(readJomStdOutput(), QStringList() << "a.in b.in c.in");
+    const QList<QByteArray> err = splitOutput(m_jomProcess->readAllStandardError());
+    QList<QByteArray>::const_iterator it = std::find_if(err.begin(), err.end(),
+                [] (const QByteArray &line)
+                { return line.startsWith("jom: 1 temporary files with "); });
+    QVERIFY(it != err.end());
+
+    // The response file contains "a.in b.in c.in\r\n".
+    const QList<QByteArray> words = it->split(' ');
+    QVERIFY(words.count() > 5);
+    QCOMPARE(words.at(5), QByteArray("16"));
+
+    foreach (const QString &fileName, outputFiles)
+        QVERIFY(QFile::remove(directory + QLatin1Char('/') + fileName));
+}
+
+static QByteArray replayedStandardOutput;
+static QByteArray replayedOutput;
+
+static void recordReplayedOutput(FILE *stream, const char *data, size_t count)
+{
+    if (stream == stdout)
+        replayedStandardOutput.append(data, int(count));
+    replayedOutput.append(stream == stdout ? "O:" : "E:");
+    replayedOutput.append(data, int(count));
+}
+
+void Tests::outputBuffer()
+{
+    QByteArray expectedStandardOutput;
+    for (int limit = 1; limit <= 1024 * 1024; limit *= 1024) {
+        OutputBuffer::setLimits(limit, 1024 * 1024);
+        const qint64 spilledBytes = OutputBuffer::spilledBytes();
+        OutputBuffer buffer;
+        QVERIFY(buffer.isEmpty());
+        expectedStandardOutput.clear();
+        for (int i = 0; i < 5000; ++i) {
+            const QByteArray line = "line " + QByteArray::number(i) + "\n";
+            buffer.append(OutputBuffer::StandardOutput, line.constData(), line.size());
+            expectedStandardOutput += line;
+        }
+        // This one doesn't fit into the rest of a 64 KiB arena block.
+        const QByteArray bigOutput(100000, 'x');
+        buffer.append(OutputBuffer::StandardOutput, bigOutput.constData(), bigOutput.size());
+        expectedStandardOutput += bigOutput;
+        buffer.append(OutputBuffer::StandardError, "error\n", 6);
+        buffer.appendMessage(OutputBuffer::StandardError, "message\n");
+        buffer.append(OutputBuffer::StandardOutput, "done\n", 5);
+        expectedStandardOutput += "done\n";
+        QVERIFY(!buffer.isEmpty());
+        QCOMPARE(OutputBuffer::spilledBytes() > spilledBytes, limit == 1);
+
+        replayedStandardOutput.clear();
+        replayedOutput.clear();
+        buffer.replay(stdout, stderr, recordReplayedOutput);
+        QVERIFY(buffer.isEmpty());
+        QCOMPARE(replayedStandardOutput, expectedStandardOutput);
+        QVERIFY(replayedOutput.endsWith("E:error\nE:message\nO:done\n"));
+    }
+    OutputBuffer::setLimits(8 * 1024 * 1024, 128 * 1024 * 1024);
+}
+
+void Tests::noisyJobs()
+{
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j64" << "/f" << "test.mk",
+                   "blackbox/noisyJobs"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    const QStringList lines = readJomStdOutput();
+    QCOMPARE(lines.count(), 64 * 2000);
+    QCOMPARE(lines.count(QLatin1String("2000")), 64);
+}
+
+void Tests::outputSync()
+{
+    const QStringList linesOfA = QStringList() << "a1" << "a2" << "a3";
+    const QStringList linesOfB = QStringList() << "b1" << "b2" << "b3";
+
+    // The output of each target is written in one piece.
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j2" << "/Otarget" << "/f" << "test.mk",
+                   "blackbox/outputSync"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QStringList lines = readJomStdOutput();
+    QVERIFY(lines == linesOfA + linesOfB || lines == linesOfB + linesOfA);
+
+    // Lines are written as they arrive and are not mixed up. Whether the lines of
+    // the targets actually interleave depends on the scheduling.
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j2" << "/Oline" << "/f" << "test.mk",
+                   "blackbox/outputSync"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    lines = readJomStdOutput();
+    QCOMPARE(lines.filter(QRegExp(QLatin1String("^a"))), linesOfA);
+    QCOMPARE(lines.filter(QRegExp(QLatin1String("^b"))), linesOfB);
+    lines.sort();
+    QCOMPARE(lines, linesOfA + linesOfB);
+}
+
+void Tests::consoleWriter()
+{
+    FILE *file = tmpfile();
+    QVERIFY(file);
+    const ConsoleWriter::Statistics statistics = ConsoleWriter::statistics();
+    QByteArray expected;
+    for (int i = 0; i < 10000; ++i) {
+        const QByteArray line = "line " + QByteArray::number(i) + "\n";
+        if (i % 100 == 0)
+            ConsoleWriter::writeText(file, line);
+        else
+            ConsoleWriter::write(file, line.constData(), line.size());
+        expected += line;
+    }
+    ConsoleWriter::flush();
+
+    // Everything arrives in order, written in far fewer batches than writes.
+    QVERIFY(ConsoleWriter::statistics().batches - statistics.batches < 1000);
+    rewind(file);
+    QByteArray written(expected.size() + 1, 0);
+    QCOMPARE(int(fread(written.data(), 1, written.size(), file)), expected.size());
+    written.chop(1);
+    QCOMPARE(written, expected);
+    fclose(file);
+}
+
+void Tests::profile()
+{
+    QVERIFY(runJom(QStringList() << "/nologo" << "/profile" << "/f" << "test.mk",
+                   "blackbox/profile"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QStringList lines = readJomStdOutput();
+    lines.sort();
+    QCOMPARE(lines, QStringList() << "first" << "second");
+
+    const QByteArray err = m_jomProcess->readAllStandardError();
+    QVERIFY(err.startsWith("jom profile"));
+    QVERIFY(err.contains("\n  read makefile "));
+    QVERIFY(err.contains("\n    parse "));
+    QVERIFY(err.contains("\n      read line "));
+    QVERIFY(err.contains("\n        include file "));
+    QVERIFY(err.contains("\n  build dependency graph "));
+    QVERIFY(err.contains("\n  start process "));
+}
+
+void Tests::buildTrace()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString traceFileName = tempDir.path() + QLatin1String("/trace.json");
+    QVERIFY(runJom(QStringList() << "/nologo" << "/j2" << "/trace" << traceFileName
+                   << "/f" << "test.mk", "blackbox/trace"));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+
+    QFile traceFile(traceFileName);
+    QVERIFY(traceFile.open(QFile::ReadOnly));
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(traceFile.readAll(), &parseError);
+    QCOMPARE(parseError.error, QJsonParseError::NoError);
+
+    QStringList targets;
+    QStringList commands;
+    QStringList phases;
+    QStringList slotNames;
+    foreach (const QJsonValue &value, document.object().value(QLatin1String("traceEvents")).toArray()) {
+        const QJsonObject event = value.toObject();
+        const QString name = event.value(QLatin1String("name")).toString();
+        const QString category = event.value(QLatin1String("cat")).toString();
+        if (event.value(QLatin1String("ph")).toString() == QLatin1String("M")) {
+            slotNames.append(event.value(QLatin1String("args")).toObject()
+                             .value(QLatin1String("name")).toString());
+            continue;
+        }
+        QVERIFY(event.value(QLatin1String("dur")).toDouble() >= 0);
+        if (category == QLatin1String("target")) {
+            QVERIFY(event.value(QLatin1String("tid")).toInt() > 0);
+            QCOMPARE(event.value(QLatin1String("args")).toObject()
+                     .value(QLatin1String("exitCode")).toInt(), 0);
+            targets.append(name);
+        } else if (category == QLatin1String("command")) {
+            commands.append(name);
+        } else if (category == QLatin1String("jom")) {
+            phases.append(name);
+        }
+    }
+
+    targets.sort();
+    QCOMPARE(targets, QStringList() << "first" << "second");
+    QCOMPARE(commands.count(), 4);
+    QVERIFY(commands.contains(QLatin1String("echo first done")));
+    QVERIFY(phases.contains(QLatin1String("read makefile")));
+    QVERIFY(phases.contains(QLatin1String("build dependency graph")));
+    QVERIFY(slotNames.contains(QLatin1String("jom")));
+    QVERIFY(slotNames.contains(QLatin1String("job slot 2")));
+}
+
+void Tests::counters()
+{
+    QVERIFY(runJom(QStringList() << "/nologo" << "/debug" << "/f" << "test.mk",
+                   "blackbox/profile", QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    const QByteArray err = m_jomProcess->readAllStandardError();
+    QVERIFY(err.contains("jom: stat calls: "));
+    QVERIFY(err.contains("jom: macro expansions: "));
+    QVERIFY(err.contains("jom: target lookups: "));
+    QVERIFY(err.contains("jom: processes started: "));
+    QVERIFY(!err.contains("jom: target lookups: 0\n"));
+}
+
+void Tests::statusServer()
+{
+    // Without /STATUSSERVER nobody answers.
+    QProcess jom;
+    jom.setWorkingDirectory(QLatin1String("blackbox/status"));
+    jom.start(findJomBinary(), QStringList() << "/nologo" << "/f" << "test.mk");
+    QVERIFY(jom.waitForStarted());
+    QByteArray output;
+    QVERIFY(waitForOutput(&jom, "started", &output));
+    QVERIFY(runJom(QStringList() << "/status" << QString::number(jom.pid()->dwProcessId)));
+    QCOMPARE(m_jomProcess->exitCode(), 2);
+    jom.kill();
+    jom.waitForFinished();
+
+    jom.start(findJomBinary(), QStringList() << "/nologo" << "/statusserver" << "/f" << "test.mk");
+    QVERIFY(jom.waitForStarted());
+    output.clear();
+    QVERIFY(waitForOutput(&jom, "started", &output));
+
+    const QString pid = QString::number(jom.pid()->dwProcessId);
+    QVERIFY(runJom(QStringList() << "/status" << pid));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    const QByteArray status = m_jomProcess->readAllStandardOutput();
+    QVERIFY(status.startsWith("running jobs: 1\n"));
+    QVERIFY(status.contains("] slow ("));
+    QVERIFY(status.contains("ping -n 5 127.0.0.1"));
+    QVERIFY(status.contains("\nprocesses started: "));
+    QVERIFY(jom.waitForFinished());
+    QCOMPARE(jom.exitCode(), 0);
+
+    QVERIFY(runJom(QStringList() << "/status" << pid));
+    QCOMPARE(m_jomProcess->exitCode(), 2);
+}
+
+void Tests::buildHistory()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString fileName = tempDir.path() + QLatin1String("/durations/history.txt");
+    {
+        BuildHistory history(fileName);
+        QCOMPARE(history.duration("c:/project/foo.obj"), qint64(-1));
+        history.addDuration("c:/project/foo.obj", 1000);
+        history.addDuration("c:/project/foo.obj", 3000);
+        history.addDuration("c:/project/bar.obj", 500);
+        QCOMPARE(history.duration("c:/project/foo.obj"), qint64(2000));
+        QVERIFY(history.save());
+    }
+
+    BuildHistory history(fileName);
+    QCOMPARE(history.duration("c:/project/foo.obj"), qint64(2000));
+    QCOMPARE(history.duration("c:/project/bar.obj"), qint64(500));
+    QCOMPARE(history.duration("c:/project/baz.obj"), qint64(-1));
+}
+
+void Tests::progress()
+{
+    const QString directory = QLatin1String("blackbox/progress");
+    const QString cacheDirectory = QDir(directory).absoluteFilePath(QLatin1String("cache"));
+    QDir(cacheDirectory).removeRecursively();
+    QStringList environment = QProcessEnvironment::systemEnvironment().toStringList();
+    environment << QLatin1String("JOMCACHEDIR=") + cacheDirectory;
+    m_jomProcess->setEnvironment(environment);
+
+    // Nothing is known about the target in the first run.
+    QVERIFY(runJom(QStringList() << "/nologo" << "/progress" << "/f" << "test.mk", directory,
+                   QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    QByteArray err = m_jomProcess->readAllStandardError();
+    QVERIFY(err.contains("jom: 0/1 targets done, 1 running\n"));
+    QCOMPARE(QDir(cacheDirectory + QLatin1String("/durations")).entryList(QDir::Files).count(), 1);
+
+    // The second run knows how long the target takes.
+    m_jomProcess->setEnvironment(environment);
+    QVERIFY(runJom(QStringList() << "/nologo" << "/progress" << "/f" << "test.mk", directory,
+                   QProcess::SeparateChannels));
+    QCOMPARE(m_jomProcess->exitCode(), 0);
+    err = m_jomProcess->readAllStandardError();
+    QVERIFY(err.contains("jom: 0/1 targets done, 1 running, about 0:0"));
+
+    QDir(cacheDirectory).removeRecursively();
+}
+
 QTEST_MAIN(Tests)
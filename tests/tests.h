@@ -85,6 +85,31 @@ private slots:
     void nonexistentDependent();
     void noTargets();
     void outOfDateCheck();
+    void commandScripts();
+    void shellWorkers();
+    void programLookup();
+    void failFast();
+    void dispatchRampUp();
+    void recursiveJobServer();
+    void inProcessSubMakes();
+    void nonRecursive();
+    void buildServer();
+    void watchMode();
+    void sharedStatCache();
+    void sideOutputs();
+    void resultCache();
+    void remoteWorkers();
+    void temporaryFiles();
+    void outputBuffer();
+    void noisyJobs();
+    void outputSync();
+    void consoleWriter();
+    void profile();
+    void buildTrace();
+    void counters();
+    void statusServer();
+    void buildHistory();
+    void progress();
 
 private:
     bool openMakefile(const QString& fileName);